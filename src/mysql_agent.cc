@@ -54,6 +54,9 @@ using namespace nova::guest::diagnostics;
 using namespace nova::guest::monitoring;
 using namespace nova::db::mysql;
 using namespace nova::guest::mysql;
+using nova::utils::PeriodicScheduler;
+using nova::utils::PeriodicTask;
+using nova::utils::PeriodicTaskPtr;
 using nova::utils::ThreadBasedJobRunner;
 using namespace nova::rpc;
 using std::string;
@@ -73,15 +76,43 @@ public:
     {
     }
 
-    void operator() ()
+    /* Checking MySQL's status and checking the monitoring agent run as
+     * separate tasks, so a slow status check doesn't hold up the other and
+     * each can have its own interval. */
+    void add_tasks(PeriodicScheduler & scheduler, const FlagValues & flags)
     {
-        mysql_app_status->update();
-        monitoring_manager->ensure_running();
+        scheduler.add("mysql status",
+                      PeriodicTaskPtr(new StatusTask(mysql_app_status)),
+                      flags.periodic_interval(), flags.periodic_jitter());
+        scheduler.add("monitoring agent",
+                      PeriodicTaskPtr(new MonitoringTask(monitoring_manager)),
+                      flags.monitoring_agent_check_interval(),
+                      flags.periodic_jitter());
     }
 
 private:
     MonitoringManagerPtr monitoring_manager;
     MySqlAppStatusPtr mysql_app_status;
+
+    struct StatusTask : public PeriodicTask {
+        MySqlAppStatusPtr status;
+
+        StatusTask(MySqlAppStatusPtr status) : status(status) {}
+
+        virtual void operator()() {
+            status->update();
+        }
+    };
+
+    struct MonitoringTask : public PeriodicTask {
+        MonitoringManagerPtr manager;
+
+        MonitoringTask(MonitoringManagerPtr manager) : manager(manager) {}
+
+        virtual void operator()() {
+            manager->ensure_running();
+        }
+    };
 };
 
 typedef boost::shared_ptr<PeriodicTasks> PeriodicTasksPtr;
@@ -96,6 +127,10 @@ struct Func {
     // threads.
     nova::db::mysql::MySqlApiScope mysql_api_scope;
 
+    // Connections to local host shared by the MySQL handlers. Declared after
+    // mysql_api_scope so it is torn down before the library is shut down.
+    MySqlConnectionPoolPtr mysql_pool;
+
     static bool is_mysql_installed(std::list<std::string> package_list,
                                    AptGuestPtr & apt_worker) {
         BOOST_FOREACH(const auto & package_name, package_list) {
@@ -118,18 +153,26 @@ struct Func {
         AptGuestPtr apt_worker(new AptGuest(
             flags.apt_use_sudo(),
             flags.apt_self_package_name(),
-            flags.apt_self_update_time_out()));
+            flags.apt_self_update_time_out(),
+            flags.apt_update_ttl()));
         MessageHandlerPtr handler_apt(new AptMessageHandler(apt_worker));
         handlers.push_back(handler_apt);
 
         const auto package_list = flags.possible_packages_for_mysql();
 
-        /* Create MySQL updater. */
+        /* Create MySQL updater. Updates come every periodic_interval, give
+         * or take the jitter, so a heartbeat interval no longer than that
+         * means a heartbeat on every update. */
+        const double heartbeat_interval =
+            flags.status_heartbeat_interval() > flags.periodic_interval()
+            ? flags.status_heartbeat_interval() : 0.0;
         MySqlAppStatusPtr mysql_status_updater(new MySqlAppStatus(
-            sender, is_mysql_installed(package_list, apt_worker)));
+            sender, is_mysql_installed(package_list, apt_worker),
+            heartbeat_interval));
 
         /* Create MySQL Guest. */
-        MessageHandlerPtr handler_mysql(new MySqlMessageHandler());
+        mysql_pool = MySqlConnectionPool::create("localhost");
+        MessageHandlerPtr handler_mysql(new MySqlMessageHandler(mysql_pool));
         handlers.push_back(handler_mysql);
 
         MonitoringManagerPtr monitoring_manager(new MonitoringManager(
@@ -179,7 +222,9 @@ struct Func {
             new MySqlAppMessageHandler(mysqlApp,
                                        apt_worker,
                                        monitoring_manager,
-                                       volumeManager));
+                                       volumeManager,
+                                       mysql_pool,
+                                       flags.apt_prefetch_on_prepare()));
         handlers.push_back(handler_mysql_app);
 
         /* Create the Interrogator for the guest. */
@@ -220,6 +265,20 @@ struct Func {
 } // end anonymous namespace
 
 
+namespace nova { namespace guest { namespace agent {
+
+    template<>
+    struct PeriodicTaskRegistrar<PeriodicTasksPtr> {
+        static void add_tasks(PeriodicScheduler & scheduler,
+                              PeriodicTasksPtr tasks,
+                              const FlagValues & flags) {
+            tasks->add_tasks(scheduler, flags);
+        }
+    };
+
+} } }  // end namespace nova::guest::agent
+
+
 int main(int argc, char* argv[]) {
     return ::nova::guest::agent::execute_main<Func, PeriodicTasksPtr>(
         "MySQL Edition", argc, argv);
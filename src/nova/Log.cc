@@ -4,16 +4,19 @@
 #include <boost/format.hpp>
 #include <iostream>
 #include <boost/optional.hpp>
+#include <boost/scoped_array.hpp>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <sstream>
+#include <string.h>
 #include <sys/stat.h>
 #include <time.h>
-#include "nova/guest/utils.h"
+#include <vector>
+#include "nova/json.h"
 
 using boost::format;
 using nova::Log;
-using nova::guest::utils::IsoDateTime;
 using boost::optional;
 using std::string;
 
@@ -36,10 +39,74 @@ namespace {
         }
     }
 
+    /* The local time, reformatted at most once a second by each thread. */
+    const char * current_timestamp() {
+        static __thread time_t cached_second = 0;
+        static __thread char cached[20];
+        const time_t now = ::time(NULL);
+        if (now != cached_second) {
+            tm local;
+            if (localtime_r(&now, &local) == NULL
+                || strftime(cached, sizeof(cached), "%Y-%m-%d %H:%M:%S",
+                            &local) == 0) {
+                strcpy(cached, "?\?\?\?-?\?-?\? ?\?:?\?:?\?");
+            }
+            cached_second = now;
+        }
+        return cached;
+    }
+
+    /* The calling thread's id as text, formatted once per thread. */
+    const char * current_thread_id() {
+        static __thread char cached[32];
+        if (cached[0] == '\0') {
+            std::ostringstream id;
+            id << boost::this_thread::get_id();
+            strncpy(cached, id.str().c_str(), sizeof(cached) - 1);
+        }
+        return cached;
+    }
+
+    // Held by anything replacing or rotating the instance. Getting the
+    // instance doesn't need it.
     static boost::mutex global_mutex;
 
+    // The innermost LogFieldScope on this thread.
+    static __thread const LogFieldScope * innermost_field = 0;
+
+    /* Appends the fields outermost first, so an inner field repeating a key
+     * wins for a reader that keeps the last value. */
+    void append_json_fields(string & line, const LogFieldScope * field) {
+        if (field->outer) {
+            append_json_fields(line, field->outer);
+            line += ',';
+        }
+        json_append_string(line, field->key, strlen(field->key));
+        line += ':';
+        json_append_string(line, field->value.data(), field->value.size());
+    }
+
+    // What get_instance() hands out. Read and written with GCC's atomic
+    // builtins, as is the count of get_instance() calls in progress.
+    static nova::Log * volatile published_instance = 0;
+
+    static volatile int instance_readers = 0;
+
     static time_t start_time;
 
+    const int ALL_LEVELS = ~0;
+
+    int levels_enabled_by(const nova::LogOptions & options) {
+        int levels = ALL_LEVELS;
+        if (!options.show_debug) {
+            levels &= ~(1 << Log::LEVEL_DEBUG);
+        }
+        if (!options.show_trace) {
+            levels &= ~(1 << Log::LEVEL_TRACE);
+        }
+        return levels;
+    }
+
 } // end anonymous namespace
 
 
@@ -69,21 +136,34 @@ const char * LogException::what() const throw() {
 
 LogFileOptions::LogFileOptions(string path, optional<size_t> max_size,
                                optional<double> max_time_in_seconds,
-                               int max_old_files)
-:   max_old_files(max_old_files),
+                               int max_old_files, bool compress_old_files)
+:   compress_old_files(compress_old_files),
+    max_old_files(max_old_files),
     max_size(max_size),
     max_time_in_seconds(max_time_in_seconds),
     path(path) {
 }
 
 
+/**---------------------------------------------------------------------------
+ *- LogAsyncOptions
+ *---------------------------------------------------------------------------*/
+
+LogAsyncOptions::LogAsyncOptions(size_t buffer_size, OverflowPolicy overflow)
+:   buffer_size(buffer_size),
+    overflow(overflow) {
+}
+
+
 /**---------------------------------------------------------------------------
  *- LogOptions
  *---------------------------------------------------------------------------*/
 
 LogOptions::LogOptions(boost::optional<LogFileOptions> file,
-                       bool use_std_streams, bool show_trace)
- : file(file), show_trace(show_trace), use_std_streams(use_std_streams) {
+                       bool use_std_streams, bool show_trace,
+                       boost::optional<LogAsyncOptions> async)
+ : async(async), file(file), json_lines(false), show_debug(true),
+   show_trace(show_trace), use_std_streams(use_std_streams) {
 }
 
 LogOptions LogOptions::simple() {
@@ -92,6 +172,20 @@ LogOptions LogOptions::simple() {
 }
 
 
+/**---------------------------------------------------------------------------
+ *- LogFieldScope
+ *---------------------------------------------------------------------------*/
+
+LogFieldScope::LogFieldScope(const char * key, const string & value)
+:   key(key), outer(innermost_field), value(value) {
+    innermost_field = this;
+}
+
+LogFieldScope::~LogFieldScope() {
+    innermost_field = outer;
+}
+
+
 /**---------------------------------------------------------------------------
  *- LogApiScope
  *---------------------------------------------------------------------------*/
@@ -104,33 +198,281 @@ LogApiScope::~LogApiScope() {
     Log::shutdown();
 }
 
+/**---------------------------------------------------------------------------
+ *- Log::AsyncWriter
+ *---------------------------------------------------------------------------*/
+
+/* A bounded ring of formatted lines filled by any thread and drained by a
+ * single writer thread. Producers claim a slot by advancing enqueue_pos
+ * with a compare and swap, and each slot's sequence number tells both
+ * sides whose turn it is, so queueing a line takes no lock. The mutex is
+ * only taken to sleep: by the writer when the ring is empty, by producers
+ * when it's full and they have to wait, and to wait for lines to be
+ * written. All I/O happens on the writer thread. */
+class Log::AsyncWriter : boost::noncopyable {
+    public:
+        AsyncWriter(Log & log, const LogAsyncOptions & options)
+        :   capacity(ring_capacity(options.buffer_size)),
+            dequeue_pos(0),
+            dropped(0),
+            enqueue_pos(0),
+            flushed(),
+            log(log),
+            mutex(),
+            not_empty(),
+            not_full(),
+            options(options),
+            ring(new Slot[capacity]),
+            stopping(false),
+            writer_sleeping(0),
+            written(0),
+            thread() {
+            for (size_t index = 0; index < capacity; ++ index) {
+                ring[index].sequence = index;
+            }
+            // Started here rather than in the initializer list so the
+            // slots are numbered first.
+            boost::thread(&AsyncWriter::run, this).swap(thread);
+        }
+
+        // Writes out whatever is still queued before returning.
+        ~AsyncWriter() {
+            {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                stopping = true;
+                not_empty.notify_one();
+            }
+            thread.join();
+        }
+
+        void flush() {
+            const size_t queued = atomic_load(enqueue_pos);
+            boost::unique_lock<boost::mutex> lock(mutex);
+            wait_until_written(lock, queued);
+        }
+
+        /* Queues the line, swapping it out of "line". ERROR lines are never
+         * dropped, and don't return until they've been written. */
+        void push(Level level, std::string & line) {
+            size_t position;
+            if (!try_push(level, line, position)) {
+                if (options.overflow == LogAsyncOptions::DROP
+                    && level != LEVEL_ERROR) {
+                    __sync_fetch_and_add(&dropped, 1);
+                    wake_writer();
+                    return;
+                }
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!try_push(level, line, position)) {
+                    not_full.wait(lock);
+                }
+            }
+            wake_writer();
+            if (level == LEVEL_ERROR) {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                wait_until_written(lock, position + 1);
+            }
+        }
+
+    private:
+        struct Record {
+            Level level;
+            std::string line;
+        };
+
+        struct Slot {
+            Level level;
+            std::string line;
+            // Equal to the position a producer may fill this slot at, or
+            // one past the position the writer may take it from.
+            volatile size_t sequence;
+        };
+
+        static inline size_t atomic_load(volatile size_t & value) {
+            return __sync_fetch_and_add(&value, 0);
+        }
+
+        /* The ring indexes by masking, so its size is a power of two. With
+         * one slot a full and an empty slot would have the same sequence,
+         * so it has at least two. */
+        static size_t ring_capacity(const size_t buffer_size) {
+            size_t capacity = 2;
+            while (capacity < buffer_size) {
+                capacity <<= 1;
+            }
+            return capacity;
+        }
+
+        void run() {
+            std::vector<Record> batch;
+            while (true) {
+                const size_t taken = take_batch(batch);
+                const unsigned long lost = __sync_fetch_and_and(&dropped, 0);
+                if (taken == 0 && lost == 0) {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    // Producers check this flag after queueing, so set it
+                    // before looking at the ring one last time.
+                    __sync_lock_test_and_set(&writer_sleeping, 1);
+                    __sync_synchronize();
+                    if (!ready_to_take()
+                        && __sync_fetch_and_add(&dropped, 0) == 0) {
+                        if (stopping) {
+                            return;  // Everything has been written.
+                        }
+                        not_empty.wait(lock);
+                    }
+                    __sync_lock_release(&writer_sleeping);
+                    continue;
+                }
+
+                write_batch(batch, taken, lost);
+
+                boost::lock_guard<boost::mutex> lock(mutex);
+                written += taken;
+                not_full.notify_all();
+                flushed.notify_all();
+            }
+        }
+
+        inline bool ready_to_take() const {
+            const Slot & slot = ring[dequeue_pos & (capacity - 1)];
+            return slot.sequence == dequeue_pos + 1;
+        }
+
+        /* Moves every line that's ready into "batch". Only the writer
+         * thread calls this, so dequeue_pos needs no atomics. */
+        size_t take_batch(std::vector<Record> & batch) {
+            size_t taken = 0;
+            while (taken < capacity && ready_to_take()) {
+                __sync_synchronize();
+                Slot & slot = ring[dequeue_pos & (capacity - 1)];
+                if (batch.size() <= taken) {
+                    batch.resize(taken + 1);
+                }
+                batch[taken].level = slot.level;
+                batch[taken].line.swap(slot.line);
+                __sync_synchronize();
+                // Hand the slot back to producers for the next lap.
+                slot.sequence = dequeue_pos + capacity;
+                ++ dequeue_pos;
+                ++ taken;
+            }
+            return taken;
+        }
+
+        /* Claims the next free slot and fills it, returning false if the
+         * ring is full. Sets "position" to the slot's place in the
+         * sequence of queued lines. */
+        bool try_push(Level level, std::string & line, size_t & position) {
+            position = atomic_load(enqueue_pos);
+            while (true) {
+                Slot & slot = ring[position & (capacity - 1)];
+                const long difference = (long) (atomic_load(slot.sequence)
+                                                - position);
+                if (difference == 0) {
+                    const size_t claimed = __sync_val_compare_and_swap(
+                        &enqueue_pos, position, position + 1);
+                    if (claimed == position) {
+                        slot.level = level;
+                        slot.line.swap(line);
+                        __sync_synchronize();
+                        slot.sequence = position + 1;
+                        return true;
+                    }
+                    position = claimed;
+                } else if (difference < 0) {
+                    return false;  // The writer hasn't emptied it yet.
+                } else {
+                    position = atomic_load(enqueue_pos);
+                }
+            }
+        }
+
+        void wait_until_written(boost::unique_lock<boost::mutex> & lock,
+                                const size_t sequence) {
+            while (written < sequence) {
+                flushed.wait(lock);
+            }
+        }
+
+        void wake_writer() {
+            __sync_synchronize();
+            if (__sync_fetch_and_add(&writer_sleeping, 0) != 0) {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                not_empty.notify_one();
+            }
+        }
+
+        void write_batch(const std::vector<Record> & batch, const size_t size,
+                         const unsigned long lost) {
+            boost::lock_guard<boost::mutex> lock(log.file_mutex);
+            if (lost > 0) {
+                const string message = str(format(
+                    "%d log lines were dropped because the buffer was full.")
+                    % lost);
+                log.write_line(LEVEL_ERROR, log.format_line(
+                    __FILE__, __LINE__, LEVEL_ERROR, message.c_str()));
+            }
+            for (size_t index = 0; index < size; ++ index) {
+                log.write_line(batch[index].level, batch[index].line);
+            }
+            if (log.options.use_std_streams) {
+                std::cout.flush();
+                std::cerr.flush();
+            }
+            if (log.file.is_open()) {
+                log.file.flush();
+            }
+        }
+
+        const size_t capacity;
+        // Only touched by the writer thread.
+        size_t dequeue_pos;
+        volatile unsigned long dropped;
+        volatile size_t enqueue_pos;
+        boost::condition_variable flushed;
+        Log & log;
+        boost::mutex mutex;
+        boost::condition_variable not_empty;
+        boost::condition_variable not_full;
+        const LogAsyncOptions options;
+        boost::scoped_array<Slot> ring;
+        bool stopping;
+        volatile int writer_sleeping;
+        // Lines written so far. Guarded by mutex.
+        size_t written;
+        boost::thread thread;
+};
+
+
 /**---------------------------------------------------------------------------
  *- Log
  *---------------------------------------------------------------------------*/
 
+volatile int Log::enabled_levels = ALL_LEVELS;
+
 void intrusive_ptr_add_ref(Log * ref) {
-    boost::lock_guard<boost::mutex> lock(ref->mutex);
-    ref->reference_count ++;
+    __sync_fetch_and_add(&ref->reference_count, 1);
 }
 
 void intrusive_ptr_release(Log * ref) {
-    {
-        boost::lock_guard<boost::mutex> lock(ref->mutex);
-        ref->reference_count --;
-    }
-    // Because the global stored in _get_instance() always (*should*) be the
-    // last reference holder, this code should not require a lock.
-    if (ref->reference_count <= 0) {
+    if (__sync_sub_and_fetch(&ref->reference_count, 1) <= 0) {
         delete ref;
     }
 }
 
 Log::Log(const LogOptions & options)
-: file(), mutex(), options(options), reference_count(0) {
+:   file(), file_size(0), file_mutex(), options(options), reference_count(0),
+    async_writer() {
     open_file();
+    if (options.async) {
+        async_writer.reset(new AsyncWriter(*this, options.async.get()));
+    }
 }
 
 Log::~Log() {
+    // Drains anything still queued.
+    async_writer.reset();
     close_file();
 }
 
@@ -158,18 +500,84 @@ void Log::initialize(const LogOptions & options) {
     ::time(&start_time);
 }
 
+void Log::flush() {
+    if (async_writer) {
+        async_writer->flush();
+    }
+}
+
+string Log::format_line(const char * file_name, int line_number,
+                        Log::Level level, const char * message) const {
+    const char * level_string = level_to_string(level);
+    char line_number_string[16];
+    snprintf(line_number_string, sizeof(line_number_string), "%d",
+             line_number);
+    string line;
+    line.reserve(128 + strlen(message));
+    if (options.json_lines) {
+        size_t level_length = strlen(level_string);
+        while (level_length > 0 && level_string[level_length - 1] == ' ') {
+            -- level_length;
+        }
+        line += "{\"time\":\"";
+        line += current_timestamp();
+        line += "\",\"level\":";
+        json_append_string(line, level_string, level_length);
+        line += ",\"thread\":\"";
+        line += current_thread_id();
+        line += "\",\"file\":";
+        json_append_string(line, file_name, strlen(file_name));
+        line += ",\"line\":";
+        line += line_number_string;
+        line += ",\"message\":";
+        json_append_string(line, message, strlen(message));
+        if (innermost_field) {
+            line += ",\"fields\":{";
+            append_json_fields(line, innermost_field);
+            line += '}';
+        }
+        line += "}\n";
+    } else {
+        line += current_timestamp();
+        line += ' ';
+        line += current_thread_id();
+        line += ' ';
+        line += level_string;
+        line += ' ';
+        line += message;
+        line += " for ";
+        line += file_name;
+        line += ':';
+        line += line_number_string;
+        line += '\n';
+    }
+    return line;
+}
+
 LogPtr & Log::_get_instance() {
     static LogPtr instance(0);
     return instance;
 }
 
 LogPtr Log::get_instance() {
-    boost::lock_guard<boost::mutex> lock(global_mutex);
-    if (!_get_instance()) {
+    // Announcing the read first keeps publish_instance() from releasing the
+    // instance between loading the pointer and taking a reference to it.
+    __sync_fetch_and_add(&instance_readers, 1);
+    LogPtr instance(__sync_val_compare_and_swap(&published_instance, 0, 0));
+    __sync_fetch_and_sub(&instance_readers, 1);
+    if (!instance) {
         std::cerr << "Logging system not initialized!" << std::endl;
         throw LogException(LogException::NOT_INITIALIZED);
     }
-    return _get_instance();
+    return instance;
+}
+
+void Log::publish_instance(Log * log) {
+    (void) __sync_lock_test_and_set(&published_instance, log);
+    __sync_synchronize();
+    while (__sync_fetch_and_add(&instance_readers, 0) != 0) {
+        boost::this_thread::yield();
+    }
 }
 
 void Log::handle_fmt_error(const char * filename, const int line_number,
@@ -189,8 +597,11 @@ void Log::handle_fmt_error(const char * filename, const int line_number,
 
 void Log::open_file() {
     if (options.file) {
-        file.open(options.file.get().path.c_str(),
-                  std::ios::out | std::ios::app);
+        const char * path = options.file.get().path.c_str();
+        file.open(path, std::ios::out | std::ios::app);
+        // Don't log a failure here; the caller may hold file_mutex.
+        struct stat buf;
+        file_size = (::stat(path, &buf) == 0) ? buf.st_size : 0;
     }
 }
 
@@ -200,20 +611,35 @@ void Log::_open_log(const LogOptions & options) {
             "UPCOMING EOF: This log will be closed after it finishes its "
             "current task.");
     }
+    LogPtr old = _get_instance();
     _get_instance().reset(new Log(options));
+    publish_instance(_get_instance().get());
+    set_enabled_levels(levels_enabled_by(options));
+    // The old log closes once whoever is still using it lets go.
+    old.reset();
 }
 
 void Log::rotate_files() {
+    // Compression runs at idle priority and can take a while, so wait for
+    // it before taking the locks every log write needs.
+    wait_for_log_compression();
     boost::lock_guard<boost::mutex> lock(global_mutex);
     LogPtr old = _get_instance();
     if (!old) {
         throw LogException(LogException::NOT_INITIALIZED);
     }
-    boost::lock_guard<boost::mutex> lock2(old->mutex);
+    // Make sure queued lines end up in the file they were written to.
+    old->flush();
+    boost::lock_guard<boost::mutex> lock2(old->file_mutex);
     if (old->options.file) {
         old->close_file();
-        _rotate_files(old->options.file.get());
+        const bool rotated = _rotate_files(old->options.file.get());
         old->open_file();
+        if (!rotated) {
+            // Another rotation started compressing since we waited. Leaving
+            // start_time alone makes the next check try again.
+            return;
+        }
     }
     ::time(&start_time);
 }
@@ -225,6 +651,11 @@ void Log::rotate_logs_if_needed() {
     }
 }
 
+void Log::set_enabled_levels(int levels) {
+    (void) __sync_lock_test_and_set(&enabled_levels, levels);
+    __sync_synchronize();
+}
+
 bool Log::should_rotate_logs() {
     if (options.file) {
         const LogFileOptions & file_options = options.file.get();
@@ -236,11 +667,9 @@ bool Log::should_rotate_logs() {
                 return true;
             }
         } else if (file_options.max_size) {
-            boost::optional<size_t> size = current_log_file_size();
-            if (size) { // ignore if we couldn't stat the file.
-                if (size > file_options.max_size) {
-                    return true;
-                }
+            boost::lock_guard<boost::mutex> lock(file_mutex);
+            if (file_size > file_options.max_size.get()) {
+                return true;
             }
         }
     }
@@ -251,26 +680,34 @@ bool Log::should_rotate_logs() {
 void Log::write(const char * file_name, int line_number, Log::Level level,
                 const char * message)
 {
-    if (level == LEVEL_TRACE && !options.show_trace) {
+    if ((level == LEVEL_TRACE && !options.show_trace)
+        || (level == LEVEL_DEBUG && !options.show_debug)) {
         return;
     }
-    IsoDateTime time;
-    const char * level_string = level_to_string(level);
-    boost::lock_guard<boost::mutex> lock(mutex);
+    string line = format_line(file_name, line_number, level, message);
+    if (async_writer) {
+        async_writer->push(level, line);
+        return;
+    }
+    boost::lock_guard<boost::mutex> lock(file_mutex);
+    write_line(level, line);
     if (options.use_std_streams) {
         std::ostream & out = (level == LEVEL_INFO) ? std::cout : std::cerr;
-        out << time.c_str() << " " << boost::this_thread::get_id() << " "
-            << level_string << " " << message
-            << " for " << file_name <<  ":" << line_number << std::endl;
+        out.flush();
     }
-    {
-        if (file.is_open()) {
-            file << time.c_str() << " " << boost::this_thread::get_id() << " "
-                 << level_string << " " << message
-                 << " for " << file_name <<  ":" << line_number << std::endl;
-            file.flush();
+    if (file.is_open()) {
+        file.flush();
+    }
+}
 
-        }
+void Log::write_line(Log::Level level, const string & line) {
+    if (options.use_std_streams) {
+        std::ostream & out = (level == LEVEL_INFO) ? std::cout : std::cerr;
+        out << line;
+    }
+    if (file.is_open()) {
+        file << line;
+        file_size += line.size();
     }
 }
 
@@ -278,10 +715,16 @@ void Log::shutdown() {
     if (_get_instance().get() != 0 && _get_instance()->reference_count > 1) {
         _get_instance()->write(__FILE__, __LINE__, LEVEL_ERROR,
             "On shutdown, %d instances of the logger remain.",
-            _get_instance()->reference_count);
+            (int) _get_instance()->reference_count);
         throw LogException(LogException::STRAY_LOG_EXCEPTION);
     }
+    set_enabled_levels(ALL_LEVELS);
+    {
+        boost::lock_guard<boost::mutex> lock(global_mutex);
+        publish_instance(0);
+    }
     _get_instance().reset(0);
+    wait_for_log_compression();
 }
 
 /**---------------------------------------------------------------------------
@@ -34,25 +34,48 @@ namespace nova {
     };
 
     struct LogFileOptions {
+        // Gzip each rotated file in the background. Defaults to false.
+        bool compress_old_files;
         int max_old_files;
         boost::optional<size_t> max_size;
         boost::optional<double> max_time_in_seconds;
         std::string path;
         LogFileOptions(std::string path, boost::optional<size_t> max_size,
-                       boost::optional<double> max_time_in_seconds, int max_old_files);
+                       boost::optional<double> max_time_in_seconds, int max_old_files,
+                       bool compress_old_files = false);
 
         static void rotate_files();
     };
 
 
 
+    /* Settings for writing the log from a background thread. Callers
+     * format their line and queue it, and the writer thread writes and
+     * flushes queued lines in batches. */
+    struct LogAsyncOptions {
+        enum OverflowPolicy {
+            BLOCK,  // Wait for the writer to make room.
+            DROP    // Throw the line away and report how many were lost.
+        };
+
+        size_t buffer_size;
+        OverflowPolicy overflow;
+
+        LogAsyncOptions(size_t buffer_size, OverflowPolicy overflow);
+    };
+
     struct LogOptions {
+        boost::optional<LogAsyncOptions> async;
         boost::optional<LogFileOptions> file;
+        // Write each line as a JSON object. Defaults to false.
+        bool json_lines;
+        bool show_debug;  // Defaults to true.
         bool show_trace;
         bool use_std_streams;
 
         LogOptions(boost::optional<LogFileOptions> file, bool use_std_streams,
-                   bool show_trace);
+                   bool show_trace,
+                   boost::optional<LogAsyncOptions> async = boost::none);
 
         /** Creates a simple set of LogOptions. Useful for tests. */
         static LogOptions simple();
@@ -102,6 +125,14 @@ namespace nova {
 
             static void initialize(const LogOptions & options);
 
+            /* Checked by the NOVA_LOG_* macros before any arguments are
+             * formatted. Every level reads as enabled until the log is
+             * initialized, so that logging too early still throws. */
+            static inline bool is_enabled(Level level) {
+                const int levels = __sync_fetch_and_add(&enabled_levels, 0);
+                return (levels & (1 << level)) != 0;
+            }
+
             /** Saves the current log to name.1, after first renaming all other
              *  backed up logs from 1 - options.max_old_files. */
             static void rotate_files();
@@ -117,11 +148,13 @@ namespace nova {
             void write(const char * filename, const int line_number,
                        const nova::Log::Level level, const char * fmt_string,
                        const Types... args) {
+                if (!is_enabled(level)) {
+                    return;
+                }
                 try {
                     boost::format fmt = boost::format(fmt_string);
                     const std::string msg(boost::str(decompose_fmt(fmt, args...)));
-                    nova::Log::get_instance()->write(filename, line_number, level,
-                                                     msg.c_str());
+                    write(filename, line_number, level, msg.c_str());
                 } catch (const boost::io::format_error & fe) {
                     handle_fmt_error(filename, line_number, fmt_string, fe);
                 }
@@ -129,7 +162,16 @@ namespace nova {
 
             bool should_rotate_logs();
 
+            /* Blocks until every line written so far is in the log. Only
+             * needed in async mode; ERROR lines and shutdown flush on their
+             * own. */
+            void flush();
+
             static void shutdown();
+
+            /* Blocks until the most recently rotated file, if any, is done
+             * being compressed. */
+            static void wait_for_log_compression();
         protected:
 
             Log(const LogOptions & options);
@@ -137,6 +179,7 @@ namespace nova {
             ~Log();
 
         private:
+            class AsyncWriter;
 
             void close_file();
 
@@ -157,9 +200,28 @@ namespace nova {
 
             static LogPtr & _get_instance();
 
+            /* Makes "log" the instance get_instance() hands out, then waits
+             * for calls that may have read the old one to take their
+             * reference. Call with global_mutex held. */
+            static void publish_instance(Log * log);
+
+            // A bit for each enabled Level. Read by every logging thread, so
+            // it's only touched through atomic builtins.
+            static volatile int enabled_levels;
+
+            static void set_enabled_levels(int levels);
+
+            std::string format_line(const char * file_name, int line_number,
+                                    Level level, const char * message) const;
+
             std::ofstream file;
 
-            boost::mutex mutex;
+            // Bytes in the current file, tracked so size based rotation
+            // doesn't have to stat it.
+            size_t file_size;
+
+            // Guards the file, its size and the standard streams.
+            boost::mutex file_mutex;
 
             void open_file();
 
@@ -167,9 +229,37 @@ namespace nova {
 
             const LogOptions options;
 
-            int reference_count;
+            // Changed only through atomic builtins.
+            volatile int reference_count;
+
+            /* Returns false without touching anything if the last rotated
+             * file is still being compressed. */
+            static bool _rotate_files(LogFileOptions options);
+
+            // Writes one formatted line to each output without flushing.
+            // file_mutex must be held.
+            void write_line(Level level, const std::string & line);
+
+            // Set when logging asynchronously.
+            boost::scoped_ptr<AsyncWriter> async_writer;
+    };
+
+    /* Adds a key/value field to each line the current thread logs while
+     * this is in scope. JSON lines list them in a "fields" object; the text
+     * format leaves them out. Scopes must be destroyed in the reverse order
+     * they were created, which they are as locals. */
+    class LogFieldScope : boost::noncopyable {
+        public:
+            // "key" must outlive the scope; a literal is expected.
+            LogFieldScope(const char * key, const std::string & value);
+
+            ~LogFieldScope();
+
+            const char * const key;
 
-            static void _rotate_files(LogFileOptions options);
+            const LogFieldScope * const outer;
+
+            const std::string value;
     };
 
     class LogLine {
@@ -191,16 +281,31 @@ namespace nova {
 
 }
 
+/* TRACE calls are compiled out of release builds unless
+ * NOVA_LOG_COMPILE_TRACE is defined as 1. They still get type checked. */
+#ifndef NOVA_LOG_COMPILE_TRACE
+    #ifdef _DEBUG
+        #define NOVA_LOG_COMPILE_TRACE 1
+    #else
+        #define NOVA_LOG_COMPILE_TRACE 0
+    #endif
+#endif
+
 /* It is necessary to use macros here to automatically insert the file
- * name and line numbers. */
-#define NOVA_LOG_DEBUG(fmt, ...) { ::nova::Log::get_instance()->write( \
-    __FILE__, __LINE__, nova::Log::LEVEL_DEBUG, fmt, ##__VA_ARGS__); }
-#define NOVA_LOG_INFO(fmt, ...) { ::nova::Log::get_instance()->write( \
-    __FILE__, __LINE__, nova::Log::LEVEL_INFO, fmt, ##__VA_ARGS__); }
-#define NOVA_LOG_ERROR(fmt, ...) { ::nova::Log::get_instance()->write( \
-    __FILE__, __LINE__, nova::Log::LEVEL_ERROR, fmt, ##__VA_ARGS__); }
-#define NOVA_LOG_TRACE(fmt, ...) { ::nova::Log::get_instance()->write( \
-    __FILE__, __LINE__, nova::Log::LEVEL_TRACE, fmt, ##__VA_ARGS__); }
+ * name and line numbers. Checking the level first skips formatting, and
+ * evaluating the arguments, for levels that are turned off. */
+#define NOVA_LOG_AT_LEVEL(level, fmt, ...) { \
+    if (::nova::Log::is_enabled(level)) { \
+        ::nova::Log::get_instance()->write( \
+            __FILE__, __LINE__, level, fmt, ##__VA_ARGS__); } }
+#define NOVA_LOG_DEBUG(fmt, ...) NOVA_LOG_AT_LEVEL( \
+    nova::Log::LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define NOVA_LOG_INFO(fmt, ...) NOVA_LOG_AT_LEVEL( \
+    nova::Log::LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define NOVA_LOG_ERROR(fmt, ...) NOVA_LOG_AT_LEVEL( \
+    nova::Log::LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define NOVA_LOG_TRACE(fmt, ...) { if (NOVA_LOG_COMPILE_TRACE) { \
+    NOVA_LOG_AT_LEVEL(nova::Log::LEVEL_TRACE, fmt, ##__VA_ARGS__) } }
 
 
 #endif
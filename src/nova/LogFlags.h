@@ -13,14 +13,25 @@ namespace nova {
             LogFileOptions ops(flags.log_file_path().get(),
                                flags.log_file_max_size(),
                                flags.log_file_max_time(),
-                               flags.log_file_max_old_files().get_value_or(30));
+                               flags.log_file_max_old_files().get_value_or(30),
+                               flags.log_file_compress_old_files());
             log_file_options = boost::optional<LogFileOptions>(ops);
         } else {
             log_file_options = boost::none;
         }
+        boost::optional<LogAsyncOptions> log_async_options;
+        if (flags.log_async_buffer_size()) {
+            log_async_options = LogAsyncOptions(
+                flags.log_async_buffer_size().get(),
+                flags.log_async_drop_on_overflow() ? LogAsyncOptions::DROP
+                                                   : LogAsyncOptions::BLOCK);
+        }
         LogOptions log_options(log_file_options,
                                flags.log_use_std_streams(),
-                               flags.log_show_trace());
+                               flags.log_show_trace(),
+                               log_async_options);
+        log_options.json_lines = flags.log_json_lines();
+        log_options.show_debug = flags.log_show_debug();
 
         return log_options;
     }
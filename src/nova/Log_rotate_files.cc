@@ -2,8 +2,14 @@
 #include "nova/Log.h"
 
 #include <boost/format.hpp>
+#include <fstream>
 #include "nova/utils/io.h"
 #include <string>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
 
 using boost::format;
 namespace io = nova::utils::io;
@@ -13,6 +19,59 @@ namespace nova {
 
 namespace {
 
+    // Compresses one rotated file at a time, in the background.
+    boost::mutex compression_mutex;
+
+    boost::thread compression_thread;
+
+    /* Puts the calling thread in the idle I/O class and at the lowest CPU
+     * priority so compression doesn't compete with the database. glibc
+     * has no wrapper for ioprio_set, hence the constants. */
+    void lower_thread_priority() {
+        const int IOPRIO_CLASS_IDLE = 3;
+        const int IOPRIO_CLASS_SHIFT = 13;
+        const int IOPRIO_WHO_PROCESS = 1;
+        const pid_t thread_id = ::syscall(SYS_gettid);
+        ::syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, thread_id,
+                  IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+        ::setpriority(PRIO_PROCESS, thread_id, 19);
+    }
+
+    /* Writes path to path.gz and deletes the original. A temporary name is
+     * used until it's finished, so a crash leaves the plain file behind
+     * rather than a truncated archive. Nothing is logged, as this may run
+     * while the log is being rotated. */
+    void compress_file(const string path) {
+        lower_thread_priority();
+        const string gz_path = path + ".gz";
+        const string temp_path = gz_path + ".tmp";
+        std::ifstream input(path.c_str(), std::ios::in | std::ios::binary);
+        if (!input.is_open()) {
+            return;
+        }
+        gzFile output = gzopen(temp_path.c_str(), "wb");
+        if (output == NULL) {
+            return;
+        }
+        std::vector<char> buffer(64 * 1024);
+        bool success = true;
+        while (success && input.good()) {
+            input.read(&buffer[0], buffer.size());
+            const int count = (int) input.gcount();
+            if (count > 0 && gzwrite(output, &buffer[0], count) != count) {
+                success = false;
+            }
+        }
+        if (gzclose(output) != Z_OK || !input.eof()) {
+            success = false;
+        }
+        if (success && ::rename(temp_path.c_str(), gz_path.c_str()) == 0) {
+            ::remove(path.c_str());
+        } else {
+            ::remove(temp_path.c_str());
+        }
+    }
+
     class LogFileRotater {
     public:
 
@@ -34,7 +93,8 @@ namespace {
         int oldest_log_file_index() {
             for (int i = options.max_old_files; i > 0; i --) {
                 string possible_file = file_path(i);
-                if (io::is_file_sans_logging(possible_file.c_str())) {
+                if (io::is_file_sans_logging(possible_file.c_str())
+                    || io::is_file_sans_logging((possible_file + ".gz").c_str())) {
                     return i;
                 }
             }
@@ -43,16 +103,27 @@ namespace {
 
         void rotate() {
             for (int i = oldest_log_file_index(); i >= 0; i --) {
-                string old_file = file_path(i);
-                if (io::is_file_sans_logging(old_file.c_str())) {
-                    if (i == options.max_old_files) {
-                        ::remove(old_file.c_str());
-                    } else {
-                        string new_file = file_path(i + 1);
-                        ::rename(old_file.c_str(), new_file.c_str());
-                    }
+                shift(i, "");
+                if (i > 0) {
+                    shift(i, ".gz");
+                }
+            }
+            if (options.compress_old_files && options.max_old_files > 0) {
+                compression_thread = boost::thread(compress_file,
+                                                   file_path(1));
+            }
+        }
+
+        /** Moves old file "index" up by one, or removes it if it's the
+         *  oldest one kept. */
+        void shift(int index, const char * suffix) {
+            string old_file = file_path(index) + suffix;
+            if (io::is_file_sans_logging(old_file.c_str())) {
+                if (index == options.max_old_files) {
+                    ::remove(old_file.c_str());
                 } else {
-                    // Just skip it...
+                    string new_file = file_path(index + 1) + suffix;
+                    ::rename(old_file.c_str(), new_file.c_str());
                 }
             }
         }
@@ -62,9 +133,24 @@ namespace {
 } // end anonymous namespace
 
 
-void Log::_rotate_files(LogFileOptions options) {
+bool Log::_rotate_files(LogFileOptions options) {
+    boost::lock_guard<boost::mutex> lock(compression_mutex);
+    // Renaming the file being compressed would break it, but waiting for it
+    // here would hold up every log write, so try again later instead.
+    if (compression_thread.joinable()
+        && !compression_thread.timed_join(boost::posix_time::seconds(0))) {
+        return false;
+    }
     LogFileRotater rotater(options);
     rotater.rotate();
+    return true;
+}
+
+void Log::wait_for_log_compression() {
+    boost::lock_guard<boost::mutex> lock(compression_mutex);
+    if (compression_thread.joinable()) {
+        compression_thread.join();
+    }
 }
 
 } // end nova namespace
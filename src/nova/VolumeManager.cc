@@ -1,5 +1,6 @@
 #include "nova/Log.h"
 #include "nova/process.h"
+#include "nova/sudo.h"
 #include "nova/VolumeManager.h"
 #include <boost/assign/list_of.hpp>
 #include <boost/format.hpp>
@@ -97,14 +98,14 @@ class VolumeMountPoint {
 
             NOVA_LOG_INFO("Writing to fstab...");
             try {
-                proc::execute(list_of("/usr/bin/sudo")("cp")
-                                     (fstab_file_name.c_str())
-                                     (fstab_original_file_name.c_str()));
-                proc::execute(list_of("/usr/bin/sudo")("cp")
-                                     (fstab_file_name.c_str())
-                                     (new_fstab_file_name.c_str()));
-                proc::execute(list_of("/usr/bin/sudo")("chmod")
-                                     ("666")(new_fstab_file_name.c_str()));
+                proc::sudo(list_of("cp")
+                                  (fstab_file_name.c_str())
+                                  (fstab_original_file_name.c_str()));
+                proc::sudo(list_of("cp")
+                                  (fstab_file_name.c_str())
+                                  (new_fstab_file_name.c_str()));
+                proc::sudo(list_of("chmod")
+                                  ("666")(new_fstab_file_name.c_str()));
 
                 ofstream tmp_new_fstab_file;
                 // Open file in append mode
@@ -117,11 +118,11 @@ class VolumeMountPoint {
                 tmp_new_fstab_file << fstab_line << endl;
                 tmp_new_fstab_file.close();
 
-                proc::execute(list_of("/usr/bin/sudo")("chmod")
-                                     ("640")(new_fstab_file_name.c_str()));
-                proc::execute(list_of("/usr/bin/sudo")("mv")
-                                     (new_fstab_file_name.c_str())
-                                     (fstab_file_name.c_str()));
+                proc::sudo(list_of("chmod")
+                                  ("640")(new_fstab_file_name.c_str()));
+                proc::sudo(list_of("mv")
+                                  (new_fstab_file_name.c_str())
+                                  (fstab_file_name.c_str()));
             }
             catch (proc::ProcessException &e) {
                 NOVA_LOG_ERROR("Writing to fstab FAILED:%s", e.what());
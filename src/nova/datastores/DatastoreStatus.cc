@@ -1,5 +1,6 @@
 #include "pch.hpp"
 #include "nova/datastores/DatastoreStatus.h"
+#include <algorithm>
 #include <boost/format.hpp>
 #include "nova/utils/io.h"
 #include <boost/lexical_cast.hpp>
@@ -41,8 +42,12 @@ namespace utils = nova::guest::utils;
 namespace nova { namespace datastores {
 
 DatastoreStatus::DatastoreStatus(ResilientSenderPtr sender,
-                                 bool is_installed)
-: installed(is_installed),
+                                 bool is_installed,
+                                 double heartbeat_interval)
+: heartbeat_interval(heartbeat_interval),
+  installed(is_installed),
+  last_report_time(boost::none),
+  reported_status(boost::none),
   restart_mode(false),
   status(boost::none),
   sender(sender) {
@@ -54,7 +59,7 @@ DatastoreStatus::~DatastoreStatus() {
 
 void DatastoreStatus::begin_install() {
     boost::lock_guard<boost::mutex> lock(status_mutex);
-    set_status(BUILDING);
+    report(BUILDING);
 }
 
 void DatastoreStatus::begin_restart() {
@@ -66,14 +71,14 @@ void DatastoreStatus::end_failed_install() {
     boost::lock_guard<boost::mutex> lock(status_mutex);
     this->installed = false;
     this->restart_mode = false;
-    this->set_status(FAILED);
+    report(FAILED);
 }
 
 void DatastoreStatus::end_install_or_restart() {
     boost::lock_guard<boost::mutex> lock(status_mutex);
     this->installed = true;
     this->restart_mode = false;
-    set_status(determine_actual_status());
+    report(determine_actual_status());
 }
 
 const char * DatastoreStatus::get_current_status_string() const {
@@ -96,6 +101,12 @@ bool DatastoreStatus::is_running() const {
     return (status && status.get() == RUNNING);
 }
 
+void DatastoreStatus::report(DatastoreStatus::Status status) {
+    set_status(status);
+    reported_status = status;
+    last_report_time = now();
+}
+
 void DatastoreStatus::set_status(DatastoreStatus::Status status) {
     if (NEW == status) {
         NOVA_LOG_INFO("Won't update Conductor as status is NEW.");
@@ -154,7 +165,14 @@ void DatastoreStatus::update() {
     if (is_installed() && !is_restarting()) {
         NOVA_LOG_TRACE("Determining status of app...");
         Status status = determine_actual_status();
-        set_status(status);
+        if (!reported_status || reported_status.get() != status
+            || !last_report_time
+            || now() - last_report_time.get() >= heartbeat_interval) {
+            report(status);
+        } else {
+            NOVA_LOG_TRACE("Status is still %s, skipping the heartbeat.",
+                           status_name(status));
+        }
     } else {
         NOVA_LOG_INFO("Datastore is not installed or is in restart mode, so for "
                       "now we'll skip determining the status of the app on this "
@@ -165,27 +183,50 @@ void DatastoreStatus::update() {
 bool DatastoreStatus::wait_for_real_state_to_change_to(Status status,
                                                       int max_time,
                                                       bool update_db){
-    boost::lock_guard<boost::mutex> lock(status_mutex);
-    const int wait_time = 3;
-    for (int time = 0; time < max_time; time += wait_time) {
-        boost::this_thread::sleep(boost::posix_time::seconds(wait_time));
-        time += 1;
-        NOVA_LOG_INFO("Waiting for datastore status to change to %s...",
-                       DatastoreStatus::status_name(status));
+    // The status is checked straight away and then again whenever
+    // wait_for_status_change sees something happen. If nothing is seen the
+    // poll interval grows, so apps which can't be watched are still noticed
+    // quickly without being hammered for the whole wait.
+    const double MIN_POLL = 0.1;
+    const double MAX_POLL = 2.0;
+    NOVA_LOG_INFO("Waiting for datastore status to change to %s...",
+                   DatastoreStatus::status_name(status));
+    const double start = now();
+    double poll = MIN_POLL;
+    while (true) {
         const DatastoreStatus::Status actual_status = determine_actual_status();
-        NOVA_LOG_INFO("Datastore status was %s after %d seconds.",
-                       DatastoreStatus::status_name(actual_status), time);
-        if (actual_status == status)
-        {
+        const double elapsed = now() - start;
+        if (actual_status == status) {
+            NOVA_LOG_INFO("Datastore status was %s after %.2f seconds.",
+                           DatastoreStatus::status_name(actual_status),
+                           elapsed);
             if (update_db) {
-                set_status(actual_status);
+                boost::lock_guard<boost::mutex> lock(status_mutex);
+                report(actual_status);
             }
             return true;
         }
+        NOVA_LOG_DEBUG("Datastore status was %s after %.2f seconds.",
+                       DatastoreStatus::status_name(actual_status), elapsed);
+        const double remaining = max_time - elapsed;
+        if (remaining <= 0) {
+            break;
+        }
+        if (wait_for_status_change(std::min(poll, remaining))) {
+            poll = MIN_POLL;
+        } else {
+            poll = std::min(poll * 2, MAX_POLL);
+        }
     }
     NOVA_LOG_ERROR("Time out while waiting for datastore app status to change!");
     return false;
 }
 
+bool DatastoreStatus::wait_for_status_change(double seconds) const {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(
+        static_cast<long>(seconds * 1000)));
+    return false;
+}
+
 
 } } // end nova::guest::mysql
@@ -31,6 +31,10 @@ namespace nova { namespace datastores {
      *  restarting it or something).
      *  These modes are exitted (i.e. functionality of update() returns to
      *  normal) when end_install_or_restart() is called.
+     *  To keep broker traffic down, update() only sends the status when it
+     *  changes or when "heartbeat_interval" seconds have passed since the
+     *  last report, which is all Conductor needs to know the guest is
+     *  alive.
      */
     class DatastoreStatus {
         friend class DatastoreStatusTestsFixture;
@@ -88,14 +92,17 @@ namespace nova { namespace datastores {
 
             /** Waits for the given time for the real status to change to the
              *  one specified. Does not update the publicly viewable status
-             *  unless "update_conductor" is true. */
+             *  unless "update_conductor" is true. The status lock is only
+             *  held while reporting, so update() isn't held up meanwhile. */
             bool wait_for_real_state_to_change_to(Status status, int max_time,
                                                   bool update_conductor=false);
 
         protected:
 
+            /** A "heartbeat_interval" of zero reports on every update. */
             DatastoreStatus(nova::rpc::ResilientSenderPtr sender,
-                            bool is_installed);
+                            bool is_installed,
+                            double heartbeat_interval=0);
 
             /** Gets the status of the app on this machine.
              *  Note: This method produces nonsense (SHUTDOWN) if the app is
@@ -106,6 +113,13 @@ namespace nova { namespace datastores {
              *  off. */
             bool is_restarting() const;
 
+            /** Blocks until something happens which might change the status,
+             *  or "seconds" pass. Returns true if woken by such an event.
+             *  The default has nothing to watch and just sleeps; subclasses
+             *  which can watch the app's files or process override it so
+             *  waits end as soon as the app changes state. */
+            virtual bool wait_for_status_change(double seconds) const;
+
             /** Notifies Trove Conductor or a status change. */
             virtual void set_status(Status status);
 
@@ -113,8 +127,14 @@ namespace nova { namespace datastores {
             DatastoreStatus(DatastoreStatus const &);
             DatastoreStatus & operator = (const DatastoreStatus &);
 
+            const double heartbeat_interval;
+
             bool installed;
 
+            boost::optional<double> last_report_time;
+
+            boost::optional<Status> reported_status;
+
             bool restart_mode;
 
             boost::optional<Status> status;
@@ -122,6 +142,9 @@ namespace nova { namespace datastores {
             boost::mutex status_mutex;
 
             nova::rpc::ResilientSenderPtr sender;
+
+            /** Calls set_status and remembers what was reported when. */
+            void report(Status status);
     };
 
     typedef boost::shared_ptr<DatastoreStatus> DatastoreStatusPtr;
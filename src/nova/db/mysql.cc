@@ -2,13 +2,16 @@
 #include "nova/db/mysql.h"
 #include "nova/Log.h"
 #include <boost/format.hpp>
+#include <boost/foreach.hpp>
 #include <fstream>
 #include <iostream>
 #include <boost/lexical_cast.hpp>
 #include <mysql/mysql.h>
+#include <mysql/mysqld_error.h>
 #include "nova/db/MySqlConfigReader.h"
 #include "nova/rpc/sender.h"
 #include <string.h>
+#include <boost/thread/locks.hpp>
 
 using boost::format;
 using boost::none;
@@ -471,12 +474,12 @@ private:
 MySqlConnection::MySqlConnection(const char * uri,
                                  const char * user,
                                  const char * password)
-: con(0), password(password), uri(uri), use_mycnf(false),
+: con(0), password(password), timeout(0), uri(uri), use_mycnf(false),
   user(user) {
 }
 
 MySqlConnection::MySqlConnection(const char * uri)
-: con(0), password(""), uri(uri), use_mycnf(true),
+: con(0), password(""), timeout(0), uri(uri), use_mycnf(true),
   user("") {
 }
 
@@ -658,6 +661,11 @@ void MySqlConnection::init() {
 
     // my_bool reconnect = 1;
     // mysql_options(mysql_con(con), MYSQL_OPT_RECONNECT, &reconnect);
+    if (timeout > 0) {
+        mysql_options(mysql_con(con), MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+        mysql_options(mysql_con(con), MYSQL_OPT_READ_TIMEOUT, &timeout);
+        mysql_options(mysql_con(con), MYSQL_OPT_WRITE_TIMEOUT, &timeout);
+    }
 
     if (mysql_real_connect(mysql_con(con), uri.c_str(), user.c_str(),
                            password.c_str(),
@@ -677,6 +685,27 @@ void MySqlConnection::init() {
     // con = driver->connect(uri, user, password);
 }
 
+bool MySqlConnection::ping() {
+    if (mysql_con(con) != 0) {
+        if (mysql_ping(mysql_con(con)) == 0) {
+            return true;
+        }
+        close();
+    }
+    try {
+        init();
+        return true;
+    } catch(const MySqlException & mse) {
+        if (mse.code != MySqlException::COULD_NOT_CONNECT) {
+            close();
+            throw;
+        }
+        const bool alive = mysql_errno(mysql_con(con)) == ER_ACCESS_DENIED_ERROR;
+        close();
+        return alive;
+    }
+}
+
 MySqlPreparedStatementPtr MySqlConnection::prepare_statement(
     const char * text)
 {
@@ -694,6 +723,10 @@ MySqlResultSetPtr MySqlConnection::query(const char * text) {
     return rtn;
 }
 
+void MySqlConnection::set_timeout(unsigned int seconds) {
+    timeout = seconds;
+}
+
 bool MySqlConnection::test_connection() {
      try {
         this->query("SELECT 'Hello'");
@@ -720,4 +753,105 @@ const char * MySqlConnectionWithDefaultDb::get_db_name() const {
     return db_name.c_str();
 }
 
+
+/**---------------------------------------------------------------------------
+ *- MySqlConnectionPool
+*---------------------------------------------------------------------------*/
+
+class MySqlConnectionPool::Return {
+    public:
+        Return(MySqlConnectionPoolPtr pool)
+        :   pool(pool) {
+        }
+
+        void operator()(MySqlConnection * connection) {
+            pool->give_back(connection);
+        }
+
+    private:
+        MySqlConnectionPoolPtr pool;
+};
+
+MySqlConnectionPool::MySqlConnectionPool(const char * uri, size_t max_idle,
+                                         double max_idle_time)
+:   idle(),
+    max_idle(max_idle),
+    max_idle_time(max_idle_time),
+    mutex(),
+    uri(uri) {
+}
+
+MySqlConnectionPool::~MySqlConnectionPool() {
+    BOOST_FOREACH(const IdleConnection & entry, idle) {
+        delete entry.connection;
+    }
+}
+
+MySqlConnectionPtr MySqlConnectionPool::borrow() {
+    MySqlConnection * connection = 0;
+    std::list<IdleConnection> expired;
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        take_expired(expired);
+        if (!idle.empty()) {
+            connection = idle.front().connection;
+            idle.pop_front();
+        }
+    }
+    BOOST_FOREACH(const IdleConnection & entry, expired) {
+        delete entry.connection;
+    }
+    if (connection == 0) {
+        NOVA_LOG_DEBUG("No idle MySQL connections, opening a new one.");
+        connection = new MySqlConnection(uri.c_str());
+    } else {
+        // If mysqld went away this reconnects. If that fails the connection
+        // is left closed, and reports the problem when it's used.
+        try {
+            connection->ping();
+        } catch(const MySqlException & mse) {
+            NOVA_LOG_ERROR("Couldn't check pooled MySQL connection: %s",
+                           mse.what());
+        }
+    }
+    return MySqlConnectionPtr(connection, Return(shared_from_this()));
+}
+
+MySqlConnectionPoolPtr MySqlConnectionPool::create(
+    const char * uri, size_t max_idle, double max_idle_time)
+{
+    MySqlConnectionPoolPtr pool(
+        new MySqlConnectionPool(uri, max_idle, max_idle_time));
+    return pool;
+}
+
+void MySqlConnectionPool::give_back(MySqlConnection * connection) {
+    std::list<IdleConnection> expired;
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        take_expired(expired);
+        if (idle.size() < max_idle) {
+            IdleConnection entry = { connection, time(0) };
+            idle.push_front(entry);
+            connection = 0;
+        }
+    }
+    delete connection;
+    BOOST_FOREACH(const IdleConnection & entry, expired) {
+        delete entry.connection;
+    }
+}
+
+size_t MySqlConnectionPool::idle_count() const {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    return idle.size();
+}
+
+void MySqlConnectionPool::take_expired(std::list<IdleConnection> & expired) {
+    const time_t now = time(0);
+    while (!idle.empty() && difftime(now, idle.back().since) >= max_idle_time) {
+        expired.splice(expired.begin(), idle, --idle.end());
+    }
+}
+
 } } } // nova::guest::mysql
@@ -2,10 +2,13 @@
 #define __NOVA_DB_MYSQL_H
 
 
+#include <list>
 #include <memory>
+#include <boost/thread/mutex.hpp>
 #include <boost/optional.hpp>
 #include <boost/smart_ptr.hpp>
 #include <string>
+#include <time.h>
 #include <vector>
 #include <boost/utility.hpp>
 
@@ -126,10 +129,22 @@ namespace nova { namespace db { namespace mysql {
 
             void init();
 
+            /* Returns true if the server answers, reusing the open
+             * connection when it's still good and reconnecting otherwise.
+             * Like "mysqladmin ping," a server which refuses our login still
+             * counts as alive. Throws MY_CNF_FILE_NOT_FOUND if the
+             * credentials are meant to come from my.cnf and can't. */
+            bool ping();
+
             MySqlPreparedStatementPtr prepare_statement(const char * text);
 
             MySqlResultSetPtr query(const char * text);
 
+            /* Limits how long connecting, reading and writing may take on
+             * connections opened after this is called. Zero means the
+             * client library's defaults. */
+            void set_timeout(unsigned int seconds);
+
             bool test_connection();
 
         private:
@@ -144,6 +159,8 @@ namespace nova { namespace db { namespace mysql {
 
             std::string password;
 
+            unsigned int timeout;
+
             const std::string uri;
 
             const bool use_mycnf;
@@ -169,6 +186,60 @@ namespace nova { namespace db { namespace mysql {
     typedef boost::shared_ptr<MySqlConnectionWithDefaultDb>
         MySqlConnectionWithDefaultDbPtr;
 
+    /** Keeps connections which use the my.cnf credentials open between
+     *  uses, so each caller doesn't have to read my.cnf, connect and log in
+     *  again. A borrowed connection goes back to the pool when the last
+     *  copy of its pointer is destroyed. Idle connections are checked with
+     *  mysql_ping before they're handed out again, so one left open across
+     *  a restart of mysqld reconnects, and are closed once they've sat
+     *  unused for "max_idle_time" seconds. Safe to use from several
+     *  threads. Create instances with "create". */
+    class MySqlConnectionPool
+        : public boost::enable_shared_from_this<MySqlConnectionPool>,
+          boost::noncopyable
+    {
+        public:
+            ~MySqlConnectionPool();
+
+            /* Returns an idle connection, or a new one if there are none. */
+            MySqlConnectionPtr borrow();
+
+            static boost::shared_ptr<MySqlConnectionPool> create(
+                const char * uri, size_t max_idle=4, double max_idle_time=60);
+
+            /* The number of connections waiting to be borrowed. */
+            size_t idle_count() const;
+
+        private:
+            MySqlConnectionPool(const char * uri, size_t max_idle,
+                                double max_idle_time);
+
+            struct IdleConnection {
+                MySqlConnection * connection;
+                time_t since;
+            };
+
+            /* Deleter of borrowed connections, which gives them back. */
+            class Return;
+
+            // Most recently returned first.
+            std::list<IdleConnection> idle;
+
+            const size_t max_idle;
+
+            const double max_idle_time;
+
+            mutable boost::mutex mutex;
+
+            const std::string uri;
+
+            void give_back(MySqlConnection * connection);
+
+            void take_expired(std::list<IdleConnection> & expired);
+    };
+
+    typedef boost::shared_ptr<MySqlConnectionPool> MySqlConnectionPoolPtr;
+
     class MySqlResultSet : boost::noncopyable  {
         public:
             virtual ~MySqlResultSet();
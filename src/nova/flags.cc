@@ -248,6 +248,10 @@ FlagValues::FlagValues(FlagMapPtr map)
 {
 }
 
+bool FlagValues::apt_prefetch_on_prepare() const {
+    return get_flag_value<bool>(*map, "apt_prefetch_on_prepare", true);
+}
+
 const char * FlagValues::apt_self_package_name() const {
     return map->get("apt_self_package_name", "nova-guest");
 }
@@ -256,6 +260,10 @@ int FlagValues::apt_self_update_time_out() const {
     return get_flag_value<int>(*map, "apt_self_update_time_out", 1 * 60);
 }
 
+double FlagValues::apt_update_ttl() const {
+    return get_flag_value<double>(*map, "apt_update_ttl", 30 * 60);
+}
+
 bool FlagValues::apt_use_sudo() const {
     const char * value = map->get("apt_use_sudo", "true");
     return strncmp(value, "true", 4) == 0;
@@ -332,6 +340,22 @@ optional<const char *> FlagValues::host() const {
     return get_flag_value<const char *>(*map, "host");
 }
 
+size_t FlagValues::job_queue_size() const {
+    return get_flag_value(*map, "job_queue_size", (size_t) 4);
+}
+
+optional<size_t> FlagValues::log_async_buffer_size() const {
+    return get_flag_value<size_t>(*map, "log_async_buffer_size");
+}
+
+bool FlagValues::log_async_drop_on_overflow() const {
+    return get_flag_value<bool>(*map, "log_async_drop_on_overflow", false);
+}
+
+bool FlagValues::log_file_compress_old_files() const {
+    return get_flag_value<bool>(*map, "log_file_compress_old_files", true);
+}
+
 optional<int> FlagValues::log_file_max_old_files() const {
     return get_flag_value<int>(*map, "log_file_max_old_files");
 }
@@ -348,6 +372,19 @@ optional<const char *> FlagValues::log_file_path() const {
     return get_flag_value<const char *>(*map, "log_file_path");
 }
 
+double FlagValues::log_rotation_interval() const {
+    return get_flag_value<double>(*map, "log_rotation_interval",
+                                  (double) periodic_interval());
+}
+
+bool FlagValues::log_json_lines() const {
+    return get_flag_value<bool>(*map, "log_json_lines", false);
+}
+
+bool FlagValues::log_show_debug() const {
+    return get_flag_value<bool>(*map, "log_show_debug", true);
+}
+
 bool FlagValues::log_show_trace() const {
     return get_flag_value<bool>(*map, "log_show_trace", false);
 }
@@ -369,6 +406,11 @@ const char * FlagValues::monitoring_agent_package_name() const {
 
 }
 
+double FlagValues::monitoring_agent_check_interval() const {
+    return get_flag_value<double>(*map, "monitoring_agent_check_interval",
+                                  (double) periodic_interval());
+}
+
 double FlagValues::monitoring_agent_install_timeout() const {
     return get_flag_value<int>(*map, "monitoring_agent_install_timeout", 2 * 60);
 }
@@ -385,6 +427,10 @@ unsigned long FlagValues::periodic_interval() const {
     return get_flag_value(*map, "periodic_interval", (unsigned long) 60);
 }
 
+double FlagValues::periodic_jitter() const {
+    return get_flag_value<double>(*map, "periodic_jitter", 0.0);
+}
+
 std::list<std::string> FlagValues::possible_packages_for_mysql() const {
     return get_flag_value_as_string_list(*map, "possible_packages_for_mysql",
         "mysql-server-5.1,mysql-server-5.5");
@@ -419,10 +465,19 @@ bool FlagValues::register_dangerous_functions() const {
     return get_flag_value<bool>(*map, "register_dangerous_functions", false);
 }
 
+optional<const char *> FlagValues::root_helper_path() const {
+    return get_flag_value<const char *>(*map, "root_helper_path");
+}
+
 bool FlagValues::skip_install_for_prepare() const {
     return get_flag_value<bool>(*map, "skip_install_for_prepare", false);
 }
 
+double FlagValues::status_heartbeat_interval() const {
+    return get_flag_value<double>(*map, "status_heartbeat_interval",
+                                  (double) periodic_interval());
+}
+
 size_t FlagValues::status_thread_stack_size() const {
     return get_flag_value(*map, "status_thread_stack_size",
                           (size_t) 1024 * 1024);
@@ -456,6 +511,10 @@ const char * FlagValues::volume_mount_options() const {
     return map->get("volume_mount_options", "defaults,noatime");
 }
 
+size_t FlagValues::worker_thread_count() const {
+    return get_flag_value(*map, "worker_thread_count", (size_t) 1);
+}
+
 size_t FlagValues::worker_thread_stack_size() const {
     return get_flag_value(*map, "worker_thread_stack_size",
                           (size_t) 1024 * 1024);
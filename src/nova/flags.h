@@ -89,12 +89,20 @@ class FlagValues {
 
         FlagValues(FlagMapPtr flags);
 
+        /** If true, prepare starts downloading its packages in the
+         *  background while the volume is mounted. */
+        bool apt_prefetch_on_prepare() const;
+
         bool apt_use_sudo() const;
 
         const char * apt_self_package_name() const;
 
         int apt_self_update_time_out() const;
 
+        /** Seconds after apt-get update during which further updates are
+         *  skipped. */
+        double apt_update_ttl() const;
+
         size_t backup_zlib_buffer_size() const;
 
         std::list<std::string> backup_process_commands() const;
@@ -127,14 +135,38 @@ class FlagValues {
 
         boost::optional<const char *> host() const;
 
+        /** How many jobs (such as backups) may wait for a worker thread
+         *  before new ones are refused. */
+        size_t job_queue_size() const;
+
+        /** When set, lines are written by a background thread through a
+         *  queue holding this many lines. */
+        boost::optional<size_t> log_async_buffer_size() const;
+
+        /** In async mode, drop lines other than errors when the queue is
+         *  full instead of waiting for room. */
+        bool log_async_drop_on_overflow() const;
+
+        /** Gzip log files in the background once they're rotated. */
+        bool log_file_compress_old_files() const;
+
         boost::optional<int> log_file_max_old_files() const;
 
         boost::optional<const char *> log_file_path() const;
 
+        /** Seconds between checks of whether the logs need rotating.
+         *  Defaults to "periodic_interval". */
+        double log_rotation_interval() const;
+
         boost::optional<size_t> log_file_max_size() const;
 
         boost::optional<double> log_file_max_time() const;
 
+        /** Write the log as one JSON object per line. */
+        bool log_json_lines() const;
+
+        bool log_show_debug() const;
+
         bool log_show_trace() const;
 
         bool log_use_std_streams() const;
@@ -145,6 +177,10 @@ class FlagValues {
 
         const char * monitoring_agent_package_name() const;
 
+        /** Seconds between checks that the monitoring agent is running.
+         *  Defaults to "periodic_interval". */
+        double monitoring_agent_check_interval() const;
+
         double monitoring_agent_install_timeout() const;
 
         /** Time MySQL we'll wait for the MySQL app to change from running to
@@ -155,6 +191,10 @@ class FlagValues {
 
         unsigned long periodic_interval() const;
 
+        /** Periodic tasks run up to this many seconds early or late, so
+         *  that tasks sharing an interval don't all run at once. */
+        double periodic_jitter() const;
+
         std::list<std::string> possible_packages_for_mysql() const;
 
         size_t rabbit_client_memory() const;
@@ -171,8 +211,19 @@ class FlagValues {
 
         bool register_dangerous_functions() const;
 
+        /** If set, this binary is started once through sudo and runs the
+         *  agent's privileged commands instead of sudo being forked for
+         *  each one. */
+        boost::optional<const char *> root_helper_path() const;
+
         bool skip_install_for_prepare() const;
 
+        /** Seconds between heartbeats sent to Conductor while the status
+         *  stays the same. Changes are always sent right away. Defaults to
+         *  "periodic_interval", so every update still sends one; raising it
+         *  must keep it below Conductor's heartbeat expiry. */
+        double status_heartbeat_interval() const;
+
         size_t status_thread_stack_size() const;
 
         const char * sql_connection() const;
@@ -191,6 +242,9 @@ class FlagValues {
 
         const char * volume_mount_options() const;
 
+        /** Number of threads running jobs such as backups. */
+        size_t worker_thread_count() const;
+
         size_t worker_thread_stack_size() const;
 
         const char * conductor_queue() const;
@@ -21,20 +21,65 @@ using std::vector;
 
 namespace nova {  namespace guest { namespace agent {
 
+ReceiverOpener::ReceiverOpener(const FlagValues & flags, const string & topic)
+:   flags(flags),
+    receiver(),
+    topic(topic) {
+}
+
+boost::shared_ptr<ResilientReceiver> ReceiverOpener::get() const {
+    if (!receiver) {
+        throw GuestException(GuestException::GENERAL);
+    }
+    return receiver;
+}
+
+void ReceiverOpener::open() {
+    try {
+        receiver.reset(new ResilientReceiver(
+            flags.rabbit_host(), flags.rabbit_port(),
+            flags.rabbit_userid(), flags.rabbit_password(),
+            flags.rabbit_client_memory(), topic.c_str(),
+            flags.control_exchange(),
+            flags.rabbit_reconnect_wait_time()));
+    } catch(const std::exception & e) {
+        // Errors can't leave the thread, so "get" reports them instead.
+        NOVA_LOG_ERROR("Error creating the message receiver: %s", e.what());
+    }
+}
+
+void log_startup_step(const char * step, double step_start,
+                      double startup_start) {
+    const double finished = nova::utils::subsecond::now();
+    NOVA_LOG_INFO("Startup: %s took %.3f seconds (%.3f since starting).",
+                  step, finished - step_start, finished - startup_start);
+}
+
 LogOptions log_options_from_flags(const flags::FlagValues & flags) {
     boost::optional<LogFileOptions> log_file_options;
     if (flags.log_file_path()) {
         LogFileOptions ops(flags.log_file_path().get(),
                            flags.log_file_max_size(),
                            flags.log_file_max_time(),
-                           flags.log_file_max_old_files().get_value_or(30));
+                           flags.log_file_max_old_files().get_value_or(30),
+                           flags.log_file_compress_old_files());
         log_file_options = boost::optional<LogFileOptions>(ops);
     } else {
         log_file_options = boost::none;
     }
+    boost::optional<LogAsyncOptions> log_async_options;
+    if (flags.log_async_buffer_size()) {
+        log_async_options = LogAsyncOptions(
+            flags.log_async_buffer_size().get(),
+            flags.log_async_drop_on_overflow() ? LogAsyncOptions::DROP
+                                               : LogAsyncOptions::BLOCK);
+    }
     LogOptions log_options(log_file_options,
                            flags.log_use_std_streams(),
-                           flags.log_show_trace());
+                           flags.log_show_trace(),
+                           log_async_options);
+    log_options.json_lines = flags.log_json_lines();
+    log_options.show_debug = flags.log_show_debug();
     return log_options;
 }
 
@@ -83,6 +128,7 @@ void message_loop(ResilientReceiver & receiver,
     try {
 #endif
         GuestInput input = receiver.next_message();
+        nova::LogFieldScope method_field("method", input.method_name);
         NOVA_LOG_INFO("method=%s", input.method_name.c_str());
 
         GuestOutput output(run_method(handlers, input));
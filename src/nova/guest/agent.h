@@ -11,63 +11,88 @@
 #include <boost/tuple/tuple.hpp>
 #include "nova/Log.h"
 #include "nova/rpc/sender.h"
+#include "nova/sudo.h"
+#include "nova/utils/subsecond.h"
 #include "nova/utils/threads.h"
 #include "nova/guest/utils.h"
 
-/* In release mode, all errors should be caught so the guest will not die.
- * If you want to see the bugs in the debug mode, you can fiddle with it here.
- */
-// #ifndef _DEBUG
-#define NOVA_GUEST_AGENT_START_THREAD_TASK() try {
-#define NOVA_GUEST_AGENT_END_THREAD_TASK(name)  \
-     } catch(const std::exception & e) { \
-        NOVA_LOG_ERROR("Error in " name "! : %s", e.what()); \
-     } catch(...) { \
-        NOVA_LOG_ERROR("Error in " name "! Exception type unknown."); \
-     }
-
-
-
 namespace nova { namespace guest { namespace agent {
 
 
 /**
- * Sends updates back to Trove regarding the status of both
- * Sneaky Pete and the running application.
+ * Adapts an agent's status updater, or anything else with an operator(),
+ * into a periodic task.
  */
-template<typename AppStatusPtr>
-class PeriodicTasker : public nova::utils::Thread::Runner {
+template<typename FunctorPtr>
+class PeriodicFunctor : public nova::utils::PeriodicTask {
 
 private:
-    const unsigned long periodic_interval;
-    AppStatusPtr status_updater;
+    FunctorPtr functor;
 
 public:
-    PeriodicTasker(AppStatusPtr status_updater,
-                   unsigned long periodic_interval)
-      : periodic_interval(periodic_interval),
-        status_updater(status_updater)
+    PeriodicFunctor(FunctorPtr functor)
+      : functor(functor)
     {
     }
 
     virtual void operator()() {
-        while(true) {
-            boost::posix_time::seconds time(periodic_interval);
-            boost::this_thread::sleep(time);
-            periodic_tasks();
-        }
+        (*functor)();
     }
 
-    void periodic_tasks() {
-        NOVA_GUEST_AGENT_START_THREAD_TASK();
-            NOVA_LOG_TRACE("Running periodic tasks...");
-            (*status_updater)();
-            Log::rotate_logs_if_needed();
-        NOVA_GUEST_AGENT_END_THREAD_TASK("periodic_tasks()");
+};
+
+/** Checks whether the logs need rotating. */
+class LogRotationTask : public nova::utils::PeriodicTask {
+public:
+    virtual void operator()() {
+        Log::rotate_logs_if_needed();
+    }
+};
+
+/**
+ * Adds the periodic tasks which send updates back to Trove regarding the
+ * status of both Sneaky Pete and the running application. By default the
+ * agent's status updater runs every "periodic_interval" seconds; agents
+ * with several jobs to do can specialize this to give each of them its own
+ * task and cadence.
+ */
+template<typename AppStatusPtr>
+struct PeriodicTaskRegistrar {
+    static void add_tasks(nova::utils::PeriodicScheduler & scheduler,
+                          AppStatusPtr status_updater,
+                          const nova::flags::FlagValues & flags) {
+        nova::utils::PeriodicTaskPtr task(
+            new PeriodicFunctor<AppStatusPtr>(status_updater));
+        scheduler.add("status", task, flags.periodic_interval(),
+                      flags.periodic_jitter());
     }
+};
+
+/**
+ * Connects to the broker to receive messages. "open" is meant to be run on
+ * its own thread so the agent can initialize everything else meanwhile.
+ */
+class ReceiverOpener : boost::noncopyable {
+public:
+    ReceiverOpener(const nova::flags::FlagValues & flags,
+                   const std::string & topic);
+
+    /** Returns the receiver once the thread running "open" has been
+     *  joined. Throws a GuestException if it couldn't be created. */
+    boost::shared_ptr<nova::rpc::ResilientReceiver> get() const;
 
+    void open();
+
+private:
+    const nova::flags::FlagValues flags;
+    boost::shared_ptr<nova::rpc::ResilientReceiver> receiver;
+    const std::string topic;
 };
 
+/** Logs how long a step of starting up took and when it finished. */
+void log_startup_step(const char * step, double step_start,
+                      double startup_start);
+
 nova::LogOptions log_options_from_flags(const nova::flags::FlagValues & flags);
 
 void run_json_method(std::vector<MessageHandlerPtr> & handlers,
@@ -96,28 +121,33 @@ void initialize_and_run(const char * const title,
     NOVA_LOG_INFO(banner_text.c_str());
     NOVA_LOG_INFO(" ^  /                         starting now...^");
     NOVA_LOG_INFO(" ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^");
+    using nova::utils::subsecond::now;
+    const double startup_start = now();
+
+    /* Launch the root helper before any threads exist. */
+    double step_start = now();
+    nova::process::RootHelperScope root_helper_scope(
+        flags.root_helper_path());
+    log_startup_step("launching the root helper", step_start, startup_start);
 
-    /* Create Conductor connection. */
+    /* Create the function object, in case other goodies are attached to
+     * it (such as CurlScope). Those expect to be set up before any threads
+     * start. */
+    initialize_handlers_func initialize_handlers;
+
+    /* Both broker connections are opened in the background while the
+     * handlers are initialized, since none of them depend on each other.
+     * Anything sent to Conductor before its connection is up waits. */
     nova::rpc::ResilientSenderPtr sender(new nova::rpc::ResilientSender(
         flags.rabbit_host(), flags.rabbit_port(),
         flags.rabbit_userid(), flags.rabbit_password(),
         flags.rabbit_client_memory(), flags.conductor_queue(),
         flags.control_exchange(),
         flags.guest_id(),
-        flags.rabbit_reconnect_wait_time()));
-
-    /* Create the function object, in case other goodies are attached to
-     * it (such as CurlScope). */
-    initialize_handlers_func initialize_handlers;
-
-    /* Create job runner, but don't start it's thread until later. */
-    nova::utils::ThreadBasedJobRunner job_runner;
-
-    /* Create JSON message handlers. */
-    std::vector<MessageHandlerPtr> handlers;
-    AppStatusPtr status_updater;
-    boost::tie(handlers, status_updater) =
-        initialize_handlers(flags, sender, job_runner);
+        flags.rabbit_reconnect_wait_time(),
+        false));
+    boost::thread sender_thread(&nova::rpc::ResilientSender::connect,
+                                sender);
 
     /* Set host value. */
     std::string actual_host = nova::guest::utils::get_host_name();
@@ -126,18 +156,47 @@ void initialize_and_run(const char * const title,
     /* Create AMQP connection. */
     std::string topic = str(boost::format("guestagent.%s") % flags.guest_id());
 
-    NOVA_LOG_INFO("Starting status thread...");
-    PeriodicTasker<AppStatusPtr> tasker(status_updater,
-                                        flags.periodic_interval());
-    nova::utils::Thread statusThread(flags.status_thread_stack_size(), tasker);
-
-    NOVA_LOG_INFO("Starting job thread...");
-    nova::utils::Thread workerThread(flags.worker_thread_stack_size(),
-                                     job_runner);
-
     // If a "message" is specified we just run it and quit. Otherwise,
     // it's Rabbit time.
     boost::optional<const char *> message = flags.message();
+    boost::shared_ptr<ReceiverOpener> receiver_opener(
+        new ReceiverOpener(flags, topic));
+    boost::thread receiver_thread;
+    if (!message) {
+        receiver_thread = boost::thread(&ReceiverOpener::open,
+                                        receiver_opener);
+    }
+
+    /* Create job runner, but don't start its threads until later. */
+    nova::utils::ThreadBasedJobRunner job_runner(flags.job_queue_size(),
+                                                 flags.worker_thread_count());
+
+    /* Create JSON message handlers. */
+    step_start = now();
+    std::vector<MessageHandlerPtr> handlers;
+    AppStatusPtr status_updater;
+    boost::tie(handlers, status_updater) =
+        initialize_handlers(flags, sender, job_runner);
+    log_startup_step("initializing handlers", step_start, startup_start);
+
+    NOVA_LOG_INFO("Starting status thread...");
+    nova::utils::PeriodicScheduler scheduler(flags.status_thread_stack_size());
+    PeriodicTaskRegistrar<AppStatusPtr>::add_tasks(scheduler, status_updater,
+                                                   flags);
+    scheduler.add("log rotation",
+                  nova::utils::PeriodicTaskPtr(new LogRotationTask()),
+                  flags.log_rotation_interval(), flags.periodic_jitter());
+    nova::utils::Thread statusThread(flags.status_thread_stack_size(),
+                                     scheduler);
+
+    NOVA_LOG_INFO("Starting job threads...");
+    std::vector<boost::shared_ptr<nova::utils::Thread> > worker_threads;
+    for (size_t i = 0; i < job_runner.get_worker_count(); ++ i) {
+        worker_threads.push_back(boost::shared_ptr<nova::utils::Thread>(
+            new nova::utils::Thread(flags.worker_thread_stack_size(),
+                                    job_runner)));
+    }
+
     if (message) {
         run_json_method(handlers, message.get());
         // If a SP is being run with a message, it's possible it needs to run
@@ -149,24 +208,20 @@ void initialize_and_run(const char * const title,
             boost::this_thread::sleep(boost::posix_time::seconds(1));
         }
     } else {
-        NOVA_LOG_INFO("Before we go further, lets chill out and take a nap.");
-        // Before we go any further, lets all just chill out and take a nap.
-        // TODO(tim.simpson) In the past a large spike in virtual memory (60
-        // MB) was observed when starting the guest. However, sleeping here
-        // appears to avert this phenomenon.
-        boost::this_thread::sleep(boost::posix_time::seconds(3));
-
-        nova::rpc::ResilientReceiver receiver(flags.rabbit_host(), flags.rabbit_port(),
-                    flags.rabbit_userid(), flags.rabbit_password(),
-                    flags.rabbit_client_memory(), topic.c_str(),
-                    flags.control_exchange(),
-                    flags.rabbit_reconnect_wait_time());
-
-        message_loop(receiver, handlers);
+        step_start = now();
+        receiver_thread.join();
+        boost::shared_ptr<nova::rpc::ResilientReceiver> receiver =
+            receiver_opener->get();
+        log_startup_step("waiting for the message queue", step_start,
+                         startup_start);
+        message_loop(*receiver, handlers);
     }
+    sender_thread.join();
 
+    NOVA_LOG_INFO("Shutting down Sneaky Pete. Stopping periodic tasks.");
+    scheduler.shutdown();
     // Gracefully kill the job runner.
-    NOVA_LOG_INFO("Shutting down Sneaky Pete. Killing job runner.");
+    NOVA_LOG_INFO("Killing job runner.");
     job_runner.shutdown();
     NOVA_LOG_INFO(" ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^");
     NOVA_LOG_INFO(" ^           ^ ^                             ^");
@@ -2,14 +2,114 @@
 #define __NOVA_GUEST_APT_H
 
 #include "guest.h"
+#include <map>
+#include <boost/thread/mutex.hpp>
 #include <boost/optional.hpp>
 #include <boost/shared_ptr.hpp>
+#include <sys/stat.h>
+#include <string>
+#include <boost/thread.hpp>
+#include <sys/types.h>
 #include <boost/utility.hpp>
+#include <vector>
 
 
 namespace nova { namespace guest { namespace apt {
 
 
+    /** Looks up packages in dpkg's status database without running
+     *  dpkg-query. The file is memory mapped and indexed by package name
+     *  the first time it's needed, and the journal entries dpkg keeps in
+     *  the "updates" directory next to it are applied on top, as dpkg
+     *  itself does. Inotify watches on both directories notice when dpkg
+     *  changes either, and the index is rebuilt on the next lookup after
+     *  that. Safe to use from several threads. */
+    class DpkgStatus : boost::noncopyable {
+
+        public:
+            DpkgStatus(const char * status_file_path="/var/lib/dpkg/status");
+
+            ~DpkgStatus();
+
+            /** Sets "version" to the version of the given package, or
+             *  boost::none if dpkg has no version for it, just as
+             *  "dpkg-query -W" would report. Returns false without touching
+             *  "version" if the database couldn't be read. */
+            bool version(const char * package_name,
+                         boost::optional<std::string> & version);
+
+        private:
+            struct Package {
+                std::string status;
+                std::string version;
+            };
+
+            typedef std::map<std::string, Package> Index;
+
+            Index index;
+
+            int inotify_fd;
+
+            bool loaded;
+
+            boost::mutex mutex;
+
+            const std::string path;
+
+            bool stale;
+
+            // Used to tell if the file changed when inotify isn't available.
+            ino_t stat_inode;
+            time_t stat_modified;
+            long stat_modified_nsec;
+
+            // Where dpkg journals changes before folding them into the
+            // status file.
+            const std::string updates_path;
+
+            time_t updates_modified;
+            long updates_modified_nsec;
+
+            int updates_watch;
+
+            bool apply_updates();
+
+            bool load();
+
+            /* Parses and indexes one file. Entries for packages already in
+             * the index replace them if "replace" is true. */
+            bool load_file(const std::string & file_path, bool replace,
+                           struct stat & info);
+
+            void parse(const char * text, size_t length, bool replace);
+
+            bool is_stale();
+
+            void watch();
+    };
+
+
+    /** Returns the newest modification time of "directory" or any regular
+     *  file in it, or zero if the directory doesn't exist. */
+    time_t newest_modification_time(const char * directory);
+
+    /** Returns how many seconds before "now" the package lists in
+     *  "lists_directory" were refreshed, counting "last_refresh" as a
+     *  refresh known of by the caller. Returns boost::none if they were
+     *  never refreshed, or if "sources_list" or anything in
+     *  "sources_directory" changed since, as the lists are then stale
+     *  whatever their age. */
+    boost::optional<double> package_lists_age(const char * lists_directory,
+                                              const char * sources_list,
+                                              const char * sources_directory,
+                                              time_t last_refresh, time_t now);
+
+    /** Decides whether "apt-get update" has to run, given the lists' age
+     *  from package_lists_age. */
+    bool package_lists_need_refresh(const boost::optional<double> & age,
+                                    double update_ttl, bool force);
+
+
     /** Calls apt-get and other Debian package manager commands. */
     class AptGuest : boost::noncopyable {
 
@@ -19,9 +119,14 @@ namespace nova { namespace guest { namespace apt {
              * "self_package_name" - The name of this package.
              * "self_update_time_out" - The time waited after the update call
              * before the assumption is made that the command was executed
-             * incorrectly. */
+             * incorrectly.
+             * "update_ttl" - Seconds the package lists count as fresh after
+             * they were last refreshed. Zero means every update runs. */
             AptGuest(bool with_sudo, const char * self_package_name,
-                     int self_update_time_out);
+                     int self_update_time_out, double update_ttl=0);
+
+            /* Waits for any prefetch which is still running. */
+            ~AptGuest();
 
             /** Attempts to fix apt. */
             void fix(double time_out);
@@ -30,33 +135,74 @@ namespace nova { namespace guest { namespace apt {
              *  for the duration of time_out, an exception is raised. */
             void install(const char * package_name, const double time_out);
 
+            /** Installs all of the given packages in one apt-get call, so
+             *  their dependencies are resolved together and dpkg only runs
+             *  once. Waits for any prefetch to finish first. */
+            void install(const std::vector<std::string> & package_names,
+                         const double time_out);
+
             /** Updates this very program. */
             void install_self_update();
 
+            /** Starts downloading the given packages into apt's cache
+             *  ("apt-get -d install") in the background and returns at once,
+             *  so a later install only has to unpack them. Failures are
+             *  logged and otherwise ignored, as the install will simply
+             *  download whatever is missing. Does nothing if an earlier
+             *  prefetch is still running. */
+            void prefetch(const std::vector<std::string> & package_names,
+                          const double time_out);
+
             /** Remove the given package. If apt-get output is not received for
              *  the duration of time_out, an exception is raised. */
             void remove(const char * package_name, const double time_out);
 
             /** Updates the cache on this box. If output is not received for the
-             *  duration of time_out, an exception is raised. */
-            void update(const double time_out);
+             *  duration of time_out, an exception is raised. Does nothing
+             *  if the package lists were refreshed within the last
+             *  "update_ttl" seconds, unless "force" is true. */
+            void update(const double time_out, bool force=false);
 
             /** Find the version of the given package. Returns the string
              *  name of the package or boost::none if the package is not
-             *  installed. */
+             *  installed. Reads dpkg's database directly, only falling back
+             *  to dpkg-query (and "time_out") if that can't be read. */
             boost::optional<std::string> version(const char * package_name,
                                                  const double time_out=30);
 
         private:
 
+            void _fix(double time_out);
+
             pid_t _install_new_self();
 
+            void _prefetch(const std::vector<std::string> package_names,
+                           const double time_out);
+
+            void refresh_lists(const double time_out, bool force);
+
             void resilient_remove(const char * package_name,
                                   const double time_out);
 
+            DpkgStatus dpkg_status;
+            // How long the last apt-get update took, used to tell how much
+            // time skipping one saves.
+            boost::optional<double> last_update_duration;
+            time_t last_update_time;
+            // Held for the whole of each apt operation, including a
+            // prefetch, as apt-get and dpkg can't run twice at once.
+            boost::mutex apt_mutex;
+            boost::mutex prefetch_mutex;
+            boost::thread prefetch_thread;
             std::string self_package_name;
             int self_update_time_out;
+            double update_ttl;
             bool with_sudo;
+
+            boost::optional<std::string> version_from_dpkg_query(
+                const char * package_name, const double time_out);
+
+            void wait_for_prefetch();
     };
 
     typedef boost::shared_ptr<AptGuest> AptGuestPtr;
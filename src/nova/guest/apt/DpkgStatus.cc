@@ -0,0 +1,308 @@
+#include "pch.hpp"
+#include "nova/guest/apt.h"
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <boost/thread/locks.hpp>
+#include "nova/Log.h"
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using boost::optional;
+using std::string;
+using std::vector;
+
+namespace nova { namespace guest { namespace apt {
+
+namespace {
+
+    /* Sets "value" and returns true if "line" is the field "name". */
+    bool field_value(const char * line, size_t length, const char * name,
+                     string & value) {
+        const size_t name_length = strlen(name);
+        if (length < name_length || strncmp(line, name, name_length) != 0) {
+            return false;
+        }
+        size_t start = name_length;
+        while (start < length && line[start] == ' ') {
+            ++ start;
+        }
+        value.assign(line + start, length - start);
+        return true;
+    }
+
+    /* Update files are named with a sequence number; anything else, like
+     * the "tmp.i" dpkg writes first, is ignored as dpkg does. */
+    bool is_update_file_name(const char * name) {
+        if (*name == '\0') {
+            return false;
+        }
+        for (; *name != '\0'; ++ name) {
+            if (*name < '0' || *name > '9') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool update_file_order(const string & a, const string & b) {
+        return strtoul(a.c_str(), 0, 10) < strtoul(b.c_str(), 0, 10);
+    }
+
+    string directory_of(const string & path) {
+        const size_t slash = path.find_last_of('/');
+        return slash == string::npos ? "."
+               : (slash == 0 ? "/" : path.substr(0, slash));
+    }
+
+    /* The last word of a status is the package's state, such as
+     * "installed" or "config-files". */
+    bool is_not_installed(const string & status) {
+        const string state = status.substr(status.find_last_of(' ') + 1);
+        return state == "not-installed";
+    }
+
+}  // end anonymous namespace
+
+
+DpkgStatus::DpkgStatus(const char * status_file_path)
+:   index(),
+    inotify_fd(-1),
+    loaded(false),
+    mutex(),
+    path(status_file_path),
+    stale(true),
+    stat_inode(0),
+    stat_modified(0),
+    stat_modified_nsec(0),
+    updates_path(directory_of(status_file_path) + "/updates"),
+    updates_modified(0),
+    updates_modified_nsec(0),
+    updates_watch(-1) {
+}
+
+DpkgStatus::~DpkgStatus() {
+    if (inotify_fd >= 0) {
+        ::close(inotify_fd);
+    }
+}
+
+bool DpkgStatus::apply_updates() {
+    DIR * directory = ::opendir(updates_path.c_str());
+    if (directory == 0) {
+        if (errno == ENOENT) {
+            return true;
+        }
+        NOVA_LOG_ERROR("Couldn't open %s: %s", updates_path.c_str(),
+                       strerror(errno));
+        return false;
+    }
+    vector<string> names;
+    struct dirent * entry;
+    while ((entry = ::readdir(directory)) != 0) {
+        if (is_update_file_name(entry->d_name)) {
+            names.push_back(entry->d_name);
+        }
+    }
+    ::closedir(directory);
+    std::sort(names.begin(), names.end(), update_file_order);
+    for (size_t index = 0; index < names.size(); ++ index) {
+        struct stat info;
+        if (!load_file(updates_path + "/" + names[index], true, info)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DpkgStatus::is_stale() {
+    if (!loaded) {
+        return true;
+    }
+    if (inotify_fd < 0) {
+        struct stat info;
+        if (::stat(path.c_str(), &info) != 0) {
+            return true;
+        }
+        if (info.st_ino != stat_inode
+            || info.st_mtim.tv_sec != stat_modified
+            || info.st_mtim.tv_nsec != stat_modified_nsec) {
+            return true;
+        }
+        if (::stat(updates_path.c_str(), &info) != 0) {
+            return updates_modified != 0;
+        }
+        return info.st_mtim.tv_sec != updates_modified
+            || info.st_mtim.tv_nsec != updates_modified_nsec;
+    }
+    // dpkg writes "status-new" and then renames it over "status", so in
+    // its directory only events for the status file itself, or for the
+    // updates directory coming or going, matter. Anything happening inside
+    // the updates directory does.
+    const size_t slash = path.find_last_of('/');
+    const string file_name = path.substr(slash + 1);
+    const string updates_name = updates_path.substr(
+        updates_path.find_last_of('/') + 1);
+    char buffer[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t count;
+    while ((count = ::read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char * ptr = buffer; ptr < buffer + count;
+             ptr += sizeof(struct inotify_event)
+                    + ((struct inotify_event *) ptr)->len) {
+            const struct inotify_event * event =
+                (const struct inotify_event *) ptr;
+            if ((event->mask & IN_Q_OVERFLOW)
+                || (event->len > 0 && (event->wd == updates_watch
+                                       || file_name == event->name))) {
+                stale = true;
+            } else if (event->len > 0 && updates_name == event->name) {
+                stale = true;
+                if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    // Its watch went with it.
+                    updates_watch = -1;
+                }
+            }
+        }
+    }
+    return stale;
+}
+
+bool DpkgStatus::load() {
+    // Watch first, so a change made while the files are read isn't missed.
+    watch();
+    struct stat updates_info;
+    const bool has_updates = ::stat(updates_path.c_str(), &updates_info) == 0;
+    index.clear();
+    struct stat info;
+    if (!load_file(path, false, info) || !apply_updates()) {
+        return false;
+    }
+    stat_inode = info.st_ino;
+    stat_modified = info.st_mtim.tv_sec;
+    stat_modified_nsec = info.st_mtim.tv_nsec;
+    updates_modified = has_updates ? updates_info.st_mtim.tv_sec : 0;
+    updates_modified_nsec = has_updates ? updates_info.st_mtim.tv_nsec : 0;
+    loaded = true;
+    stale = false;
+    NOVA_LOG_DEBUG("Indexed %d packages from %s.", index.size(), path.c_str());
+    return true;
+}
+
+bool DpkgStatus::load_file(const string & file_path, bool replace,
+                           struct stat & info) {
+    const int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        NOVA_LOG_ERROR("Couldn't open %s: %s", file_path.c_str(),
+                       strerror(errno));
+        return false;
+    }
+    if (::fstat(fd, &info) != 0) {
+        NOVA_LOG_ERROR("Couldn't stat %s: %s", file_path.c_str(),
+                       strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    if (info.st_size > 0) {
+        void * text = ::mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            NOVA_LOG_ERROR("Couldn't map %s: %s", file_path.c_str(),
+                           strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        parse(static_cast<const char *>(text), info.st_size, replace);
+        ::munmap(text, info.st_size);
+    }
+    ::close(fd);
+    return true;
+}
+
+void DpkgStatus::parse(const char * text, size_t length, bool replace) {
+    const char * const end = text + length;
+    string name;
+    Package package;
+    const char * line = text;
+    while (line <= end) {
+        const char * line_end = static_cast<const char *>(
+            memchr(line, '\n', end - line));
+        if (line_end == 0) {
+            line_end = end;
+        }
+        const size_t line_length = line_end - line;
+        if (line_length == 0) {
+            // A blank line ends the stanza. Like dpkg-query, the first
+            // entry for a name in the status file wins if there's more
+            // than one, while updates replace what came before them.
+            if (!name.empty()
+                && (replace || index.find(name) == index.end())) {
+                index[name] = package;
+            }
+            name.clear();
+            package = Package();
+        } else if (line[0] != ' ') {
+            // Lines starting with a space continue a multi-line field.
+            if (!field_value(line, line_length, "Package:", name)
+                && !field_value(line, line_length, "Status:",
+                                package.status)) {
+                field_value(line, line_length, "Version:", package.version);
+            }
+        }
+        line = line_end + 1;
+    }
+    if (!name.empty() && (replace || index.find(name) == index.end())) {
+        index[name] = package;
+    }
+}
+
+bool DpkgStatus::version(const char * package_name,
+                         optional<string> & version) {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    if (is_stale() && !load()) {
+        return false;
+    }
+    Index::const_iterator found = index.find(package_name);
+    if (found == index.end() || found->second.version.empty()
+        || is_not_installed(found->second.status)) {
+        version = boost::none;
+    } else {
+        version = found->second.version;
+    }
+    return true;
+}
+
+void DpkgStatus::watch() {
+    if (inotify_fd < 0) {
+        inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd < 0) {
+            NOVA_LOG_INFO("inotify isn't available, so %s will be checked "
+                          "with stat instead.", path.c_str());
+            return;
+        }
+        const string directory = directory_of(path);
+        if (::inotify_add_watch(inotify_fd, directory.c_str(),
+                                IN_CLOSE_WRITE | IN_CREATE | IN_DELETE
+                                | IN_MOVED_FROM | IN_MOVED_TO) < 0) {
+            NOVA_LOG_INFO("Couldn't watch %s, so %s will be checked with "
+                          "stat instead.", directory.c_str(), path.c_str());
+            ::close(inotify_fd);
+            inotify_fd = -1;
+            return;
+        }
+    }
+    // dpkg keeps the updates directory around, but if it's missing now the
+    // watch on its parent sees it appear and the next load tries again.
+    if (updates_watch < 0) {
+        updates_watch = ::inotify_add_watch(inotify_fd, updates_path.c_str(),
+                                            IN_CLOSE_WRITE | IN_CREATE
+                                            | IN_DELETE | IN_MOVED_FROM
+                                            | IN_MOVED_TO);
+    }
+}
+
+} } }  // end namespace nova::guest::apt
@@ -1,5 +1,6 @@
 #include "pch.hpp"
 #include "nova/guest/apt.h"
+#include <algorithm>
 #include <boost/assign/list_of.hpp>
 #include <boost/assign/std/list.hpp>
 #include "nova/Log.h"
@@ -10,15 +11,18 @@
 #include <iostream>
 #include <malloc.h>  // Valgrind complains if we don't use "free" below. ;_;
 #include "nova/process.h"
+#include "nova/utils/subsecond.h"
 #include "nova/utils/io.h"
 #include "nova/utils/regex.h"
 #include <sys/select.h>
 #include <boost/smart_ptr.hpp>
+#include <dirent.h>
 #include <spawn.h>
 #include <sstream>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <vector>
 
 
@@ -29,14 +33,14 @@ using std::auto_ptr;
 using boost::format;
 using boost::optional;
 namespace proc = nova::process;
-using nova::utils::Regex;
+using nova::utils::PatternSet;
 using nova::utils::RegexMatches;
 using nova::utils::RegexMatchesPtr;
 using boost::shared_ptr;
 using std::stringstream;
 using std::string;
 using nova::utils::io::TimeOutException;
-using nova::utils::io::Timer;
+using nova::utils::io::Deadline;
 using std::vector;
 
 
@@ -53,10 +57,13 @@ namespace {
         REINSTALL_FIRST = 2
     };
 
-    struct ProcessResult {
-        int index;
-        RegexMatchesPtr matches;
-    };
+    typedef PatternSet::Match ProcessResult;
+
+    const char * const APT_LISTS_DIRECTORY = "/var/lib/apt/lists";
+
+    const char * const APT_SOURCES_LIST = "/etc/apt/sources.list";
+
+    const char * const APT_SOURCES_LIST_DIRECTORY = "/etc/apt/sources.list.d";
 
     void wait_for_proc_to_finish(pid_t pid, int time_out) {
         int time_left = time_out;
@@ -66,17 +73,119 @@ namespace {
         }
     }
 
+    /** Hands each line of output to a PatternSet, stopping at the first
+     *  line that matches one of its patterns. */
+    class OutputMatcher : public proc::LineHandler {
+        public:
+            OutputMatcher(PatternSet & patterns)
+            :   patterns(patterns)
+            {
+            }
+
+            virtual bool on_line(const char * line, size_t length,
+                                 bool ended) {
+                NOVA_LOG_TRACE("apt output: %s", line);
+                result = patterns.match(line, length);
+                return !result;
+            }
+
+            // Prompts such as sudo's password request don't end in a
+            // newline, so they have to be matched before the line ends.
+            virtual bool on_partial_line(const char * line, size_t length) {
+                result = patterns.match(line, length, true);
+                return !result;
+            }
+
+            optional<ProcessResult> result;
+
+        private:
+            PatternSet & patterns;
+    };
+
 } // end anonymous namespace
 
 
+time_t newest_modification_time(const char * directory) {
+    struct stat info;
+    if (::stat(directory, &info) != 0) {
+        return 0;
+    }
+    // apt-get update renames the lists it downloads into the directory,
+    // which changes the directory's time even when the files keep the
+    // times given by the mirror. Removing a file changes it too.
+    time_t newest = info.st_mtime;
+    DIR * dir = ::opendir(directory);
+    if (dir == 0) {
+        return newest;
+    }
+    const string prefix = string(directory) + "/";
+    struct dirent * entry;
+    while ((entry = ::readdir(dir)) != 0) {
+        const string path = prefix + entry->d_name;
+        if (::lstat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode)
+            && info.st_mtime > newest) {
+            newest = info.st_mtime;
+        }
+    }
+    ::closedir(dir);
+    return newest;
+}
+
+optional<double> package_lists_age(const char * lists_directory,
+                                   const char * sources_list,
+                                   const char * sources_directory,
+                                   time_t last_refresh, time_t now) {
+    const time_t refreshed = std::max(last_refresh,
+        newest_modification_time(lists_directory));
+    if (refreshed == 0) {
+        return boost::none;
+    }
+    struct stat info;
+    time_t sources_changed = newest_modification_time(sources_directory);
+    if (::stat(sources_list, &info) == 0) {
+        sources_changed = std::max(sources_changed, info.st_mtime);
+    }
+    if (sources_changed > refreshed) {
+        return boost::none;
+    }
+    return difftime(now, refreshed);
+}
+
+bool package_lists_need_refresh(const optional<double> & age,
+                                double update_ttl, bool force) {
+    // A negative age means the clock went backwards, so don't trust it.
+    return force || update_ttl <= 0 || !age || age.get() < 0
+           || age.get() >= update_ttl;
+}
+
 AptGuest::AptGuest(bool with_sudo, const char * self_package_name,
-                   int self_update_time_out)
-: self_package_name(self_package_name),
-  self_update_time_out(self_update_time_out), with_sudo(with_sudo)
+                   int self_update_time_out, double update_ttl)
+: dpkg_status(),
+  last_update_duration(boost::none),
+  last_update_time(0),
+  apt_mutex(),
+  prefetch_mutex(),
+  prefetch_thread(),
+  self_package_name(self_package_name),
+  self_update_time_out(self_update_time_out),
+  update_ttl(update_ttl),
+  with_sudo(with_sudo)
 {
+    // Set once here rather than before each apt-get, as changing the
+    // environment while other threads spawn processes isn't safe.
+    setenv("DEBIAN_FRONTEND", "noninteractive", 1);
+}
+
+AptGuest::~AptGuest() {
+    wait_for_prefetch();
 }
 
 void AptGuest::fix(double time_out) {
+    boost::lock_guard<boost::mutex> lock(apt_mutex);
+    _fix(time_out);
+}
+
+void AptGuest::_fix(double time_out) {
     // sudo -E dpkg --configure -a
     proc::CommandList cmds;
     if (with_sudo) {
@@ -94,86 +203,55 @@ void AptGuest::fix(double time_out) {
 }
 
 
-// Returns -1 on EOF, an index of a regular expression that matched.
+// Returns boost::none on EOF, or the index of the pattern that matched.
+// Output is matched a line at a time as it arrives, each line being scanned
+// once for all the patterns.
 optional<ProcessResult> match_output(
     proc::Process<proc::StdErrAndStdOut> & process,
-    const vector<string> & patterns,
+    PatternSet & patterns,
     double seconds)
 {
-    typedef shared_ptr<Regex> RegexPtr;
-    vector<RegexPtr> regexes;
-    BOOST_FOREACH(const string & pattern, patterns) {
-        RegexPtr ptr(new Regex(pattern.c_str()));
-        regexes.push_back(ptr);
-    }
-    stringstream std_out;
-
-    Timer timer(seconds);
-    while(!process.is_finished()) {
-        size_t count = process.read_into(std_out, seconds);
-        NOVA_LOG_TRACE("******************************************************");
-        NOVA_LOG_TRACE(std_out.str().c_str());
-        NOVA_LOG_TRACE("******************************************************");
-        if (count == 0) {
-            if (!process.is_finished()) {
-                NOVA_LOG_ERROR("read should not exit until it gets data.");
-                throw AptException(AptException::GENERAL);
-            }
-        }
-        string output = std_out.str();
-        for (size_t index = 0; index < regexes.size(); index ++) {
-            RegexPtr & regex = regexes[index];;
-            RegexMatchesPtr matches = regex->match(output.c_str());
-            NOVA_LOG_TRACE("__________________________________________________");
-            NOVA_LOG_TRACE(output.c_str());
-            NOVA_LOG_TRACE("Trying to match %s against regex %s",
-                           output, patterns[index]);
-            NOVA_LOG_TRACE("__________________________________________________");
-            if (!!matches) {
-                ProcessResult result;
-                result.index = index;
-                result.matches = matches;
-                return optional<ProcessResult>(result);
-            }
-        }
-        // Nothing matches... let's try again until time_out or eof().
+    OutputMatcher matcher(patterns);
+    Deadline::Scope time_limit(process.get_deadline(), seconds);
+    if (!process.is_finished()) {
+        process.read_lines_until_exit(matcher, seconds);
     }
-    return boost::none;
+    return matcher.result;
 }
 
 /**
- *  Attempts to install a package.
- *  Returns OK if the package installs fine or a result code if a
+ *  Attempts to install the packages in a single apt-get call.
+ *  Returns OK if the packages install fine or a result code if a
  *  recoverable-error occurred.
  *  Raises an exception if a non-recoverable error or time out occurs.
  */
-OperationResult _install(bool with_sudo, const char * package_name,
+OperationResult _install(bool with_sudo, const vector<string> & package_names,
                          double time_out) {
     proc::CommandList cmds;
     if (with_sudo) {
         cmds += "/usr/bin/sudo", "-E";
     }
-    setenv("DEBIAN_FRONTEND", "noninteractive", 1);
-    cmds += "/usr/bin/apt-get", "-y", "--allow-unauthenticated", "install",
-            package_name;
+    cmds += "/usr/bin/apt-get", "-y", "--allow-unauthenticated", "install";
+    BOOST_FOREACH(const string & package_name, package_names) {
+        cmds += package_name;
+    }
     proc::Process<proc::StdErrAndStdOut> process(cmds);  // Should be ok to make wait.
 
-    vector<string> patterns;
+    PatternSet patterns;
     // 0 = permissions issue
-    patterns.push_back(".*password*");
+    patterns.add_text("password");
     // 1 - 2 = could not find package
-    patterns.push_back(str(format("E: Unable to locate package %s")
-                           % package_name));
-    patterns.push_back(str(format("Couldn't find package %s")
-                           % package_name));
+    patterns.add_regex("E: Unable to locate package (" PACKAGE_NAME_REGEX ")",
+                       "E: Unable to locate package ");
+    patterns.add_regex("Couldn't find package (" PACKAGE_NAME_REGEX ")",
+                       "Couldn't find package ");
     // 3 = need to fix
-    patterns.push_back("dpkg was interrupted, you must manually run "
-                       "'sudo dpkg --configure -a'");
+    patterns.add_text("dpkg was interrupted, you must manually run "
+                      "'sudo dpkg --configure -a'");
     // 4 = lock error
-    patterns.push_back("Unable to lock the administration directory");
-    // 5 - 6 = Success, but only if followed up by EOF.
-    patterns.push_back(str(format("Setting up %s") % package_name));
-    patterns.push_back("is already the newest version");
+    patterns.add_text("Unable to lock the administration directory");
+    // "Setting up" only says one of the packages is done, so success is
+    // judged by the exit code once all the output has been seen.
 
     optional<ProcessResult> result;
     try  {
@@ -181,40 +259,54 @@ OperationResult _install(bool with_sudo, const char * package_name,
     } catch(const TimeOutException & toe) {
         throw AptException(AptException::PROCESS_TIME_OUT);
     }
-    if (!!result) { // eof
+    if (!!result) {
         const int index = result.get().index;
         if (index == 0) {
             throw AptException(AptException::PERMISSION_ERROR);
         } else if (index == 1 || index == 2) {
-            NOVA_LOG_ERROR("Could not find package %s.", package_name);
+            NOVA_LOG_ERROR("Could not find package %s.",
+                           result.get().matches->get(1).c_str());
             throw AptException(AptException::PACKAGE_NOT_FOUND);
         } else if (index == 3) {
             return RUN_DPKG_FIRST;
-        } else if (index == 4) {
-            throw AptException(AptException::ADMIN_LOCK_ERROR);
         } else {
-            try {
-                process.wait_for_exit(time_out);
-            } catch(const TimeOutException & toe) {
-                throw AptException(AptException::PROCESS_TIME_OUT);
-            }
-            return OK;
+            throw AptException(AptException::ADMIN_LOCK_ERROR);
         }
     }
-    NOVA_LOG_ERROR("Got EOF calling apt-get install!");
-    throw AptException(AptException::GENERAL);
+    try {
+        process.wait_for_exit(time_out);
+    } catch(const TimeOutException & toe) {
+        throw AptException(AptException::PROCESS_TIME_OUT);
+    }
+    if (!process.successful()) {
+        NOVA_LOG_ERROR("apt-get install failed!");
+        throw AptException(AptException::GENERAL);
+    }
+    return OK;
+}
+
+OperationResult _install(bool with_sudo, const char * package_name,
+                         double time_out) {
+    return _install(with_sudo, vector<string>(1, package_name), time_out);
 }
 
 void AptGuest::install(const char * package_name, const double time_out) {
-    update(time_out);
-    OperationResult result = _install(with_sudo, package_name, time_out);
+    install(vector<string>(1, package_name), time_out);
+}
+
+void AptGuest::install(const vector<string> & package_names,
+                       const double time_out) {
+    wait_for_prefetch();
+    boost::lock_guard<boost::mutex> lock(apt_mutex);
+    refresh_lists(time_out, false);
+    OperationResult result = _install(with_sudo, package_names, time_out);
     if (result != OK) {
         if (result == RUN_DPKG_FIRST) {
-            fix(time_out);
+            _fix(time_out);
         }
-        result = _install(with_sudo, package_name, time_out);
+        result = _install(with_sudo, package_names, time_out);
         if (result != OK) {
-            NOVA_LOG_ERROR("Package %s is in a bad state.", package_name);
+            NOVA_LOG_ERROR("Packages are in a bad state.");
             throw AptException(AptException::PACKAGE_STATE_ERROR);
         }
     }
@@ -228,7 +320,6 @@ pid_t AptGuest::_install_new_self() {
     if (with_sudo) {
         cmds += "/usr/bin/sudo", "-E";
     }
-    setenv("DEBIAN_FRONTEND", "noninteractive", 1);
     cmds += "/usr/bin/apt-get", "-y", "--allow-unauthenticated", "install",
             self_package_name.c_str();
     try {
@@ -242,7 +333,10 @@ pid_t AptGuest::_install_new_self() {
 
 void AptGuest::install_self_update() {
     NOVA_LOG_INFO("Installing a new version of Sneaky Pete...");
-    update(self_update_time_out);
+    wait_for_prefetch();
+    boost::lock_guard<boost::mutex> lock(apt_mutex);
+    // The whole point is to see the newest package, so skip the cache.
+    refresh_lists(self_update_time_out, true);
     pid_t pid = _install_new_self();
     NOVA_LOG_INFO("Waiting for oblivion...");
     wait_for_proc_to_finish(pid, self_update_time_out);
@@ -266,27 +360,28 @@ OperationResult _call_remove(bool with_sudo, const char * package_name,
     cmds += package_name;
     proc::Process<proc::StdErrAndStdOut> process(cmds);
 
-    vector<string> patterns;
+    PatternSet patterns;
     // 0 = permissions issue
-    patterns.push_back(".*password*");
+    patterns.add_text("password");
     // 1 -2 = Package not found
-    patterns.push_back(str(format("E: Unable to locate package %s")
-                           % package_name));
-    patterns.push_back("Couldn't find package");
+    patterns.add_text(str(format("E: Unable to locate package %s")
+                          % package_name));
+    patterns.add_text("Couldn't find package");
     // 3 - 4 = Reinstall first
-    patterns.push_back("Package is in a very bad inconsistent state");
-    patterns.push_back("Sub-process /usr/bin/dpkg returned an error code");
+    patterns.add_text("Package is in a very bad inconsistent state");
+    patterns.add_text("Sub-process /usr/bin/dpkg returned an error code");
     // 5 = need to fix
-    patterns.push_back("dpkg was interrupted, you must manually run "
-                       "'sudo dpkg --configure -a'");
+    patterns.add_text("dpkg was interrupted, you must manually run "
+                      "'sudo dpkg --configure -a'");
     // 6 = lock error
-    patterns.push_back("Unable to lock the administration directory");
+    patterns.add_text("Unable to lock the administration directory");
     // 7 - 9 = Success, but the captured string must be our package followed by EOF.
-    patterns.push_back("Removing (" PACKAGE_NAME_REGEX ")");
-    patterns.push_back("Package ('" PACKAGE_NAME_REGEX "') is not installed, "
-                       "so not removed");  // Wheezy! Curse your single quotes.
-    patterns.push_back("Package (" PACKAGE_NAME_REGEX ") is not installed, "
-                       "so not removed");
+    patterns.add_regex("Removing (" PACKAGE_NAME_REGEX ")", "Removing ");
+    patterns.add_regex("Package ('" PACKAGE_NAME_REGEX "') is not installed, "
+                       "so not removed",  // Wheezy! Curse your single quotes.
+                       "is not installed, so not removed");
+    patterns.add_regex("Package (" PACKAGE_NAME_REGEX ") is not installed, "
+                       "so not removed", "is not installed, so not removed");
 
     optional<ProcessResult> result;
     try  {
@@ -337,7 +432,7 @@ void AptGuest::resilient_remove(const char * package_name,
         if (result == REINSTALL_FIRST) {
             _install(with_sudo, package_name, time_out);
         } else if (result == RUN_DPKG_FIRST) {
-            fix(time_out);
+            _fix(time_out);
         }
         result = _call_remove(with_sudo, package_name, time_out);
         if (result != OK) {
@@ -347,10 +442,12 @@ void AptGuest::resilient_remove(const char * package_name,
 }
 
 void AptGuest::remove(const char * package_name, const double time_out) {
+    wait_for_prefetch();
+    boost::lock_guard<boost::mutex> lock(apt_mutex);
     resilient_remove(package_name, time_out);
 }
 
-void AptGuest::update(const double time_out) {
+void _update(bool with_sudo, const double time_out) {
     proc::CommandList cmds;
     if (with_sudo) {
         cmds += "/usr/bin/sudo", "-E";
@@ -367,27 +464,109 @@ void AptGuest::update(const double time_out) {
     }
 }
 
+void AptGuest::update(const double time_out, bool force) {
+    wait_for_prefetch();
+    boost::lock_guard<boost::mutex> lock(apt_mutex);
+    refresh_lists(time_out, force);
+}
+
+void AptGuest::prefetch(const vector<string> & package_names,
+                        const double time_out) {
+    boost::lock_guard<boost::mutex> lock(prefetch_mutex);
+    if (prefetch_thread.joinable()
+        && !prefetch_thread.timed_join(boost::posix_time::seconds(0))) {
+        // It's only a head start, so don't hold up the caller for it.
+        NOVA_LOG_INFO("Still prefetching, skipping another prefetch.");
+        return;
+    }
+    prefetch_thread = boost::thread(&AptGuest::_prefetch, this,
+                                    package_names, time_out);
+}
+
+void AptGuest::_prefetch(const vector<string> package_names,
+                         const double time_out) {
+    proc::CommandList cmds;
+    if (with_sudo) {
+        cmds += "/usr/bin/sudo", "-E";
+    }
+    cmds += "/usr/bin/apt-get", "-y", "--allow-unauthenticated", "-d",
+            "install";
+    BOOST_FOREACH(const string & package_name, package_names) {
+        cmds += package_name;
+    }
+    boost::lock_guard<boost::mutex> lock(apt_mutex);
+    NOVA_LOG_INFO("Prefetching %d packages...", package_names.size());
+    try {
+        refresh_lists(time_out, false);
+        proc::execute(cmds, time_out);
+        NOVA_LOG_INFO("Finished prefetching packages.");
+    } catch(const std::exception & e) {
+        NOVA_LOG_ERROR("Couldn't prefetch packages, they'll be downloaded "
+                       "when installed instead: %s", e.what());
+    }
+}
+
+
+void AptGuest::refresh_lists(const double time_out, bool force) {
+    // Reading the lists' times isn't free, so only do it if even brand new
+    // lists would let the update be skipped.
+    optional<double> age;
+    if (!package_lists_need_refresh(0.0, update_ttl, force)) {
+        age = package_lists_age(APT_LISTS_DIRECTORY, APT_SOURCES_LIST,
+                                APT_SOURCES_LIST_DIRECTORY, last_update_time,
+                                time(0));
+    }
+    if (!package_lists_need_refresh(age, update_ttl, force)) {
+        if (last_update_duration) {
+            NOVA_LOG_INFO("Skipping apt-get update, the package lists are "
+                          "%.0f seconds old. Saved about %.1f seconds.",
+                          age.get(), last_update_duration.get());
+        } else {
+            NOVA_LOG_INFO("Skipping apt-get update, the package lists are "
+                          "%.0f seconds old.", age.get());
+        }
+        return;
+    }
+    const double start = nova::utils::subsecond::now();
+    _update(with_sudo, time_out);
+    last_update_duration = nova::utils::subsecond::now() - start;
+    last_update_time = time(0);
+    NOVA_LOG_INFO("apt-get update took %.1f seconds.",
+                  last_update_duration.get());
+}
+
 
 typedef boost::optional<std::string> optional_string;
 
 optional<string> AptGuest::version(const char * package_name,
                                    const double time_out) {
+    optional<string> result;
+    if (dpkg_status.version(package_name, result)) {
+        NOVA_LOG_DEBUG("Version of %s is %s.", package_name,
+                       result.get_value_or("<none>").c_str());
+        return result;
+    }
+    return version_from_dpkg_query(package_name, time_out);
+}
+
+optional<string> AptGuest::version_from_dpkg_query(const char * package_name,
+                                                   const double time_out) {
     NOVA_LOG_DEBUG("Getting version of %s", package_name);
     proc::CommandList cmds = list_of("/usr/bin/dpkg-query")("-W")(package_name);
     proc::Process<proc::StdErrAndStdOut> process(cmds);
 
-    vector<string> patterns;
+    PatternSet patterns;
     // 0 = Not found in Squeeze: looks like:
     //      No packages found matching cowsay
-    patterns.push_back("No packages found matching (" PACKAGE_NAME_REGEX
-                       ")\\.");
+    patterns.add_regex("No packages found matching (" PACKAGE_NAME_REGEX
+                       ")\\.", "No packages found matching ");
     // 1 = Not found in Wheezy: looks like:
     //      dpkg-query: no packages found matching cowsay
-    patterns.push_back("no packages found matching ("
-                        PACKAGE_NAME_REGEX ")");
+    patterns.add_regex("no packages found matching ("
+                       PACKAGE_NAME_REGEX ")", "no packages found matching ");
     // 2 = success: looks like:
     //      cowsay  0.0.1-placeholder
-    patterns.push_back("(" PACKAGE_NAME_REGEX ")\\s+(\\S*).*");
+    patterns.add_regex("(" PACKAGE_NAME_REGEX ")\\s+(\\S*).*");
     optional<ProcessResult> result;
     try  {
         result = match_output(process, patterns, time_out);
@@ -424,4 +603,18 @@ optional<string> AptGuest::version(const char * package_name,
     throw AptException(AptException::UNEXPECTED_PROCESS_OUTPUT);
 }
 
+void AptGuest::wait_for_prefetch() {
+    // Join outside of the lock so prefetch() never waits on it. A prefetch
+    // started meanwhile is harmless, as apt_mutex keeps it from running
+    // alongside the caller's apt-get.
+    boost::thread running;
+    {
+        boost::lock_guard<boost::mutex> lock(prefetch_mutex);
+        running.swap(prefetch_thread);
+    }
+    if (running.joinable()) {
+        running.join();
+    }
+}
+
 } } }  // end namespace nova::guest::apt
@@ -18,6 +18,8 @@ const char * BackupException::what() const throw() {
     switch(code) {
         case INVALID_STATE:
             return "State was invalid.";
+        case JOB_QUEUE_FULL:
+            return "Too many jobs are already waiting to run.";
         default:
             return "An error occurred.";
     }
@@ -9,7 +9,8 @@ namespace nova { namespace guest { namespace backup {
 
         public:
             enum Code {
-                INVALID_STATE
+                INVALID_STATE,
+                JOB_QUEUE_FULL
             };
 
             BackupException(const Code code) throw();
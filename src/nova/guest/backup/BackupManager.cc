@@ -98,6 +98,9 @@ public:
         time_out(time_out),
         xtrabackup_log()
     {
+        // Let xtrabackup keep writing while we compress and upload, and let
+        // each read fill as much of the zlib buffer as possible.
+        process.set_std_out_capacity(zlib_buffer_size);
         xtrabackup_log.open("/tmp/xtrabackup.log");
     }
 
@@ -253,6 +256,10 @@ public:
         return new BackupJob(*this);
     }
 
+    virtual string describe() const {
+        return str(format("backup %s") % backup_info.id);
+    }
+
 private:
     // Don't allow this, despite the copy constructor above.
     BackupJob & operator=(const BackupJob & rhs);
@@ -393,7 +400,10 @@ void BackupManager::run_backup(const string & tenant,
     BackupJob job(sender, commands, segment_max_size, checksum_wait_time,
                   swift_container, time_out, tenant, token,
                   zlib_buffer_size, backup_info);
-    runner.run(job);
+    if (!runner.run(job)) {
+        NOVA_LOG_ERROR("Couldn't queue backup %s.", backup_info.id);
+        throw BackupException(BackupException::JOB_QUEUE_FULL);
+    }
 }
 
 
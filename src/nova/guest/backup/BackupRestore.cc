@@ -7,6 +7,7 @@
 #include "nova/Log.h"
 #include "nova/process.h"
 #include <sstream>
+#include "nova/sudo.h"
 #include "nova/utils/swift.h"
 #include <vector>
 #include "nova/utils/zlib.h"
@@ -158,6 +159,9 @@ private:
                                   ("/usr/bin/xbstream")("-x")("-C")
                                   (manager.restore_directory.c_str());
         Process<StdIn, StdErrToLogFile> xbstream_proc(cmds);
+        // ZlibOutput writes up to a megabyte at a time; with the default
+        // 64K pipe each of those writes would wait on xbstream 16 times.
+        xbstream_proc.set_std_in_capacity(1024 * 1024);
 
         {
             zlib::ZlibDecompressor decompressor;
@@ -193,9 +197,11 @@ private:
 
     void ls(const string & directory, vector<string> & output) {
         stringstream stdout;
-        const CommandList cmds = list_of("/usr/bin/sudo")("-E")("/bin/ls")
-                                        (directory.c_str());
-        nova::process::execute(stdout, cmds, 60.0);
+        // This used to be "sudo -E". The only part of the agent's
+        // environment ls looks at is the locale, which can change how names
+        // sort but not the names themselves, and only the names are used.
+        const CommandList cmds = list_of("/bin/ls")(directory.c_str());
+        nova::process::sudo(stdout, cmds, 60.0);
         while(stdout.good()) {
             string item;
             stdout >> item;
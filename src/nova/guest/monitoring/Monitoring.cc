@@ -8,6 +8,7 @@
 #include "nova/guest/apt.h"
 #include "nova/utils/regex.h"
 #include "nova/process.h"
+#include "nova/sudo.h"
 #include "nova/Log.h"
 #include "status.h"
 #include <sstream>
@@ -103,8 +104,7 @@ void MonitoringManager::install_and_configure_monitoring_agent(
 
     // Move the temp monitoring config file into place and restart agent
     NOVA_LOG_INFO("Moving tmp monitoring file into place.");
-    process::execute(list_of("/usr/bin/sudo")("mv")(TMP_MON_CONF)
-        (agent_config_file.c_str()));
+    process::sudo(list_of("mv")(TMP_MON_CONF)(agent_config_file.c_str()));
 
     apt.install(agent_package_name.c_str(), agent_install_timeout);
 }
@@ -122,25 +122,22 @@ void MonitoringManager::remove_monitoring_agent(AptGuest & apt) const {
 
 void MonitoringManager::start_monitoring_agent() const {
     NOVA_LOG_INFO("Starting monitoring agent...");
-    process::execute(list_of("/usr/bin/sudo")
-                            ("/etc/init.d/rackspace-monitoring-agent")
-                            ("start"));
+    process::sudo(list_of("/etc/init.d/rackspace-monitoring-agent")
+                         ("start"));
 }
 
 void MonitoringManager::stop_monitoring_agent() const {
     NOVA_LOG_INFO("Stopping monitoring agent...");
     try{
-        process::execute(list_of("/usr/bin/sudo")
-                                ("/etc/init.d/rackspace-monitoring-agent")
-                                ("stop"));
+        process::sudo(list_of("/etc/init.d/rackspace-monitoring-agent")
+                             ("stop"));
     }
     catch (process::ProcessException &e) {
         NOVA_LOG_ERROR("Failed to stop monitoring agent: %s" , e.what());
         NOVA_LOG_ERROR("Trying to killall rackspace-monitoring-agent");
         try{
-            process::execute(list_of("/usr/bin/sudo")
-                                    ("killall")
-                                    ("rackspace-monitoring-agent"));
+            process::sudo(list_of("killall")
+                                 ("rackspace-monitoring-agent"));
         }
         catch (process::ProcessException &e) {
             NOVA_LOG_ERROR("Failed to killall monitoring agent: %s" , e.what());
@@ -154,9 +151,8 @@ void MonitoringManager::stop_monitoring_agent() const {
 
 void MonitoringManager::restart_monitoring_agent() const {
     NOVA_LOG_INFO("Restarting monitoring agent...");
-    process::execute(list_of("/usr/bin/sudo")
-                            ("/etc/init.d/rackspace-monitoring-agent")
-                            ("restart"));
+    process::sudo(list_of("/etc/init.d/rackspace-monitoring-agent")
+                         ("restart"));
 
 }
 
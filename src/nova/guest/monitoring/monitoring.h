@@ -43,6 +43,10 @@ namespace nova { namespace guest { namespace monitoring {
 
             void restart_monitoring_agent() const;
 
+            inline const std::string & get_agent_package_name() const {
+                return agent_package_name;
+            }
+
         private:
 
             const std::string guest_id;
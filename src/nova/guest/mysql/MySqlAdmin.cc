@@ -234,20 +234,13 @@ MySqlUserPtr MySqlAdmin::find_user(const std::string & username, const std::stri
     user->set_host(res->get_string(1).get());
     user->set_password(res->get_string(2).get());
 
-    // Get the list of users and their associated databases
+    // Get the databases of just this user.
     MySqlResultSetPtr userDbRes = con->query(
-                "SELECT grantee, table_schema "
-                "FROM information_schema.SCHEMA_PRIVILEGES "
-                "WHERE privilege_type != 'USAGE' "
-                "GROUP BY grantee, table_schema;");
+        list_user_databases_stmt(*con, MySqlUserList(1, user)).c_str());
     while(userDbRes->next()) {
-        string found_username = extract_user(userDbRes->get_string(0).get());
-        string found_hostname = extract_host(userDbRes->get_string(0).get());
-        if ((found_username == username) && (found_hostname == hostname)) {
-            MySqlDatabasePtr database(new MySqlDatabase());
-            database->set_name(userDbRes->get_string(1).get());
-            user->get_databases()->push_back(database);
-        }
+        MySqlDatabasePtr database(new MySqlDatabase());
+        database->set_name(userDbRes->get_string(2).get());
+        user->get_databases()->push_back(database);
     }
     userDbRes->close();
 
@@ -269,31 +262,10 @@ MySqlAdmin::list_databases(unsigned int limit, optional<string> marker,
     if (limit == 0) {
         throw MySqlGuestException(MySqlGuestException::INVALID_ZERO_LIMIT);
     }
-    stringstream query;
-    query << "   SELECT"
-        "            schema_name as name,"
-        "            default_character_set_name as charset,"
-        "            default_collation_name as collation"
-        "        FROM"
-        "            information_schema.schemata"
-        "        WHERE"
-        "            schema_name not in"
-        "            ('mysql', 'information_schema', 'lost+found')";
-    if (marker) {
-        query << "\n AND schema_name ";
-        if (include_marker) {
-            query << " >= ";
-        } else {
-            query << " > ";
-        }
-        query << "'" << con->escape_string(marker.get().c_str()) << "'";
-    }
-    query <<
-        "        ORDER BY"
-        "            schema_name ASC"
-        "        LIMIT " << limit + 1;
+    const string query = list_databases_stmt(*con, limit, marker,
+                                             include_marker);
 
-    MySqlResultSetPtr res = con->query(query.str().c_str());
+    MySqlResultSetPtr res = con->query(query.c_str());
 
     MySqlDatabaseListPtr databases(new MySqlDatabaseList());
     MySqlDatabasePtr database;
@@ -325,23 +297,9 @@ MySqlAdmin::list_users(unsigned int limit, optional<string> marker,
     }
     UserMap user_map;
     // Get the list of users
-    stringstream query;
-    query << "SELECT User, Host, Marker FROM"
-             " (SELECT User, Host, CONCAT(User, '@', Host) as Marker"
-             " FROM mysql.user) as innerquery"
-             " WHERE host != 'localhost'";
-    if (marker) {
-        query << " AND Marker ";
-        if (include_marker) {
-            query << " >= ";
-        } else {
-            query << " > ";
-        }
-        query << "'" << con->escape_string(marker.get().c_str()) << "'";
-    }
-    query << " ORDER BY Marker ASC LIMIT " << limit + 1;
+    const string query = list_users_stmt(*con, limit, marker, include_marker);
 
-    MySqlResultSetPtr res = con->query(query.str().c_str());
+    MySqlResultSetPtr res = con->query(query.c_str());
     MySqlUserListPtr users(new MySqlUserList());
     MySqlUserPtr user;
     optional<string> next_marker(boost::none);
@@ -362,19 +320,20 @@ MySqlAdmin::list_users(unsigned int limit, optional<string> marker,
     }
     res->close();
 
-    // Get the list of users and their associated databases
+    if (users->empty()) {
+        return boost::make_tuple(users, next_marker);
+    }
+
+    // Get the databases of just the users on this page.
     MySqlResultSetPtr userDbRes = con->query(
-                "SELECT grantee, table_schema from information_schema.SCHEMA_PRIVILEGES "
-                "WHERE privilege_type != 'USAGE' "
-                "GROUP BY grantee, table_schema;");
+        list_user_databases_stmt(*con, *users).c_str());
     while(userDbRes->next()) {
-        string username = extract_user(userDbRes->get_string(0).get());
-        string hostname = extract_host(userDbRes->get_string(0).get());
-        string mapkey = username + "@" + hostname;
+        string mapkey = userDbRes->get_string(0).get() + "@"
+                        + userDbRes->get_string(1).get();
         if (user_map.find(mapkey) != user_map.end()) {
             MySqlUserPtr & user = user_map[mapkey];
             MySqlDatabasePtr database(new MySqlDatabase());
-            database->set_name(userDbRes->get_string(1).get());
+            database->set_name(userDbRes->get_string(2).get());
             user->get_databases()->push_back(database);
         }
     }
@@ -14,7 +14,9 @@
 #include "nova/guest/mysql/MySqlGuestException.h"
 #include <boost/optional.hpp>
 #include "nova/process.h"
+#include "nova/sudo.h"
 #include <sstream>
+#include "nova/utils/subsecond.h"
 #include "nova/guest/utils.h"
 
 using nova::guest::apt::AptGuest;
@@ -62,10 +64,10 @@ namespace {
         // UPDATE: Nope, turns out this is only on my box. Sometimes it
         //         returns something else.
         stringstream output;
-        process::CommandList cmds = list_of("/usr/bin/sudo")
-            ("update-rc.d")("mysql")(enabled ? "enable" : "disable");
+        process::CommandList cmds = list_of("update-rc.d")("mysql")
+            (enabled ? "enable" : "disable");
         try {
-            process::execute(output, cmds);
+            process::sudo(output, cmds);
         } catch(const process::ProcessException & pe) {
             NOVA_LOG_ERROR("Exception running process!");
             NOVA_LOG_ERROR(pe.what());
@@ -149,11 +151,9 @@ void MySqlApp::write_config_overrides(const string & overrides_content) {
     }
     NOVA_LOG_INFO("Moving tmp overrides to final location (%s -> %s).",
                   MYCNF_OVERRIDES_TMP, MYCNF_OVERRIDES);
-    process::execute(list_of("/usr/bin/sudo")
-                     ("mv")(MYCNF_OVERRIDES_TMP)(MYCNF_OVERRIDES));
+    process::sudo(list_of("mv")(MYCNF_OVERRIDES_TMP)(MYCNF_OVERRIDES));
     NOVA_LOG_INFO("Setting permissions on %s.", MYCNF_OVERRIDES);
-    process::execute(list_of("/usr/bin/sudo")
-                     ("chmod")("0711")(MYCNF_OVERRIDES));
+    process::sudo(list_of("chmod")("0711")(MYCNF_OVERRIDES));
 }
 
 void MySqlApp::write_mycnf(AptGuest & apt,
@@ -181,14 +181,13 @@ void MySqlApp::write_mycnf(AptGuest & apt,
                                         admin_password.c_str());
 
     NOVA_LOG_INFO("Copying tmp file so we can log in (permissions work-around).");
-    process::execute(list_of("/usr/bin/sudo")("cp")(TMP_MYCNF)(HACKY_MYCNF));
+    process::sudo(list_of("cp")(TMP_MYCNF)(HACKY_MYCNF));
     NOVA_LOG_INFO("Moving tmp into final.");
-    process::execute(list_of("/usr/bin/sudo")("mv")(TMP_MYCNF)(FINAL_MYCNF));
+    process::sudo(list_of("mv")(TMP_MYCNF)(FINAL_MYCNF));
     NOVA_LOG_INFO("Removing original my.cnf.");
-    process::execute(list_of("/usr/bin/sudo")("rm")("-f")(ORIG_MYCNF));
+    process::sudo(list_of("rm")("-f")(ORIG_MYCNF));
     NOVA_LOG_INFO("Symlinking final my.cnf.");
-    process::execute(list_of("/usr/bin/sudo")("ln")("-s")(FINAL_MYCNF)
-                            (ORIG_MYCNF));
+    process::sudo(list_of("ln")("-s")(FINAL_MYCNF)(ORIG_MYCNF));
     wipe_ib_logfiles();
 
     if (overrides) {
@@ -266,9 +265,8 @@ void MySqlApp::prepare(AptGuest & apt,
 
 string fetch_debian_sys_maint_password() {
     // Have to copy the debian file to tmp and chown it just to read it. LOL!
-    process::execute(list_of("/usr/bin/sudo")("cp")(TRUE_DEBIAN_CNF)
-                            (TMP_DEBIAN_CNF));
-    process::execute(list_of("/usr/bin/sudo")("/bin/chown")("nova")(TMP_DEBIAN_CNF));
+    process::sudo(list_of("cp")(TRUE_DEBIAN_CNF)(TMP_DEBIAN_CNF));
+    process::sudo(list_of("/bin/chown")("nova")(TMP_DEBIAN_CNF));
     string user, password;
     MySqlConnection::get_auth_from_config(TMP_DEBIAN_CNF, user, password);
     if (user != "debian-sys-maint") {
@@ -318,10 +316,7 @@ void MySqlApp::write_fresh_init_file(const string & admin_password,
 
 void MySqlApp::install_mysql(AptGuest & apt, const vector<string> & packages) {
     NOVA_LOG_INFO("Installing mysql server.");
-    BOOST_FOREACH(const string & package, packages) {
-        NOVA_LOG_INFO("Installing package %s...", package);
-        apt.install(package.c_str(), TIME_OUT);
-    }
+    apt.install(packages, TIME_OUT);
 }
 
 void MySqlApp::internal_stop_mysql(bool update_db) {
@@ -339,8 +334,7 @@ void MySqlApp::remove_anonymous_user(MySqlAdmin & db) {
 void MySqlApp::remove_overrides() {
     if (is_file(MYCNF_OVERRIDES)) {
         NOVA_LOG_DEBUG("Removing overrides cnf file %s.", MYCNF_OVERRIDES);
-        process::execute(list_of("/usr/bin/sudo")
-                         ("-f")("rm")(MYCNF_OVERRIDES));
+        process::sudo(list_of("rm")("-f")(MYCNF_OVERRIDES));
     } else {
         NOVA_LOG_DEBUG("Overrides cnf file %s not found.", MYCNF_OVERRIDES);
     }
@@ -367,9 +361,15 @@ void MySqlApp::restart() {
             status->end_install_or_restart();
         }
     } restarter(status);
+    const double start = subsecond::now();
     internal_stop_mysql();
+    const double stopped = subsecond::now();
     enable_starting_mysql_on_boot();
     start_mysql();
+    const double finished = subsecond::now();
+    NOVA_LOG_INFO("Restarted MySQL in %.2f seconds (%.2f to stop, %.2f to "
+                  "start).", finished - start, stopped - start,
+                  finished - stopped);
 }
 
 void MySqlApp::restart_mysql_and_wipe_ib_logfiles() {
@@ -406,9 +406,8 @@ void MySqlApp::run_mysqld_with_init() {
     }
     NOVA_LOG_INFO("Killing mysqld_safe...");
     string pid_str = str(format("%d") % mysqld_safe.get_pid());
-    process::CommandList kill_cmd = list_of("/usr/bin/sudo")("/bin/kill")
-                                           (pid_str.c_str());
-    process::execute(kill_cmd);
+    process::CommandList kill_cmd = list_of("/bin/kill")(pid_str.c_str());
+    process::sudo(kill_cmd);
     NOVA_LOG_INFO("Waiting for process to die...");
     mysqld_safe.wait_for_exit(60);
 
@@ -497,14 +496,7 @@ void MySqlApp::wait_for_internal_stop(bool update_db) {
 void MySqlApp::wipe_ib_logfile(const int index) {
     const char * const MYSQL_BASE_DIR = "/var/lib/mysql";
     string logfile = str(format("%s/ib_logfile%d") % MYSQL_BASE_DIR % index);
-    process::CommandList cmds = list_of("/usr/bin/sudo")("/bin/ls")
-                                       (logfile.c_str());
-    process::Process<process::StdErrAndStdOut> proc(cmds);
-    proc.wait_for_exit(60);
-    if (proc.successful()) {
-        process::execute_with_stdout_and_stderr(
-            list_of("/usr/bin/sudo")("rm")(logfile.c_str()));
-    }
+    process::sudo(list_of("rm")("-f")(logfile.c_str()), 60);
 }
 
 void MySqlApp::wipe_ib_logfiles() {
@@ -10,17 +10,22 @@
 #include "nova/guest/mysql/MySqlGuestException.h"
 #include <boost/optional.hpp>
 #include "nova/process.h"
+#include "nova/sudo.h"
 #include "nova/rpc/sender.h"
 #include "nova/utils/regex.h"
 #include <boost/thread.hpp>
 #include "nova/guest/utils.h"
 #include <string>
 #include "nova/utils/subsecond.h"
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace boost::assign; // brings CommandList += into our code.
 using nova::datastores::DatastoreStatus;
 using boost::format;
 using nova::json_obj;
+using nova::db::mysql::MySqlConnection;
 using nova::db::mysql::MySqlConnectionWithDefaultDb;
 using nova::db::mysql::MySqlConnectionWithDefaultDbPtr;
 using nova::db::mysql::MySqlException;
@@ -41,9 +46,23 @@ namespace utils = nova::guest::utils;
 
 namespace nova { namespace guest { namespace mysql {
 
+namespace {
+
+    // A healthy server answers in well under a second; anything slower is
+    // as good as blocked.
+    const unsigned int PING_TIME_OUT = 5;
+
+}
+
 MySqlAppStatus::MySqlAppStatus(ResilientSenderPtr sender,
-                               bool is_mysql_installed)
-:   DatastoreStatus(sender, is_mysql_installed) {
+                               bool is_mysql_installed,
+                               double heartbeat_interval)
+:   DatastoreStatus(sender, is_mysql_installed, heartbeat_interval),
+    connection(),
+    my_cnf_path("/etc/mysql/my.cnf"),
+    my_cnf_stamp(boost::none),
+    cached_pid_file(boost::none),
+    probe_mutex() {
 }
 
 
@@ -55,52 +74,95 @@ DatastoreStatus::Status MySqlAppStatus::determine_actual_status() const {
     // BLOCKED = We can't ping it, but we can see the process running.
     // CRASHED = The process is dead, but left evidence it once existed.
     // SHUTDOWN = The process is dead and never existed or cleaned itself up.
-    std::stringstream out;
-    try {
-        execute(out, list_of("/usr/bin/sudo")("/usr/bin/mysqladmin")("ping"));
+    if (ping_mysql()) {
         return RUNNING;
-    } catch(const process::ProcessException & pe) {
-        if (pe.code != process::ProcessException::EXIT_CODE_NOT_ZERO) {
-            throw pe;
-        }
-        try {
-            execute(out, list_of("/usr/bin/sudo")("/bin/ps")("-C")
-                                 ("mysqld")("h"));
-            // TODO(rnirmal): Need to create new statuses for instances where
-            // the mysql service is up, but unresponsive
-            return BLOCKED;
-        } catch(const process::ProcessException & pe) {
-            if (pe.code != process::ProcessException::EXIT_CODE_NOT_ZERO) {
-                throw pe;
-            }
-            // Figure out what the PID file would be if we started.
-            // If it exists, then MySQL crashed.
-            optional<string> pid_file = find_mysql_pid_file();
-            if (!!pid_file && is_file(pid_file.get().c_str())) {
-                return CRASHED;
-            } else {
-                return SHUTDOWN;
-            }
-        }
+    }
+    if (is_mysqld_running()) {
+        // TODO(rnirmal): Need to create new statuses for instances where
+        // the mysql service is up, but unresponsive
+        return BLOCKED;
+    }
+    // Figure out what the PID file would be if we started.
+    // If it exists, then MySQL crashed.
+    optional<string> pid_file = find_mysql_pid_file();
+    if (!!pid_file && is_file(pid_file.get().c_str())) {
+        return CRASHED;
+    } else {
+        return SHUTDOWN;
     }
 }
 
 // These are the normal production methods.
 // By defining these the tests can mock out the dependencies.
+// Commands run as root.
 void MySqlAppStatus::execute(stringstream & out,
                                     const process::CommandList & cmds) const {
-    process::execute(out, cmds);
+    process::sudo(out, cmds);
 }
 
 bool MySqlAppStatus::is_file(const char * file_path) const {
     return io::is_file(file_path);
 }
 
+bool MySqlAppStatus::is_mysqld_running() const {
+    return !!process::find_process_by_name("mysqld");
+}
+
+bool MySqlAppStatus::ping_mysql() const {
+    {
+        boost::lock_guard<boost::mutex> lock(probe_mutex);
+        if (!connection) {
+            connection.reset(new MySqlConnection("localhost"));
+            connection->set_timeout(PING_TIME_OUT);
+        }
+        try {
+            return connection->ping();
+        } catch(const MySqlException & mse) {
+            if (mse.code != MySqlException::MY_CNF_FILE_NOT_FOUND) {
+                throw;
+            }
+        }
+    }
+    // Until prepare writes the os_admin credentials all we can do is ask
+    // mysqladmin, which runs as root and so uses root's defaults.
+    stringstream out;
+    try {
+        execute(out, list_of("/usr/bin/mysqladmin")("ping"));
+        return true;
+    } catch(const process::ProcessException & pe) {
+        if (pe.code != process::ProcessException::EXIT_CODE_NOT_ZERO) {
+            throw;
+        }
+        return false;
+    }
+}
+
+optional<MySqlAppStatus::FileStamp> MySqlAppStatus::stamp_my_cnf() const {
+    struct stat info;
+    if (::stat(my_cnf_path.c_str(), &info) != 0) {
+        return boost::none;
+    }
+    FileStamp stamp;
+    stamp.inode = info.st_ino;
+    stamp.modified = info.st_mtim.tv_sec;
+    stamp.modified_nsec = info.st_mtim.tv_nsec;
+    stamp.size = info.st_size;
+    return stamp;
+}
+
 optional<string> MySqlAppStatus::find_mysql_pid_file() const {
+    // The config is rewritten by moving a new file into place, so the stamp
+    // changes whenever the pid file could have.
+    const optional<FileStamp> stamp = stamp_my_cnf();
+    {
+        boost::lock_guard<boost::mutex> lock(probe_mutex);
+        if (!!stamp && !!my_cnf_stamp && stamp.get() == my_cnf_stamp.get()) {
+            return cached_pid_file;
+        }
+    }
     stringstream out;
     try {
-        execute(out, list_of("/usr/bin/sudo")("/usr/sbin/mysqld")
-                            ("--print-defaults"));
+        execute(out, list_of("/usr/sbin/mysqld")("--print-defaults"));
     } catch(const process::ProcessException & pe) {
         NOVA_LOG_ERROR("Error running mysqld --print-defaults! %s", pe.what());
         return boost::none;
@@ -114,7 +176,65 @@ optional<string> MySqlAppStatus::find_mysql_pid_file() const {
         return boost::none;
     }
     optional<string> rtn(matches->get(1));
+    {
+        boost::lock_guard<boost::mutex> lock(probe_mutex);
+        cached_pid_file = rtn;
+        my_cnf_stamp = stamp;
+    }
     return rtn;
 }
 
+
+bool MySqlAppStatus::wait_for_status_change(double seconds) const {
+    // Anything which happens between the last status check and the watches
+    // being added is missed, but then the caller's poll catches it.
+    struct Watches {
+        int fds[2];
+        size_t count;
+
+        Watches() : count(0) {
+        }
+
+        ~Watches() {
+            for (size_t index = 0; index < count; ++ index) {
+                ::close(fds[index]);
+            }
+        }
+    } watches;
+
+    const optional<string> pid_file = find_mysql_pid_file();
+    if (!!pid_file) {
+        const int inotify_fd = ::inotify_init1(IN_CLOEXEC);
+        if (inotify_fd >= 0) {
+            watches.fds[watches.count ++] = inotify_fd;
+            const string directory = pid_file.get().substr(
+                0, pid_file.get().find_last_of('/'));
+            if (::inotify_add_watch(inotify_fd, directory.c_str(),
+                                    IN_CREATE | IN_DELETE | IN_MOVED_FROM
+                                    | IN_MOVED_TO | IN_CLOSE_WRITE) < 0) {
+                ::close(inotify_fd);
+                watches.count -= 1;
+            }
+        }
+    }
+    const optional<pid_t> pid = process::find_process_by_name("mysqld");
+    if (!!pid) {
+        const int pid_fd = io::open_pid_fd(pid.get());
+        if (pid_fd >= 0) {
+            watches.fds[watches.count ++] = pid_fd;
+        }
+    }
+    // With nothing to watch this is a plain sleep.
+    return !!io::wait_for_readable(watches.fds, watches.count, seconds);
+}
+
+/**---------------------------------------------------------------------------
+ *- MySqlAppStatus::FileStamp
+ *---------------------------------------------------------------------------*/
+
+bool MySqlAppStatus::FileStamp::operator==(const FileStamp & rhs) const {
+    return inode == rhs.inode && modified == rhs.modified
+        && modified_nsec == rhs.modified_nsec && size == rhs.size;
+}
+
 } } } // end nova::guest::mysql
@@ -11,6 +11,7 @@
 #include <sstream>
 #include <string>
 #include "nova/utils/subsecond.h"
+#include <sys/types.h>
 
 
 namespace nova { namespace guest { namespace mysql {
@@ -18,19 +19,60 @@ namespace nova { namespace guest { namespace mysql {
     class MySqlAppStatus : public nova::datastores::DatastoreStatus {
         public:
             MySqlAppStatus(nova::rpc::ResilientSenderPtr sender,
-                           bool is_mysql_installed);
+                           bool is_mysql_installed,
+                           double heartbeat_interval=0);
 
             virtual ~MySqlAppStatus();
 
         protected:
+            /* Checks the status in process: the server is pinged over a
+             * connection kept open between calls, and /proc is scanned for
+             * mysqld. Nothing is spawned unless my.cnf has changed since the
+             * pid file was last looked up, or the os_admin credentials
+             * haven't been written yet. */
             virtual Status determine_actual_status() const;
 
             virtual void execute(std::stringstream & out,
                                  const std::list<std::string> & cmds) const;
 
+            /* Returns the pid file mysqld would use, remembering the answer
+             * until my.cnf changes. */
             boost::optional<std::string> find_mysql_pid_file() const;
 
             virtual bool is_file(const char * file_path) const;
+
+            /* True if a process named mysqld is running. */
+            virtual bool is_mysqld_running() const;
+
+            /* True if the server answers a ping. */
+            virtual bool ping_mysql() const;
+
+            /* Wakes up when anything is created or removed next to the pid
+             * file (mysqld's socket usually lives there too) or the running
+             * mysqld exits. */
+            virtual bool wait_for_status_change(double seconds) const;
+
+        private:
+            struct FileStamp {
+                ino_t inode;
+                time_t modified;
+                long modified_nsec;
+                off_t size;
+
+                bool operator==(const FileStamp & rhs) const;
+            };
+
+            mutable nova::db::mysql::MySqlConnectionPtr connection;
+
+            std::string my_cnf_path;
+
+            mutable boost::optional<FileStamp> my_cnf_stamp;
+
+            mutable boost::optional<std::string> cached_pid_file;
+
+            mutable boost::mutex probe_mutex;
+
+            boost::optional<FileStamp> stamp_my_cnf() const;
     };
 
     typedef boost::shared_ptr<MySqlAppStatus> MySqlAppStatusPtr;
@@ -399,6 +399,9 @@ namespace {
     };
 
 
+    // Matches the time out MySqlApp gives apt-get install.
+    const double PREFETCH_TIME_OUT = 500;
+
     // Grabs the packages argument from a JSON object.
     vector<string> get_packages_argument(JsonObjectPtr obj) {
         try {
@@ -413,7 +416,8 @@ namespace {
     }
 }
 
-MySqlMessageHandler::MySqlMessageHandler()
+MySqlMessageHandler::MySqlMessageHandler(MySqlConnectionPoolPtr pool)
+:   pool(pool)
 {
     const MethodEntry static_method_entries [] = {
         REGISTER(apply_overrides),
@@ -455,10 +459,10 @@ JsonDataPtr MySqlMessageHandler::handle_message(const GuestInput & input) {
 }
 
 
-MySqlAdminPtr MySqlMessageHandler::sql_admin() {
-    // Creates a connection from local host with values coming from my.cnf.
-    MySqlConnectionPtr connection(new MySqlConnection("localhost"));
-    MySqlAdminPtr ptr(new MySqlAdmin(connection));
+MySqlAdminPtr MySqlMessageHandler::sql_admin() const {
+    // Borrows a connection to local host with values coming from my.cnf,
+    // which goes back to the pool once the MySqlAdmin is done with it.
+    MySqlAdminPtr ptr(new MySqlAdmin(pool->borrow()));
     return ptr;
 }
 
@@ -472,11 +476,15 @@ MySqlAppMessageHandler::MySqlAppMessageHandler(
     MySqlAppPtr mysqlApp,
     nova::guest::apt::AptGuestPtr apt,
     nova::guest::monitoring::MonitoringManagerPtr monitoring,
-    VolumeManagerPtr volumeManager)
+    VolumeManagerPtr volumeManager,
+    MySqlConnectionPoolPtr pool,
+    bool prefetch_packages)
 :   apt(apt),
     monitoring(monitoring),
     mysqlApp(mysqlApp),
-    volumeManager(volumeManager)
+    volumeManager(volumeManager),
+    pool(pool),
+    prefetch_packages(prefetch_packages)
 {
 }
 
@@ -491,6 +499,17 @@ JsonDataPtr MySqlAppMessageHandler::handle_message(const GuestInput & input) {
         const auto packages = get_packages_argument(input.args);
         const auto config_contents = input.args->get_string("config_contents");
         const auto overrides = input.args->get_optional_string("overrides");
+        const auto monitoring_info =
+            input.args->get_optional_object("monitoring_info");
+        if (prefetch_packages) {
+            // Download everything prepare installs while the volume is
+            // formatted and mounted.
+            vector<string> prefetch_list(packages);
+            if (monitoring_info) {
+                prefetch_list.push_back(monitoring->get_agent_package_name());
+            }
+            apt->prefetch(prefetch_list, PREFETCH_TIME_OUT);
+        }
         // Mount volume
         if (volumeManager) {
             const auto device_path = input.args->get_optional_string("device_path");
@@ -524,12 +543,11 @@ JsonDataPtr MySqlAppMessageHandler::handle_message(const GuestInput & input) {
         // The argument signature is the same as create_database so just
         // forward the method.
         NOVA_LOG_INFO("Creating initial databases and users following successful prepare");
-        _create_database(MySqlMessageHandler::sql_admin(), input.args);
-        _create_user(MySqlMessageHandler::sql_admin(), input.args);
+        MySqlAdminPtr sql(new MySqlAdmin(pool->borrow()));
+        _create_database(sql, input.args);
+        _create_user(sql, input.args);
 
         // installation of monitoring
-        const auto monitoring_info =
-            input.args->get_optional_object("monitoring_info");
         if (monitoring_info) {
             NOVA_LOG_INFO("Installing Monitoring Agent following successful prepare");
             const auto token = monitoring_info->get_string("token");
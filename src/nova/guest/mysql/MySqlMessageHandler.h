@@ -18,7 +18,8 @@ namespace nova { namespace guest { namespace mysql {
     class MySqlMessageHandler : public MessageHandler {
 
         public:
-            MySqlMessageHandler();
+            /* The pool must be destroyed before the MySqlApiScope is. */
+            MySqlMessageHandler(nova::db::mysql::MySqlConnectionPoolPtr pool);
 
             virtual JsonDataPtr handle_message(const GuestInput & input);
 
@@ -29,13 +30,14 @@ namespace nova { namespace guest { namespace mysql {
 
             nova::guest::apt::AptGuest & apt_guest() const;
 
-            static MySqlAdminPtr sql_admin();
+            MySqlAdminPtr sql_admin() const;
 
         private:
             MySqlMessageHandler(const MySqlMessageHandler & other);
             MySqlMessageHandler & operator = (const MySqlMessageHandler &);
 
             MethodMap methods;
+            nova::db::mysql::MySqlConnectionPoolPtr pool;
     };
 
     class MySqlAppMessageHandler : public MessageHandler {
@@ -45,7 +47,9 @@ namespace nova { namespace guest { namespace mysql {
                 MySqlAppPtr mysqlApp,
                 nova::guest::apt::AptGuestPtr apt,
                 nova::guest::monitoring::MonitoringManagerPtr monitoring,
-                VolumeManagerPtr volumeManager);
+                VolumeManagerPtr volumeManager,
+                nova::db::mysql::MySqlConnectionPoolPtr pool,
+                bool prefetch_packages=false);
 
             virtual ~MySqlAppMessageHandler();
 
@@ -60,6 +64,8 @@ namespace nova { namespace guest { namespace mysql {
             nova::guest::monitoring::MonitoringManagerPtr monitoring;
             MySqlAppPtr mysqlApp;
             VolumeManagerPtr volumeManager;
+            nova::db::mysql::MySqlConnectionPoolPtr pool;
+            bool prefetch_packages;
     };
 
 } } }
@@ -59,6 +59,81 @@ std::string create_global_stmt(
 }
 
 
+/* Appends " > 'marker'", or " >= 'marker'" if "include_marker" is true. */
+template<typename Connection>
+void append_after_marker(Connection & con, std::stringstream & query,
+                         const std::string & marker, bool include_marker) {
+    query << (include_marker ? " >= '" : " > '")
+          << con.escape_string(marker.c_str()) << "'";
+}
+
+/* Selects a page of databases after "marker", fetching one more than
+ * "limit" to tell if there's another page. */
+template<typename Connection>
+std::string list_databases_stmt(Connection & con, unsigned int limit,
+                                const boost::optional<std::string> & marker,
+                                bool include_marker) {
+    std::stringstream query;
+    query << "SELECT schema_name, default_character_set_name,"
+             " default_collation_name FROM information_schema.schemata"
+             " WHERE schema_name NOT IN"
+             " ('mysql', 'information_schema', 'lost+found')";
+    if (marker) {
+        query << " AND schema_name";
+        append_after_marker(con, query, marker.get(), include_marker);
+    }
+    query << " ORDER BY schema_name ASC LIMIT " << limit + 1;
+    return query.str();
+}
+
+/* Selects a page of users after "marker" in the order of mysql.user's
+ * primary key, (Host, User), so MySQL can start reading at the marker
+ * instead of computing and sorting a key for every user. Markers look
+ * like "user@host"; as user names may contain "@" the host is whatever
+ * follows the last one. */
+template<typename Connection>
+std::string list_users_stmt(Connection & con, unsigned int limit,
+                            const boost::optional<std::string> & marker,
+                            bool include_marker) {
+    std::stringstream query;
+    query << "SELECT User, Host FROM mysql.user WHERE Host != 'localhost'";
+    if (marker) {
+        const std::string & value = marker.get();
+        const size_t at = value.find_last_of('@');
+        const std::string user = value.substr(0, at);
+        const std::string host = at == std::string::npos ? ""
+                                                         : value.substr(at + 1);
+        const std::string escaped_host = con.escape_string(host.c_str());
+        query << " AND Host >= '" << escaped_host << "'"
+                 " AND (Host > '" << escaped_host << "' OR User";
+        append_after_marker(con, query, user, include_marker);
+        query << ")";
+    }
+    query << " ORDER BY Host ASC, User ASC LIMIT " << limit + 1;
+    return query.str();
+}
+
+/* Selects the databases each of the given users has privileges on. Reads
+ * mysql.db by its primary key rather than scanning every row of
+ * information_schema.SCHEMA_PRIVILEGES. */
+template<typename Connection>
+std::string list_user_databases_stmt(Connection & con,
+                                     const MySqlUserList & users) {
+    std::stringstream query;
+    query << "SELECT User, Host, Db FROM mysql.db WHERE";
+    bool first = true;
+    BOOST_FOREACH(const MySqlUserPtr & user, users) {
+        query << (first ? " " : " OR ")
+              << "(Host = '" << con.escape_string(user->get_host().c_str())
+              << "' AND User = '" << con.escape_string(user->get_name().c_str())
+              << "')";
+        first = false;
+    }
+    query << " ORDER BY Db ASC";
+    return query.str();
+}
+
+
 } } }  // end namespace
 
 #endif // __NOVA_GUEST_MYSQL_MYSQLSTATEMENTS_H
@@ -1,6 +1,9 @@
 #include "pch.hpp"
 #include "nova/json.h"
+#include <boost/enable_shared_from_this.hpp>
 #include <json/json.h>
+#include <stdio.h>
+#include <string.h>
 using boost::lexical_cast;
 using boost::optional;
 using std::string;
@@ -93,6 +96,204 @@ namespace {
         return json_object_get_string(string_obj);
     }
 
+    inline bool is_json_whitespace(const char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    inline void throw_malformed() {
+        throw JsonException(JsonException::CTOR_ARGUMENT_IS_NOT_JSON_STRING);
+    }
+
+    /* Walks raw JSON text without building json_objects. Used to pull single
+     * values out of envelopes whose other contents we don't care about. */
+    class TopLevelScanner {
+    public:
+        TopLevelScanner(const char * text, size_t length)
+        :   pos(text), end(text + length) {
+        }
+
+        inline bool at_end() const {
+            return pos >= end;
+        }
+
+        inline void expect(const char c) {
+            if (next() != c) {
+                throw_malformed();
+            }
+        }
+
+        inline char next() {
+            if (at_end()) {
+                throw_malformed();
+            }
+            return *(pos ++);
+        }
+
+        inline char peek() {
+            if (at_end()) {
+                throw_malformed();
+            }
+            return *pos;
+        }
+
+        /* Reads the rest of a string whose opening quote was consumed,
+         * unescaping it into "out" (replacing what was there) unless "out"
+         * is null. */
+        void read_string(string * out) {
+            const char * const close = find_closing_quote();
+            if (out) {
+                // Unescaping never makes a string longer, so size "out" to
+                // the escaped text and write straight into it.
+                out->resize(close - pos);
+                char * const begin = &(*out)[0];
+                char * write = begin;
+                while (pos < close) {
+                    const char * slash = (const char *)
+                        memchr(pos, '\\', close - pos);
+                    const char * run_end = slash ? slash : close;
+                    memcpy(write, pos, run_end - pos);
+                    write += run_end - pos;
+                    pos = run_end;
+                    if (pos < close) {
+                        ++ pos;
+                        write = unescape(write);
+                    }
+                }
+                out->resize(write - begin);
+            }
+            pos = close + 1;
+        }
+
+        /* Skips over a value of any type, including nested ones. */
+        void skip_value() {
+            const char c = next();
+            if (c == '"') {
+                read_string(0);
+            } else if (c == '{' || c == '[') {
+                int depth = 1;
+                while (depth > 0) {
+                    const char n = next();
+                    if (n == '"') {
+                        read_string(0);
+                    } else if (n == '{' || n == '[') {
+                        ++ depth;
+                    } else if (n == '}' || n == ']') {
+                        -- depth;
+                    }
+                }
+            } else {
+                // A number, true, false or null.
+                while (pos < end && *pos != ',' && *pos != '}'
+                       && *pos != ']' && !is_json_whitespace(*pos)) {
+                    ++ pos;
+                }
+            }
+        }
+
+        inline void skip_whitespace() {
+            while (pos < end && is_json_whitespace(*pos)) {
+                ++ pos;
+            }
+        }
+
+    private:
+        const char * pos;
+        const char * end;
+
+        /* Finds the quote ending the string that starts at pos. */
+        const char * find_closing_quote() const {
+            const char * search = pos;
+            while (true) {
+                const char * quote = (const char *)
+                    memchr(search, '"', end - search);
+                if (!quote) {
+                    throw_malformed();
+                }
+                // The quote is escaped if an odd number of slashes precede it.
+                const char * slashes = quote;
+                while (slashes > pos && *(slashes - 1) == '\\') {
+                    -- slashes;
+                }
+                if ((quote - slashes) % 2 == 0) {
+                    return quote;
+                }
+                search = quote + 1;
+            }
+        }
+
+        unsigned int read_hex4() {
+            unsigned int code = 0;
+            for (int i = 0; i < 4; ++ i) {
+                const char h = next();
+                code <<= 4;
+                if (h >= '0' && h <= '9') {
+                    code |= h - '0';
+                } else if (h >= 'a' && h <= 'f') {
+                    code |= h - 'a' + 10;
+                } else if (h >= 'A' && h <= 'F') {
+                    code |= h - 'A' + 10;
+                } else {
+                    throw_malformed();
+                }
+            }
+            return code;
+        }
+
+        unsigned int read_unicode_escape() {
+            unsigned int code = read_hex4();
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                // A high surrogate must be followed by a low one.
+                expect('\\');
+                expect('u');
+                const unsigned int low = read_hex4();
+                if (low < 0xDC00 || low > 0xDFFF) {
+                    throw_malformed();
+                }
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            }
+            return code;
+        }
+
+        /* Decodes the escape sequence following a slash to "write" and
+         * returns the position after what was written. */
+        char * unescape(char * write) {
+            switch(next()) {
+                case '"': *write = '"'; break;
+                case '\\': *write = '\\'; break;
+                case '/': *write = '/'; break;
+                case 'b': *write = '\b'; break;
+                case 'f': *write = '\f'; break;
+                case 'n': *write = '\n'; break;
+                case 'r': *write = '\r'; break;
+                case 't': *write = '\t'; break;
+                case 'u':
+                    return write_utf8(read_unicode_escape(), write);
+                default:
+                    throw_malformed();
+            }
+            return write + 1;
+        }
+
+        static char * write_utf8(const unsigned int code, char * write) {
+            if (code < 0x80) {
+                *(write ++) = (char) code;
+            } else if (code < 0x800) {
+                *(write ++) = (char) (0xC0 | (code >> 6));
+                *(write ++) = (char) (0x80 | (code & 0x3F));
+            } else if (code < 0x10000) {
+                *(write ++) = (char) (0xE0 | (code >> 12));
+                *(write ++) = (char) (0x80 | ((code >> 6) & 0x3F));
+                *(write ++) = (char) (0x80 | (code & 0x3F));
+            } else {
+                *(write ++) = (char) (0xF0 | (code >> 18));
+                *(write ++) = (char) (0x80 | ((code >> 12) & 0x3F));
+                *(write ++) = (char) (0x80 | ((code >> 6) & 0x3F));
+                *(write ++) = (char) (0x80 | (code & 0x3F));
+            }
+            return write;
+        }
+    };
+
 } // end anonymous namespace
 
 
@@ -144,11 +345,178 @@ const char * JsonException::what() const throw() {
  *- json_string
  *---------------------------------------------------------------------------*/
 
+namespace {
+
+    /* For each byte, the character following the slash when it must be
+     * escaped, 'u' when it needs a \u00XX escape, or zero otherwise. */
+    struct EscapeTable {
+        char table[256];
+
+        EscapeTable() {
+            memset(table, 0, sizeof(table));
+            for (int c = 0; c < 0x20; ++ c) {
+                table[c] = 'u';
+            }
+            table[(unsigned char) '"'] = '"';
+            table[(unsigned char) '\\'] = '\\';
+            table[(unsigned char) '\b'] = 'b';
+            table[(unsigned char) '\f'] = 'f';
+            table[(unsigned char) '\n'] = 'n';
+            table[(unsigned char) '\r'] = 'r';
+            table[(unsigned char) '\t'] = 't';
+        }
+    };
+
+    const EscapeTable escapes;
+
+} // end anonymous namespace
+
+void json_append_string(std::string & out, const char * text,
+                        size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    out.reserve(out.size() + length + 2);
+    out.push_back('"');
+    const char * run = text;
+    const char * const end = text + length;
+    for (const char * itr = text; itr < end; ++ itr) {
+        const char escape = escapes.table[(unsigned char) *itr];
+        if (escape) {
+            out.append(run, itr - run);
+            run = itr + 1;
+            if (escape == 'u') {
+                const char code[] = { '\\', 'u', '0', '0',
+                                      hex[(*itr >> 4) & 0xF],
+                                      hex[*itr & 0xF] };
+                out.append(code, sizeof(code));
+            } else {
+                const char code[] = { '\\', escape };
+                out.append(code, sizeof(code));
+            }
+        }
+    }
+    out.append(run, end - run);
+    out.push_back('"');
+}
+
 std::string json_string(const char * text) {
-    return JsonData::from_string(text)->to_string();
+    std::string rtn;
+    json_append_string(rtn, text, strlen(text));
+    return rtn;
+}
+
+
+/**---------------------------------------------------------------------------
+ *- json_find_top_level_string
+ *---------------------------------------------------------------------------*/
+
+bool json_find_top_level_string(const char * text, size_t length,
+                                const char * key, string & value) {
+    TopLevelScanner scanner(text, length);
+    scanner.skip_whitespace();
+    if (scanner.at_end() || scanner.next() != '{') {
+        throw JsonException(JsonException::CTOR_ARGUMENT_NOT_OBJECT);
+    }
+    scanner.skip_whitespace();
+    if (scanner.peek() == '}') {
+        return false;
+    }
+    const size_t key_length = strlen(key);
+    string current_key;
+    // Keep going after a match so a repeated key resolves to its last value,
+    // the same as json-c does.
+    bool found = false;
+    while (true) {
+        scanner.skip_whitespace();
+        scanner.expect('"');
+        scanner.read_string(&current_key);
+        scanner.skip_whitespace();
+        scanner.expect(':');
+        scanner.skip_whitespace();
+        const bool is_key = current_key.size() == key_length
+            && 0 == current_key.compare(0, key_length, key);
+        if (is_key) {
+            found = (scanner.peek() == '"');
+        }
+        if (is_key && found) {
+            scanner.next();
+            scanner.read_string(&value);
+        } else {
+            scanner.skip_value();
+        }
+        scanner.skip_whitespace();
+        const char separator = scanner.next();
+        if (separator == '}') {
+            return found;
+        } else if (separator != ',') {
+            throw_malformed();
+        }
+    }
 }
 
 
+/**---------------------------------------------------------------------------
+ *- JsonData::Root
+ *---------------------------------------------------------------------------*/
+
+class JsonData::Root : public boost::enable_shared_from_this<JsonData::Root>,
+                       boost::noncopyable {
+    public:
+        Root(json_object * original)
+        :   block_used(BLOCK_SIZE),
+            blocks(),
+            nodes(),
+            original(original) {
+        }
+
+        ~Root() {
+            for (size_t index = nodes.size(); index > 0; -- index) {
+                if (nodes[index - 1] != 0) {
+                    nodes[index - 1]->~JsonData();
+                }
+            }
+            BOOST_FOREACH(char * block, blocks) {
+                ::operator delete(block);
+            }
+            json_object_put(original);
+        }
+
+        // Records a node constructed in memory from reserve(), so it is
+        // destroyed along with the tree.
+        void adopt(JsonData * node) {
+            nodes.back() = node;
+        }
+
+        // Returns arena memory for a node. Its slot is taken up front so
+        // the node can't leak if growing the list fails after it's built.
+        void * reserve(size_t size) {
+            nodes.push_back(0);
+            return allocate(size);
+        }
+
+    private:
+        static const size_t ALIGNMENT = sizeof(void *) * 2;
+
+        static const size_t BLOCK_SIZE = 4096;
+
+        void * allocate(size_t size) {
+            size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+            if (block_used + size > BLOCK_SIZE) {
+                blocks.push_back(static_cast<char *>(
+                    ::operator new(BLOCK_SIZE)));
+                block_used = 0;
+            }
+            void * rtn = blocks.back() + block_used;
+            block_used += size;
+            return rtn;
+        }
+
+        size_t block_used;
+        std::vector<char *> blocks;
+        std::vector<JsonData *> nodes;
+        json_object * const original;
+};
+
+
 /**---------------------------------------------------------------------------
  *- JsonData
  *---------------------------------------------------------------------------*/
@@ -157,11 +525,16 @@ JsonData::Visitor::~Visitor() {
 }
 
 JsonData::JsonData()
-: object(0), root(0) {
+: object(0), root(0), owned_root() {
+}
+
+JsonData::JsonData(json_object * obj, Root * root)
+: object(0), root(0), owned_root() {
+    initialize_child_no_check(obj, root);
 }
 
 JsonData::JsonData(json_object * obj)
-: object(0), root(0) {
+: object(0), root(0), owned_root() {
     if (obj == 0) {
         json_object_put(obj);
         throw JsonException(JsonException::CTOR_ARGUMENT_IS_NOT_JSON_STRING);
@@ -170,7 +543,7 @@ JsonData::JsonData(json_object * obj)
 }
 
 JsonData::JsonData(json_object * obj, int type_i)
-: object(0), root(0) {
+: object(0), root(0), owned_root() {
     json_type type = (json_type) type_i;
     if (type != json_type_null) {
         if (obj == 0) {
@@ -191,13 +564,6 @@ JsonData::JsonData(json_object * obj, int type_i)
 
 
 JsonData::~JsonData() {
-    if (root != 0) {
-        root->reference_count --;
-        if (root->reference_count <= 0) {
-            json_object_put(root->original);
-            delete root;
-        }
-    }
 }
 
 void JsonData::check_initial_object(bool owned, json_object * obj,
@@ -218,10 +584,16 @@ void JsonData::check_initial_object(bool owned, json_object * obj,
     }
 }
 
+template<typename T>
+boost::shared_ptr<T> JsonData::make_child(json_object * obj) const {
+    T * node = new (root->reserve(sizeof(T))) T(obj, root);
+    root->adopt(node);
+    // Shares the Root's count rather than getting one of its own.
+    return boost::shared_ptr<T>(root->shared_from_this(), node);
+}
+
 JsonDataPtr JsonData::create_child(json_object * obj) const {
-    JsonDataPtr rtn(new JsonData());
-    rtn->initialize_child_no_check(obj, root);
-    return rtn;
+    return make_child<JsonData>(obj);
 }
 
 JsonDataPtr JsonData::from_boolean(bool value) {
@@ -259,7 +631,6 @@ void JsonData::initialize_child(json_object * obj, int type_i,
 
 void JsonData::initialize_child_no_check(json_object * obj, Root * root) {
     this->root = root;
-    root->reference_count ++;
     this->object = obj;
 }
 
@@ -272,9 +643,8 @@ void JsonData::initialize_root(json_object * obj, int type_i,
 }
 
 void JsonData::set_root(json_object * obj) {
-    this->root = new JsonData::Root();
-    root->reference_count = 1;
-    root->original = obj;
+    this->owned_root.reset(new JsonData::Root(obj));
+    this->root = owned_root.get();
     this->object = obj;
 }
 
@@ -306,12 +676,12 @@ void JsonData::visit(JsonData::Visitor & visitor) const {
             break;
         }
         case json_type_object: {
-            JsonObjectPtr value(new JsonObject(object, root));
+            JsonObjectPtr value = make_child<JsonObject>(object);
             visitor.for_object(value);
             break;
         }
         case json_type_array: {
-            JsonArrayPtr value(new JsonArray(object, root));
+            JsonArrayPtr value = make_child<JsonArray>(object);
             visitor.for_array(value);
             break;
         }
@@ -378,7 +748,7 @@ JsonDataPtr JsonArray::get_any(const int index) const {
 JsonArrayPtr JsonArray::get_array(const int index) const {
     json_object * array_obj = get(index);
     validate_json_array(array_obj, JsonException::INDEX_ERROR);
-    JsonArrayPtr rtn(new JsonArray(array_obj, root));
+    JsonArrayPtr rtn = make_child<JsonArray>(array_obj);
     return rtn;
 }
 
@@ -390,7 +760,7 @@ int JsonArray::get_int(const int index) const {
 JsonObjectPtr JsonArray::get_object(const int index) const {
     json_object * object_obj = get(index);
     validate_json_object(object_obj, JsonException::INDEX_ERROR);
-    JsonObjectPtr rtn(new JsonObject(object_obj, root));
+    JsonObjectPtr rtn = make_child<JsonObject>(object_obj);
     return rtn;
 }
 
@@ -432,6 +802,11 @@ JsonObject::JsonObject(const char * json_text)
     initialize(json_text);
 }
 
+JsonObject::JsonObject(const char * json_text, size_t length)
+: JsonData() {
+    initialize(json_text, length);
+}
+
 JsonObject::JsonObject(const JsonObjectBuilder & obj)
 : JsonData() {
     std::string s = boost::lexical_cast<std::string>(obj);
@@ -478,7 +853,7 @@ JsonDataPtr JsonObject::get_any(const char * key) const {
 JsonArrayPtr JsonObject::get_array(const char * key) const {
     json_object * array_obj = json_object_object_get(object, key);
     validate_json_array(array_obj, JsonException::KEY_ERROR);
-    JsonArrayPtr rtn(new JsonArray(array_obj, root));
+    JsonArrayPtr rtn = make_child<JsonArray>(array_obj);
     return rtn;
 }
 
@@ -495,7 +870,7 @@ int JsonObject::get_int(const char * key) const {
 JsonObjectPtr JsonObject::get_object(const char * key) const {
     json_object * object_obj = json_object_object_get(object, key);
     validate_json_object(object_obj, JsonException::KEY_ERROR);
-    JsonObjectPtr rtn(new JsonObject(object_obj, root));
+    JsonObjectPtr rtn = make_child<JsonObject>(object_obj);
     return rtn;
 }
 
@@ -515,7 +890,7 @@ JsonObjectPtr JsonObject::get_optional_object(const char * key) const {
         return JsonObjectPtr();
     } else {
         validate_json_object(object_obj, JsonException::KEY_ERROR);
-        JsonObjectPtr rtn(new JsonObject(object_obj, root));
+        JsonObjectPtr rtn = make_child<JsonObject>(object_obj);
         return rtn;
     }
 }
@@ -537,7 +912,7 @@ JsonObjectPtr JsonObject::get_object_or_empty(const char * key) const {
         return rtn;
     } else {
         validate_json_object(object_obj, JsonException::INDEX_ERROR);
-        JsonObjectPtr rtn(new JsonObject(object_obj, root));
+        JsonObjectPtr rtn = make_child<JsonObject>(object_obj);
         return rtn;
     }
 }
@@ -587,6 +962,19 @@ void JsonObject::initialize(const char * json_text) {
                     JsonException::CTOR_ARGUMENT_NOT_OBJECT);
 }
 
+void JsonObject::initialize(const char * json_text, size_t length) {
+    // json_tokener_parse would strlen the text first; we already know it.
+    json_tokener * tokener = json_tokener_new();
+    json_object * obj = json_tokener_parse_ex(tokener, json_text,
+                                              (int) length);
+    json_tokener_free(tokener);
+    if (obj == 0) {
+        throw JsonException(JsonException::CTOR_ARGUMENT_IS_NOT_JSON_STRING);
+    }
+    initialize_root(obj, json_type_object,
+                    JsonException::CTOR_ARGUMENT_NOT_OBJECT);
+}
+
 void JsonObject::iterate(JsonObject::Iterator & itr) {
     // This is a macro defined in the JSON lib we're using.
     json_object_object_foreach(object, key_object, value_object) {
@@ -608,13 +996,53 @@ JsonDataBuilder::JsonDataBuilder()
 }
 
 JsonDataBuilder::JsonDataBuilder(const JsonDataBuilder & other)
-:   msg(),
+:   msg(other.msg),
     seen_comma(other.seen_comma) {
-    msg.str(other.msg.str());
+}
+
+void JsonDataBuilder::add_unescaped_value(const JsonArrayBuilder & value) {
+    msg += "[ ";
+    msg += value.msg;
+    msg += " ]";
+}
+
+void JsonDataBuilder::add_unescaped_value(const JsonObjectBuilder & value) {
+    msg += "{ ";
+    msg += value.msg;
+    msg += " }";
+}
+
+void JsonDataBuilder::append_double(const double value) {
+    // Six significant digits, the same as a default formatted stream.
+    char buffer[32];
+    const int length = snprintf(buffer, sizeof(buffer), "%g", value);
+    msg.append(buffer, length);
+}
+
+void JsonDataBuilder::append_integer(const int value) {
+    if (value < 0) {
+        msg.push_back('-');
+        // Negate as unsigned so INT_MIN doesn't overflow.
+        append_integer(0u - (unsigned int) value);
+    } else {
+        append_integer((unsigned int) value);
+    }
+}
+
+void JsonDataBuilder::append_integer(const unsigned int value) {
+    char buffer[16];
+    char * const end = buffer + sizeof(buffer);
+    char * start = end;
+    unsigned int remaining = value;
+    do {
+        *(-- start) = '0' + (remaining % 10);
+        remaining /= 10;
+    } while (remaining != 0);
+    msg.append(start, end - start);
 }
 
 void JsonDataBuilder::assign(const JsonDataBuilder & other) {
-    this->msg.str(other.msg.str());
+    this->msg = other.msg;
     this->seen_comma = other.seen_comma;
 }
 
@@ -647,7 +1075,7 @@ JsonArrayBuilder::~JsonArrayBuilder() {
 
 std::ostream & operator<<(std::ostream & source,
                           const JsonArrayBuilder & obj) {
-    source << "[ " << obj.msg.str() << " ]";
+    source << "[ " << obj.msg << " ]";
     return source;
 }
 
@@ -676,7 +1104,7 @@ JsonObjectBuilder::~JsonObjectBuilder() {
 
 std::ostream & operator<<(std::ostream & source,
                           const JsonObjectBuilder & obj) {
-    source << "{ " << obj.msg.str() << " }";
+    source << "{ " << obj.msg << " }";
     return source;
 }
 
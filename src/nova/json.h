@@ -6,6 +6,7 @@
 #include <boost/intrusive_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <string>
+#include <string.h>
 #include <vector>
 #include <boost/utility.hpp>
 
@@ -26,6 +27,10 @@ namespace nova {
         return json_string((const char *) text.c_str());
     }
 
+    /** Appends text to out as a quoted Json string, escaping as needed. */
+    void json_append_string(std::string & out, const char * text,
+                            size_t length);
+
     class JsonArrayBuilder;
 
     class JsonObjectBuilder;
@@ -40,23 +45,24 @@ namespace nova {
             ~JsonDataBuilder();
 
             void add_value(const int value) {
-                add_unescaped_value(value);
+                append_integer(value);
             }
 
             void add_value(const unsigned int value) {
-                add_unescaped_value(value);
+                append_integer(value);
             }
 
             void add_value(const float value) {
-                add_unescaped_value(value);
+                append_double(value);
             }
 
             void add_value(const double value) {
-                add_unescaped_value(value);
+                append_double(value);
             }
 
+            // Booleans have always gone out as 1 or 0.
             void add_value(const bool value) {
-                add_unescaped_value(value);
+                msg.push_back(value ? '1' : '0');
             }
 
             void add_value(const JsonArrayBuilder & value) {
@@ -111,19 +117,58 @@ namespace nova {
             // Convert to a string
             template<typename T>
             void add_string_value(const T & value) {
-                const auto str_value = boost::lexical_cast<std::string>(value);
-                add_unescaped_value(json_string(str_value));
+                add_string_value(boost::lexical_cast<std::string>(value));
+            }
+
+            void add_string_value(const char * value) {
+                json_append_string(msg, value, strlen(value));
+            }
+
+            void add_string_value(const std::string & value) {
+                json_append_string(msg, value.data(), value.size());
             }
 
             // For values that don't need quotes and aren't strings.
             template<typename T>
             void add_unescaped_value(const T & value) {
-                msg << value;
+                msg += boost::lexical_cast<std::string>(value);
+            }
+
+            void add_unescaped_value(const char * value) {
+                msg += value;
             }
 
+            void add_unescaped_value(const std::string & value) {
+                msg += value;
+            }
+
+            void add_unescaped_value(const JsonArrayBuilder & value);
+
+            void add_unescaped_value(const JsonObjectBuilder & value);
+
+            void append_double(const double value);
+
+            void append_integer(const int value);
+
+            void append_integer(const unsigned int value);
+
             void assign(const JsonDataBuilder & other);
 
-            std::stringstream msg;
+            void separate() {
+                if (seen_comma) {
+                    msg += ", ";
+                }
+                seen_comma = true;
+            }
+
+            void write_name(const char * name) {
+                separate();
+                add_string_value(name);
+                msg += " : ";
+            }
+
+            // Everything written so far, minus the enclosing brackets.
+            std::string msg;
 
             bool seen_comma;
     };
@@ -141,11 +186,8 @@ namespace nova {
 
             template<typename T>
             void add(const T & value) {
-                if (seen_comma) {
-                    msg << ", ";
-                }
+                separate();
                 add_value(value);
-                seen_comma = true;
             }
 
             // Allows for multiple additions at once.
@@ -157,11 +199,8 @@ namespace nova {
 
             template<typename T>
             void add_unescaped(const T & value) {
-                if (seen_comma) {
-                    msg << ", ";
-                }
+                separate();
                 add_unescaped_value(value);
-                seen_comma = true;
             }
 
         friend std::ostream & operator<<(std::ostream & source,
@@ -192,12 +231,8 @@ namespace nova {
 
             template<typename T>
             void add(const char * name, const T & value) {
-                if (seen_comma) {
-                    msg << ", ";
-                }
-                msg << json_string(name) << " : ";
+                write_name(name);
                 add_value(value);
-                seen_comma = true;
             }
 
             // Allows for multiple additions at once.
@@ -210,12 +245,8 @@ namespace nova {
 
             template<typename T>
             void add_unescaped(const char * name, const T & value) {
-                if (seen_comma) {
-                    msg << ", ";
-                }
-                msg << json_string(name) << " : ";
+                write_name(name);
                 add_unescaped_value(value);
-                seen_comma = true;
             }
 
         friend std::ostream & operator<<(std::ostream & source,
@@ -269,6 +300,15 @@ namespace nova {
             const Code code;
     };
 
+    /* Scans only the top level of the JSON object in "text" for "key",
+     * without building a tree, and unescapes its string value into "value".
+     * Pass the same "value" string across calls to reuse its storage.
+     * Like json-c, a repeated key resolves to its last occurrence.
+     * Returns false if the key is absent or its value is not a string.
+     * Throws JsonException if "text" is not a well formed JSON object. */
+    bool json_find_top_level_string(const char * text, size_t length,
+                                    const char * key, std::string & value);
+
     class JsonArray;
 
     class JsonData;
@@ -320,15 +360,24 @@ namespace nova {
             const char * to_string() const;
 
         protected:
-            struct Root {
-                int reference_count;
-                json_object * original;
-            };
+            /* Owns the parsed json_object tree along with every child
+             * wrapper handed out for it. Children are placed in an arena
+             * and returned as pointers sharing the Root's reference count,
+             * so a lookup allocates nothing on its own and everything is
+             * freed at once when the last reference to the tree goes away.
+             * Like the json_object tree itself, it is not thread safe. */
+            class Root;
 
             JsonData();
 
+            JsonData(json_object * obj, Root * root);
+
             JsonDataPtr create_child(json_object * obj) const;
 
+            // Places a T wrapping obj in the root's arena.
+            template<typename T>
+            boost::shared_ptr<T> make_child(json_object * obj) const;
+
             // Validates that json_object is of the given type and sets obj.
             // If anything fails it will *not* free the json_object and throw.
             // Sets root without validation.
@@ -357,11 +406,14 @@ namespace nova {
             void check_initial_object(bool owned, json_object * obj, int type,
                                       JsonException::Code exception_code);
 
-            // Sets this object's object and root fields to the given values,
-            // and increases the reference count on root.
+            // Sets this object's object and root fields to the given values.
             void initialize_child_no_check(json_object * obj, Root * root);
 
             void set_root(json_object * obj);
+
+            // Set only on the object a tree was parsed into; children are
+            // owned by the root's arena instead.
+            boost::shared_ptr<Root> owned_root;
     };
 
 
@@ -430,6 +482,10 @@ namespace nova {
 
             JsonObject(const char * json_text);
 
+            /* Parses exactly "length" bytes of json_text, which need not be
+             * null terminated. */
+            JsonObject(const char * json_text, size_t length);
+
             JsonObject(json_object * obj);
 
             JsonObject(const JsonObjectBuilder & obj);
@@ -484,6 +540,8 @@ namespace nova {
 
             void initialize(const char * json_text);
 
+            void initialize(const char * json_text, size_t length);
+
     };
 
 } // end namespace
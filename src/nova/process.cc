@@ -4,13 +4,13 @@
 #include "nova/Log.h"
 #include <errno.h>
 #include <fcntl.h> // Consider moving to io.cc and using there.
+#include <dirent.h>
 #include <boost/foreach.hpp>
 #include <fstream>
 #include "nova/utils/io.h"
 #include <iostream>
 #include <malloc.h>  // Valgrind complains if we don't use "free" below. ;_;
 #include <signal.h>
-#include <sys/select.h>
 #include <spawn.h>
 #include <sstream>
 #include <stdio.h>
@@ -28,12 +28,10 @@ using nova::utils::io::Pipe;
 using namespace nova::utils;
 using std::stringstream;
 using std::string;
+using nova::utils::io::Deadline;
 using nova::utils::io::TimeOutException;
-using nova::utils::io::Timer;
 using nova::utils::io::wait_pid_with_throw;
 
-bool time_out_occurred;
-
 namespace nova { namespace process {
 
 namespace {
@@ -93,37 +91,29 @@ namespace {
 
     const size_t BUFFER_SIZE = 1048;
 
+    /** Longest line read_lines_until_exit passes in one piece. */
+    const size_t LINE_BUFFER_SIZE = 4096;
+
     /** Waits for the given file descriptor to have more data for the given
-     *  number of seconds. */
-    bool ready(int file_desc, const optional<double> seconds) {
-        fd_set file_set;
-        FD_ZERO(&file_set);
-        FD_SET(file_desc, &file_set);
-        return io::select_with_throw(file_desc + 1, &file_set, NULL, NULL, seconds)
-               != 0;
+     *  number of seconds. Throws TimeOutException if the process's deadline
+     *  passes first. */
+    bool ready(const Deadline & deadline, int file_desc,
+               const optional<double> seconds) {
+        return !!io::wait_for_readable(&file_desc, 1, seconds, &deadline);
     }
 
     /* If neither file descriptor has input by the time denoted by "seconds",
      * boost::none is returned. Otherwise, the filedesc which was ready is
      * returned. */
-    optional<int> ready(int file_desc1, int file_desc2,
-                        const optional<double> seconds) {
-        fd_set file_set;
-        FD_ZERO(&file_set);
-        FD_SET(file_desc1, &file_set);
-        FD_SET(file_desc2, &file_set);
-        int nfds = std::max(file_desc1, file_desc2) + 1;
-        auto result = io::select_with_throw(nfds, &file_set, NULL,
-                                            NULL, seconds);
-        if (0 == result) {
+    optional<int> ready(const Deadline & deadline, int file_desc1,
+                        int file_desc2, const optional<double> seconds) {
+        const int fds[] = { file_desc1, file_desc2 };
+        optional<size_t> index = io::wait_for_readable(fds, 2, seconds,
+                                                       &deadline);
+        if (!index) {
             return boost::none;
-        } else {
-            if (FD_ISSET(file_desc1, &file_set)) {
-                return file_desc1;
-            } else {
-                return file_desc2;
-            }
         }
+        return fds[index.get()];
     }
 
 }  // end anonymous namespace
@@ -244,6 +234,45 @@ pid_t execute_and_abandon(const CommandList & cmds) {
     return pid;
 }
 
+optional<pid_t> find_process_by_name(const char * name) {
+    DIR * proc = ::opendir("/proc");
+    if (proc == 0) {
+        NOVA_LOG_ERROR("Error opening /proc: %s", strerror(errno));
+        throw ProcessException(ProcessException::GENERAL);
+    }
+    optional<pid_t> found;
+    char path[64];
+    char comm[64];
+    struct dirent * entry;
+    while (!found && (entry = ::readdir(proc)) != 0) {
+        char * end;
+        const long pid = strtol(entry->d_name, &end, 10);
+        if (*end != '\0' || pid <= 0) {
+            continue;  // Not a process directory.
+        }
+        snprintf(path, sizeof(path), "/proc/%ld/comm", pid);
+        // The process may exit between readdir and open; that's fine.
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            continue;
+        }
+        const ssize_t count = ::read(fd, comm, sizeof(comm) - 1);
+        ::close(fd);
+        if (count <= 0) {
+            continue;
+        }
+        comm[count] = '\0';
+        if (comm[count - 1] == '\n') {
+            comm[count - 1] = '\0';
+        }
+        if (strcmp(comm, name) == 0) {
+            found = static_cast<pid_t>(pid);
+        }
+    }
+    ::closedir(proc);
+    return found;
+}
+
 bool is_pid_alive(pid_t pid) {
     // Send the "null signal," so kill only performs error checking but does not
     // actually send a signal.
@@ -287,20 +316,38 @@ const char * ProcessException::what() const throw() {
  *- ProcessStatusWatcher
  *---------------------------------------------------------------------------*/
 
-ProcessStatusWatcher::ProcessStatusWatcher()
-: finished_flag(false), success(false)
+ProcessStatusWatcher::ProcessStatusWatcher(const Deadline & deadline)
+: deadline(deadline), finished_flag(false), pid_fd(-1), success(false)
 {
 
 
 }
 
 ProcessStatusWatcher::~ProcessStatusWatcher() {
-    wait_for_exit_code(false);  // Close pipes.
+    try {
+        wait_for_exit_code(false);  // Close pipes.
+    } catch(const std::exception & e) {
+        NOVA_LOG_ERROR("Error waiting for the process to exit: %s", e.what());
+    }
+    close_pid_fd();
+}
+
+int ProcessStatusWatcher::call_waitpid(int * status,
+                                       optional<double> seconds,
+                                       bool use_deadline) {
+    return wait_pid_with_throw(pid, pid_fd, status, seconds,
+                               use_deadline ? &deadline : 0);
+}
+
+void ProcessStatusWatcher::close_pid_fd() {
+    if (pid_fd >= 0) {
+        ::close(pid_fd);
+        pid_fd = -1;
+    }
 }
 
-int ProcessStatusWatcher::call_waitpid(int * status, bool do_not_wait) {
-    const int options = do_not_wait ? WNOHANG : 0 ;
-    return wait_pid_with_throw(pid, status, options);
+void ProcessStatusWatcher::start_watching() {
+    pid_fd = io::open_pid_fd(pid);
 }
 
 void ProcessStatusWatcher::wait_for_exit_code(bool wait_forever) {
@@ -310,20 +357,17 @@ void ProcessStatusWatcher::wait_for_exit_code(bool wait_forever) {
         int child_pid;
         if (!wait_forever) {
             // Here's the thing- WNOHANG causes waitpid to return 0 (fail)
-            // nearly every time. So it's better to not specify it, even if
-            // the calling code wanted it, and use a Timer to bust out if
-            // we risk hanging forever. Then we can use WNOHANG as a last
-            // resort.
-            try {
-                Timer timer(1);
-                child_pid = call_waitpid(&status);
-            } catch(const TimeOutException & toe) {
-                NOVA_LOG_ERROR("Timed out calling waitpid without WNOHANG.");
-                child_pid = call_waitpid(&status, true);
+            // nearly every time. So give the process a second to finish up
+            // instead, ignoring the deadline since this is how we clean up
+            // after it passes.
+            child_pid = call_waitpid(&status, 1.0, false);
+            if (0 == child_pid) {
+                NOVA_LOG_ERROR("Timed out waiting for the process to exit.");
             }
         } else {
-            child_pid = call_waitpid(&status);
+            child_pid = call_waitpid(&status, boost::none, true);
         }
+        close_pid_fd();
         #ifdef _NOVA_PROCESS_VERBOSE
             NOVA_LOG_TRACE("Child exited. wait_forever=%s child_pid=%d, "
                            "pid=%d, Pid==pid=%s, "
@@ -346,8 +390,9 @@ void ProcessStatusWatcher::wait_for_exit_code(bool wait_forever) {
  *---------------------------------------------------------------------------*/
 
 ProcessBase::ProcessBase()
-:   io_watchers(),
-    status_watcher()
+:   deadline(),
+    io_watchers(),
+    status_watcher(deadline)
 {
 }
 
@@ -376,6 +421,7 @@ void ProcessBase::initialize(const CommandList & cmds) { //, ProcessIOList io_li
     pre_spawn_stdout_actions(file_actions);
 
     spawn_process(cmds, &(status_watcher.get_pid()), &file_actions);
+    status_watcher.start_watching();
 
     BOOST_FOREACH(ProcessFileHandler * const ptr, io_watchers) {
         ptr->post_spawn_actions();
@@ -423,7 +469,7 @@ void ProcessBase::_wait_for_exit_code(bool wait_forever) {
 void ProcessBase::wait_for_exit(double seconds) {
     NOVA_LOG_DEBUG("Waiting for %f seconds for EOF...", seconds);
     drain_io_from_file_handlers(seconds);
-    Timer timer(seconds);
+    Deadline::Scope time_limit(deadline, seconds);
     wait_forever_for_exit();
 }
 
@@ -457,9 +503,9 @@ void IndependentStdErrAndStdOut::drain_io(optional<double> seconds) {
     NOVA_LOG_TRACE("Draining STDOUT / STDERR...");
     draining = true;
     char buffer[1024];
-    std::unique_ptr<Timer> timer;
+    std::unique_ptr<Deadline::Scope> time_limit;
     if (seconds) {
-        timer.reset(new Timer(seconds.get()));
+        time_limit.reset(new Deadline::Scope(deadline, seconds.get()));
     }
     ReadResult result;
     while((result = read_into(buffer, sizeof(buffer), seconds)).write_length
@@ -507,8 +553,8 @@ IndependentStdErrAndStdOut::ReadResult IndependentStdErrAndStdOut::read_into(
             return _read_into(buffer, length, seconds);
         }
     }
-    const auto result = ready(this->std_out_pipe.in(), this->std_err_pipe.in(),
-                              seconds);
+    const auto result = ready(deadline, this->std_out_pipe.in(),
+                              this->std_err_pipe.in(), seconds);
     if (!result) {
         NOVA_LOG_TRACE("ready returned nothing. Returning NA from read_into");
         return { ReadResult::NA, 0 };
@@ -546,7 +592,7 @@ IndependentStdErrAndStdOut::ReadResult IndependentStdErrAndStdOut::_read_into(
         index = ReadResult::FileIndex::StdErr;
     }
     NOVA_LOG_TRACE("read_into with timeout=%f", !seconds ? 0.0 : seconds.get());
-    if (!ready(filedesc, seconds)) {
+    if (!ready(deadline, filedesc, seconds)) {
         NOVA_LOG_TRACE("ready returned false, returning zero from read_into");
         return { ReadResult::NA, 0 };
     }
@@ -630,12 +676,58 @@ void StdErrToFile::pre_spawn_stderr_actions(SpawnFileActions & file_actions) {
 }
 
 
+/**---------------------------------------------------------------------------
+ *- LineHandler
+ *---------------------------------------------------------------------------*/
+
+LineHandler::~LineHandler() {
+}
+
+bool LineHandler::on_partial_line(const char *, size_t) {
+    return true;
+}
+
+LineCollector::LineCollector(optional<size_t> max_size)
+:   max_size(max_size),
+    output(),
+    was_truncated(false)
+{
+}
+
+LineCollector::~LineCollector() {
+}
+
+bool LineCollector::on_line(const char * line, size_t length, bool ended) {
+    output.append(line, length);
+    if (ended) {
+        output.push_back('\n');
+    }
+    // Trim only once twice the limit is reached so the cost of erasing is
+    // spread over many lines.
+    if (max_size && output.size() > max_size.get() * 2) {
+        output.erase(0, output.size() - max_size.get());
+        was_truncated = true;
+    }
+    return true;
+}
+
+string LineCollector::str() const {
+    if (max_size && output.size() > max_size.get()) {
+        return output.substr(output.size() - max_size.get());
+    }
+    return output;
+}
+
+
 /**---------------------------------------------------------------------------
  *- StdErrAndStdOut
  *---------------------------------------------------------------------------*/
 
 StdErrAndStdOut::StdErrAndStdOut()
 :   draining(false),
+    line_buffer(),
+    line_length(0),
+    line_scanned(0),
     std_out_pipe()
 {
     ::fcntl(std_out_pipe.in(), F_SETFL, O_NONBLOCK);
@@ -654,9 +746,9 @@ void StdErrAndStdOut::drain_io(optional<double> seconds) {
     draining = true;
     char buffer[1024];
     size_t count;
-    std::auto_ptr<Timer> timer;
+    std::auto_ptr<Deadline::Scope> time_limit;
     if (seconds) {
-        timer.reset(new Timer(seconds.get()));
+        time_limit.reset(new Deadline::Scope(deadline, seconds.get()));
     }
     while (0 != (count = read_into(buffer, sizeof(buffer) - 1, seconds))) {
         NOVA_LOG_TRACE("Draining again! %d", count);
@@ -700,7 +792,7 @@ size_t StdErrAndStdOut::read_into(char * buffer, const size_t length,
     if (!std_out_pipe.in_is_open()) {
         throw ProcessException(ProcessException::PROGRAM_FINISHED);
     }
-    if (!ready(this->std_out_pipe.in(), seconds)) {
+    if (!ready(deadline, this->std_out_pipe.in(), seconds)) {
         NOVA_LOG_TRACE("ready returned false, returning zero from read_into");
         return 0;
     }
@@ -738,6 +830,73 @@ size_t StdErrAndStdOut::read_until_pause(stringstream & std_out,
     return bytes_read;
 }
 
+bool StdErrAndStdOut::read_lines_until_exit(LineHandler & handler,
+                                            double seconds) {
+    if (line_buffer.empty()) {
+        // One extra byte so there's always room for a terminating null.
+        line_buffer.resize(LINE_BUFFER_SIZE + 1);
+    }
+    // Lines left over from a handler which stopped early go first.
+    if (!deliver_lines(handler)) {
+        return true;
+    }
+    while(true) {
+        const size_t count = read_into(&line_buffer[line_length],
+                                       LINE_BUFFER_SIZE - line_length,
+                                       optional<double>(seconds));
+        if (count == 0) {
+            break;
+        }
+        line_length += count;
+        if (!deliver_lines(handler)) {
+            return true;
+        }
+    }
+    if (std_out_pipe.in_is_open()) {
+        NOVA_LOG_ERROR("Something went wrong, EOF not reached! Time out=%f",
+                       seconds);
+        throw TimeOutException();
+    }
+    if (line_length > 0) {
+        // The last line didn't end with a newline.
+        const size_t length = line_length;
+        line_buffer[length] = '\0';
+        line_length = line_scanned = 0;
+        return !handler.on_line(&line_buffer[0], length, false);
+    }
+    return false;
+}
+
+bool StdErrAndStdOut::deliver_lines(LineHandler & handler) {
+    char * const buffer = &line_buffer[0];
+    char * const end = buffer + line_length;
+    char * start = buffer;
+    char * scan = buffer + line_scanned;  // Earlier bytes have no newlines.
+    bool keep_going = true;
+    char * newline;
+    while (keep_going
+           && 0 != (newline = (char *) memchr(scan, '\n', end - scan))) {
+        *newline = '\0';
+        keep_going = handler.on_line(start, newline - start, true);
+        start = scan = newline + 1;
+    }
+    if (keep_going && end - start == (ptrdiff_t) LINE_BUFFER_SIZE) {
+        // No newline in a full buffer, so pass on what there is.
+        *end = '\0';
+        keep_going = handler.on_line(start, end - start, false);
+        start = end;
+    }
+    line_length = end - start;
+    ::memmove(buffer, start, line_length);
+    // If the handler stopped early the rest may hold more newlines.
+    line_scanned = keep_going ? line_length : 0;
+    if (keep_going && line_length > 0) {
+        buffer[line_length] = '\0';
+        keep_going = handler.on_partial_line(buffer, line_length);
+    }
+    return keep_going;
+}
+
 void StdErrAndStdOut::set_eof_actions() {
     std_out_pipe.close_in();
     NOVA_LOG_TRACE("Closing in side of the stderr/stdout pipe.");
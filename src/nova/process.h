@@ -68,6 +68,10 @@ void execute(std::stringstream & out, const CommandList & cmds,
  *  class it does not open up the process's streams or wait for it. */
 pid_t execute_and_abandon(const CommandList & cmds);
 
+/** Returns the pid of a process whose command name (as "ps -C" sees it)
+ *  is "name" by scanning /proc, or boost::none if there isn't one. */
+boost::optional<pid_t> find_process_by_name(const char * name);
+
 /** Returns true if the given pid is alive. */
 bool is_pid_alive(pid_t pid);
 
@@ -102,8 +106,8 @@ class ProcessStatusWatcher : private boost::noncopyable {
     public:
         /** Creates an object which will get the status of pid. If
          *  "wait_for_close" is true, the program will hang until the process
-         *  identified by pid dies. */
-        ProcessStatusWatcher();
+         *  identified by pid dies. Waits give up once "deadline" passes. */
+        ProcessStatusWatcher(const nova::utils::io::Deadline & deadline);
 
         ~ProcessStatusWatcher();
 
@@ -125,17 +129,26 @@ class ProcessStatusWatcher : private boost::noncopyable {
             return success;
         }
 
+        /** Call once the pid is set so its exit can be waited for without
+         *  signals. */
+        void start_watching();
+
         /** Called when you're ready to get the processes exit status.
          *  This needs to be when you're finished with the process and
          *  perceive it to have completed.*/
         void wait_for_exit_code(bool wait_forever);
 
     private:
+        const nova::utils::io::Deadline & deadline;
         bool finished_flag;
         pid_t pid;
+        int pid_fd;
         bool success;
 
-        int call_waitpid(int * status, bool do_not_wait=false);
+        int call_waitpid(int * status, boost::optional<double> seconds,
+                         bool use_deadline);
+
+        void close_pid_fd();
 };
 
 
@@ -150,6 +163,13 @@ class ProcessBase : private boost::noncopyable {
             return status_watcher.is_finished();
         }
 
+        /** Reads and waits on this process throw TimeOutException once
+         *  this passes. Use a Deadline::Scope to bound a series of calls.
+         *  Each process has its own, so many can be timed out at once. */
+        inline nova::utils::io::Deadline & get_deadline() {
+            return deadline;
+        }
+
         inline pid_t & get_pid() {
             return status_watcher.get_pid();
         }
@@ -186,6 +206,8 @@ class ProcessBase : private boost::noncopyable {
 
         virtual void pre_spawn_stdout_actions(SpawnFileActions & sp);
 
+        nova::utils::io::Deadline deadline;
+
     private:
         std::list<ProcessFileHandler *>  io_watchers;
         ProcessStatusWatcher status_watcher;
@@ -236,6 +258,12 @@ class StdIn : public ProcessFileHandler, public virtual ProcessBase {
         /** Writes to the process's standard input. */
         void write(const char * msg, size_t length);
 
+        /** Resizes the stdin pipe so large writes need fewer trips through
+         *  the kernel. See Pipe::set_capacity. */
+        boost::optional<size_t> set_std_in_capacity(size_t size) {
+            return std_in_pipe.set_capacity(size);
+        }
+
     protected:
 
         virtual void post_spawn_actions();
@@ -312,6 +340,12 @@ class IndependentStdErrAndStdOut : public ProcessFileHandler,
         bool std_out_closed() const {
             return !std_out_pipe.in_is_open();
         }
+
+        /** Resizes the stdout pipe so a process producing lots of output
+         *  can get further ahead of the reader. See Pipe::set_capacity. */
+        boost::optional<size_t> set_std_out_capacity(size_t size) {
+            return std_out_pipe.set_capacity(size);
+        }
     protected:
 
         virtual void drain_io(boost::optional<double> seconds);
@@ -334,6 +368,53 @@ class IndependentStdErrAndStdOut : public ProcessFileHandler,
         nova::utils::io::Pipe std_out_pipe;
 };
 
+/** Receives a process's output a line at a time. See
+ *  StdErrAndStdOut::read_lines_until_exit. */
+class LineHandler {
+    public:
+        virtual ~LineHandler();
+
+        /** Called with each line, minus its newline. "line" is null
+         *  terminated but is only valid for the duration of the call.
+         *  Lines too long for the reader's buffer arrive in pieces.
+         *  "ended" is true if a newline followed, and false for such pieces
+         *  and for a last line the process didn't end.
+         *  Return false to stop reading. */
+        virtual bool on_line(const char * line, size_t length,
+                             bool ended) = 0;
+
+        /** Called after each read with the start of a line whose newline
+         *  hasn't arrived yet, such as a prompt. The same text is passed
+         *  again (possibly longer) after the next read. By default does
+         *  nothing. Return false to stop reading. */
+        virtual bool on_partial_line(const char * line, size_t length);
+};
+
+/** A LineHandler which keeps the lines it receives. If "max_size" is set
+ *  only roughly the last "max_size" bytes are kept, so long running
+ *  processes don't use more and more memory. */
+class LineCollector : public LineHandler {
+    public:
+        LineCollector(boost::optional<size_t> max_size=boost::none);
+
+        virtual ~LineCollector();
+
+        virtual bool on_line(const char * line, size_t length, bool ended);
+
+        /** The collected output, exactly as the process wrote it. */
+        std::string str() const;
+
+        /** True if earlier output was thrown away to respect "max_size". */
+        bool truncated() const {
+            return was_truncated;
+        }
+
+    private:
+        const boost::optional<size_t> max_size;
+        std::string output;
+        bool was_truncated;
+};
+
 class StdErrAndStdOut : public ProcessFileHandler, public virtual ProcessBase {
     public:
         StdErrAndStdOut();
@@ -342,8 +423,8 @@ class StdErrAndStdOut : public ProcessFileHandler, public virtual ProcessBase {
 
         /* Waits until the process's stdout stream has bytes to read or the
          * number of seconds specified by the argument "seconds" passes.
-         * If seconds is not set will block here forever (unless a Timer is
-         * used).
+         * If seconds is not set will block here forever (unless the process
+         * deadline passes).
          * Writes any bytes read to the given argument stream.
          * Returns the number of bytes read (0 for time out).If end of file
          * is encountered the eof property is set to true. */
@@ -365,6 +446,15 @@ class StdErrAndStdOut : public ProcessFileHandler, public virtual ProcessBase {
         size_t read_until_pause(std::stringstream & std_out,
                                 const double time_out);
 
+        /** Reads until EOF, handing the output to "handler" a line at a
+         *  time. Output is read into a fixed size buffer which is reused
+         *  between calls, so memory use doesn't grow with the amount of
+         *  output and each byte is only scanned once.
+         *  Returns true if the handler asked to stop, in which case any
+         *  unread lines are kept for the next call, and false at EOF.
+         *  Throws TimeOutException if no output arrives for "seconds". */
+        bool read_lines_until_exit(LineHandler & handler, double seconds);
+
     protected:
 
         virtual void drain_io(boost::optional<double> seconds);
@@ -379,7 +469,12 @@ class StdErrAndStdOut : public ProcessFileHandler, public virtual ProcessBase {
 
     private:
         bool draining;
+        std::vector<char> line_buffer;
+        size_t line_length;
+        size_t line_scanned;
         nova::utils::io::Pipe std_out_pipe;
+
+        bool deliver_lines(LineHandler & handler);
 };
 
 
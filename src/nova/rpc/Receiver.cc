@@ -13,7 +13,9 @@ using boost::format;
 using nova::guest::GuestInput;
 using nova::guest::GuestException;
 using nova::guest::GuestOutput;
+using nova::json_find_top_level_string;
 using nova::json_string;
+using nova::JsonException;
 using nova::JsonObject;
 using nova::JsonObjectPtr;
 using nova::Log;
@@ -36,6 +38,7 @@ Receiver::Receiver(AmqpConnectionPtr connection, const char * topic,
 :   connection(connection),
     last_delivery_tag(-1),
     last_msg_id(boost::none),
+    oslo_message(),
     queue(),
     topic(topic)
 {
@@ -143,10 +146,35 @@ JsonObjectPtr Receiver::_next_message() {
         #endif
     }
     NOVA_LOG_INFO(log_msg.str().c_str());
-    JsonObjectPtr json_obj(new JsonObject(msg->message.c_str()));
 
+    // Only the "oslo.message" string of the envelope is needed, so pull it
+    // out with a scan instead of building a json-c tree for the envelope and
+    // then parsing its string a second time.
+    bool found;
+    try {
+        found = json_find_top_level_string(msg->message.data(),
+                                           msg->message.size(),
+                                           "oslo.message", oslo_message);
+    } catch(const JsonException & je) {
+        queue->recycle_message(msg);
+        NOVA_LOG_ERROR("Message was not JSON! %s", je.what());
+        throw GuestException(GuestException::MALFORMED_INPUT);
+    }
     last_delivery_tag = msg->delivery_tag;
-    return json_obj;
+    queue->recycle_message(msg);
+    if (!found) {
+        NOVA_LOG_ERROR("Message had no oslo.message string.");
+        throw GuestException(GuestException::MALFORMED_INPUT);
+    }
+    try {
+        JsonObjectPtr json_obj(new JsonObject(oslo_message.data(),
+                                              oslo_message.size()));
+        return json_obj;
+    } catch (const JsonException & je) {
+        NOVA_LOG_ERROR("Oslo message could not be converted to dictionary.");
+        NOVA_LOG_ERROR("%s", je.what());
+        throw GuestException(GuestException::MALFORMED_INPUT);
+    }
 }
 
 void Receiver::init_input_with_json(GuestInput & input, JsonObject & msg) {
@@ -157,35 +185,19 @@ void Receiver::init_input_with_json(GuestInput & input, JsonObject & msg) {
 }
 
 GuestInput Receiver::next_message() {
-    while(true) {
-        JsonObjectPtr raw;
-        try {
-            raw = _next_message();
-        } catch(const JsonException & je) {
-            NOVA_LOG_ERROR("Message was not JSON! %s", je.what());
-            throw GuestException(GuestException::MALFORMED_INPUT);
-        }
-        JsonObjectPtr msg;
-        try {
-            msg.reset(new JsonObject(raw->get_string("oslo.message")));
-        } catch (const JsonException & je) {
-            NOVA_LOG_ERROR("Oslo message could not be converted to dictionary.");
-            NOVA_LOG_ERROR("%s", je.what());
-            throw GuestException(GuestException::MALFORMED_INPUT);
-        }
-        try {
-            last_msg_id = msg->get_string("_msg_id");
-         } catch(const JsonException & je) {
-             last_msg_id = boost::none;
-         }
-         try {
-             GuestInput input;
-             init_input_with_json(input, *msg);
-             return input;
-         } catch(const JsonException & je) {
-            NOVA_LOG_ERROR("Json message was malformed:", msg->to_string());
-             throw GuestException(GuestException::MALFORMED_INPUT);
-         }
+    JsonObjectPtr msg = _next_message();
+    try {
+        last_msg_id = msg->get_optional_string("_msg_id");
+    } catch(const JsonException & je) {
+        last_msg_id = boost::none;
+    }
+    try {
+        GuestInput input;
+        init_input_with_json(input, *msg);
+        return input;
+    } catch(const JsonException & je) {
+        NOVA_LOG_ERROR("Json message was malformed: %s", msg->to_string());
+        throw GuestException(GuestException::MALFORMED_INPUT);
     }
 }
 
@@ -50,7 +50,8 @@ void Sender::send(const JsonObject & publish_object) {
 ResilientSender::ResilientSender(const char * host, int port,
     const char * userid, const char * password, size_t client_memory,
     const char * topic, const char * exchange_name,
-    const char * instance_id, unsigned long reconnect_wait_time)
+    const char * instance_id, unsigned long reconnect_wait_time,
+    bool connect_now)
 :   client_memory(client_memory),
     exchange_name(exchange_name),
     host(host),
@@ -63,8 +64,9 @@ ResilientSender::ResilientSender(const char * host, int port,
     reconnect_wait_time(reconnect_wait_time),
     conductor_mutex()
 {
-    boost::lock_guard<boost::mutex> lock(conductor_mutex);
-    open(false);
+    if (connect_now) {
+        connect();
+    }
 }
 
 ResilientSender::~ResilientSender() {
@@ -75,6 +77,11 @@ void ResilientSender::close() {
     sender.reset(0);
 }
 
+void ResilientSender::connect() {
+    boost::lock_guard<boost::mutex> lock(conductor_mutex);
+    open(false);
+}
+
 void ResilientSender::open(bool wait_first) {
     while(sender.get() == 0) {
         try {
@@ -121,6 +128,7 @@ void ResilientSender::start_send(const char * method, JsonObjectBuilder & args)
 void ResilientSender::send_plain_string(const char * msg) {
     NOVA_LOG_INFO("Sending message ]%s[", msg);
     boost::lock_guard<boost::mutex> lock(conductor_mutex);
+    open(false);
     while(true)
     {
         try {
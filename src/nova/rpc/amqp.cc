@@ -302,8 +302,8 @@ void intrusive_ptr_release(AmqpChannel * ref) {
 }
 
 AmqpChannel::AmqpChannel(AmqpConnection * parent, const int channel_number)
-: channel_number(channel_number), is_open(false), parent(parent),
-  reference_count(0)
+: body_buffer(), channel_number(channel_number), is_open(false),
+  parent(parent), reference_count(0)
 {
     amqp_connection_state_t conn = parent->get_connection();
     NOVA_LOG_DEBUG("Opening new channel with # %d.", channel_number);
@@ -527,24 +527,29 @@ AmqpQueueMessagePtr AmqpChannel::get_message(const char * queue_name) {
                                  (size_t) properties->content_type.len);
     }
 
-    size_t body_target = frame.payload.properties.body_size;
-    size_t body_received = 0;
-    while (body_received < body_target) {
+    // The header says exactly how big the body is, so reserve it up front
+    // and append the fragments without reallocating.
+    const size_t body_target = frame.payload.properties.body_size;
+    body_buffer.clear();
+    body_buffer.reserve(body_target);
+    while (body_buffer.size() < body_target) {
         result = amqp_simple_wait_frame(conn, &frame);
-		if (result < 0) {
-		  throw AmqpException(AmqpException::WAIT_FRAME_FAILED);
-		}
-		if (frame.frame_type != AMQP_FRAME_BODY) {
-		    throw AmqpException(AmqpException::BODY_EXPECTED);
-		}
-		body_received += frame.payload.body_fragment.len;
-		if (body_received > body_target) {
-		    throw AmqpException(AmqpException::BODY_LARGER);
-		}
-		//TODO: Is it safe to assume these are normal chars?
-		rtn->message.append((char *) frame.payload.body_fragment.bytes,
-                      		(size_t) frame.payload.body_fragment.len);
+        if (result < 0) {
+            throw AmqpException(AmqpException::WAIT_FRAME_FAILED);
+        }
+        if (frame.frame_type != AMQP_FRAME_BODY) {
+            throw AmqpException(AmqpException::BODY_EXPECTED);
+        }
+        const size_t fragment_length =
+            (size_t) frame.payload.body_fragment.len;
+        if (body_buffer.size() + fragment_length > body_target) {
+            throw AmqpException(AmqpException::BODY_LARGER);
+        }
+        //TODO: Is it safe to assume these are normal chars?
+        body_buffer.append((char *) frame.payload.body_fragment.bytes,
+                           fragment_length);
     }
+    rtn->message.swap(body_buffer);
     return rtn;
 }
 
@@ -571,6 +576,13 @@ void AmqpChannel::publish(const char * exchange_name,
     }
 }
 
+void AmqpChannel::recycle_message(AmqpQueueMessagePtr & message) {
+    if (message && message->message.capacity() > body_buffer.capacity()) {
+        body_buffer.swap(message->message);
+    }
+    message.reset();
+}
+
 void AmqpChannel::_throw(const AmqpException::Code & code) {
     parent->mark_channel_as_bad(this);
     throw AmqpException(code);
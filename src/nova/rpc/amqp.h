@@ -162,6 +162,11 @@ namespace nova { namespace rpc {
             void publish(const char * exchange_name, const char * routing_key,
                          const char * messagebody);
 
+            /** Hands the body of a message returned by get_message back to
+             *  this channel so its storage can be reused for the next
+             *  message. The message is reset and must not be used after. */
+            void recycle_message(AmqpQueueMessagePtr & message);
+
         protected:
             AmqpChannel(AmqpConnection * parent, const int channel_number);
             ~AmqpChannel();
@@ -170,6 +175,10 @@ namespace nova { namespace rpc {
             AmqpChannel(const AmqpChannel &);
             AmqpChannel & operator = (const AmqpChannel &);
 
+            // Message bodies are assembled here, then swapped into the
+            // returned message, so capacity survives between messages.
+            std::string body_buffer;
+
             const int channel_number;
 
             void check(const amqp_rpc_reply_t reply,
@@ -37,6 +37,8 @@ namespace nova { namespace rpc {
         AmqpConnectionPtr connection;
         int last_delivery_tag;
         boost::optional<std::string> last_msg_id;
+        // Holds the unescaped inner message; reused between messages.
+        std::string oslo_message;
         AmqpChannelPtr queue;
         const std::string topic;
 
@@ -36,15 +36,23 @@ namespace nova { namespace rpc {
 
     class ResilientSender {
         public:
+            /** Connects right away unless "connect_now" is false, in which
+             *  case the connection is opened by "connect" or the first
+             *  message sent. */
             ResilientSender(const char * host, int port, const char * userid,
                             const char * password, size_t client_memory,
                             const char * topic,
                             const char * exchange_name,
                             const char * instance_id,
-                            unsigned long reconnect_wait_time);
+                            unsigned long reconnect_wait_time,
+                            bool connect_now=true);
 
             ~ResilientSender();
 
+            /** Opens the connection if it isn't open yet. Messages sent
+             *  meanwhile wait for it. */
+            void connect();
+
             /**
              *  Sends a message. Accepts JSON object element key value pairs
              *  as arguments, similar to nova::json_obj.
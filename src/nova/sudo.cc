@@ -0,0 +1,759 @@
+#include "pch.hpp"
+#include "nova/sudo.h"
+
+#include <algorithm>
+#include <boost/foreach.hpp>
+#include <errno.h>
+#include <boost/format.hpp>
+#include <fcntl.h>
+#include "nova/Log.h"
+#include <poll.h>
+#include <pwd.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+extern char **environ;
+
+using boost::optional;
+using std::string;
+using std::stringstream;
+using nova::utils::io::TimeOutException;
+using std::vector;
+
+namespace nova { namespace process {
+
+namespace {
+
+    /* Sent by the helper as soon as it starts so the agent knows sudo
+     * actually let it run. */
+    const uint32_t GREETING = 0x53505248;  // "SPRH"
+
+    const double GREETING_TIME_OUT = 10.0;
+
+    /* How much longer than the command's own time out the agent waits for
+     * the helper to answer before giving up on it. The helper enforces the
+     * time out itself, so this only matters if the helper is wedged. */
+    const double REPLY_GRACE_SECONDS = 5.0;
+
+    /* How long a caller waits for another thread's command to finish in the
+     * helper before spawning sudo itself. Most commands the helper runs take
+     * milliseconds, but an init script or mkfs would hold up everyone. */
+    const double BUSY_WAIT_SECONDS = 0.5;
+
+    /* How long closing the connection waits for the helper to exit. */
+    const double EXIT_TIME_OUT = 5.0;
+
+    const uint32_t MAX_ARG_COUNT = 256;
+
+    const uint32_t MAX_ARG_LENGTH = 64 * 1024;
+
+    const uint32_t MAX_OUTPUT_LENGTH = 16 * 1024 * 1024;
+
+    enum ResultCode {
+        RESULT_SUCCESS = 0,
+        RESULT_FAILURE = 1,
+        RESULT_NOT_ALLOWED = 2,
+        RESULT_TIMED_OUT = 3,
+        RESULT_MALFORMED = 4
+    };
+
+    struct AllowedProgram {
+        const char * name;
+        const char * path;
+    };
+
+    /* Everything the helper is willing to run. Commands may be given either
+     * by name or by the full path listed here. */
+    const AllowedProgram ALLOWED_PROGRAMS[] = {
+        { "blockdev", "/sbin/blockdev" },
+        { "chmod", "/bin/chmod" },
+        { "chown", "/bin/chown" },
+        { "cp", "/bin/cp" },
+        { "dumpe2fs", "/sbin/dumpe2fs" },
+        { "e2fsck", "/sbin/e2fsck" },
+        { "kill", "/bin/kill" },
+        { "killall", "/usr/bin/killall" },
+        { "ln", "/bin/ln" },
+        { "ls", "/bin/ls" },
+        { "mkdir", "/bin/mkdir" },
+        { "mkfs", "/sbin/mkfs" },
+        { "mount", "/bin/mount" },
+        { "mv", "/bin/mv" },
+        { "mysqladmin", "/usr/bin/mysqladmin" },
+        { "mysqld", "/usr/sbin/mysqld" },
+        { "ps", "/bin/ps" },
+        { "resize2fs", "/sbin/resize2fs" },
+        { "rm", "/bin/rm" },
+        { "umount", "/bin/umount" },
+        { "update-rc.d", "/usr/sbin/update-rc.d" }
+    };
+
+    /* Scripts in here may also be run, such as "/etc/init.d/mysql". */
+    const char * const INIT_SCRIPT_DIRECTORY = "/etc/init.d/";
+
+    double seconds_until(const timespec & deadline) {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (deadline.tv_sec - now.tv_sec)
+               + (deadline.tv_nsec - now.tv_nsec) / 1000000000.0;
+    }
+
+    timespec deadline_from_now(double seconds) {
+        timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += (time_t) seconds;
+        deadline.tv_nsec += (long) ((seconds - (time_t) seconds) * 1000000000L);
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec ++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        return deadline;
+    }
+
+    /* Writes everything or throws. MSG_NOSIGNAL keeps a dead helper from
+     * taking the agent down with SIGPIPE. */
+    void send_all(int fd, const string & data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            const ssize_t result = ::send(fd, data.data() + sent,
+                                          data.size() - sent, MSG_NOSIGNAL);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                NOVA_LOG_ERROR("Error writing to root helper socket: %s",
+                               strerror(errno));
+                throw RootHelperException(
+                    RootHelperException::CONNECTION_CLOSED);
+            }
+            sent += result;
+        }
+    }
+
+    /* Fills "buffer" completely. Returns false if the other side closed the
+     * socket before anything was read, and throws if it closed part way
+     * through. If a deadline is given throws a TimeOutException once it
+     * passes. */
+    bool receive_all(int fd, char * buffer, size_t length,
+                     const optional<timespec> & deadline) {
+        size_t received = 0;
+        while (received < length) {
+            if (deadline) {
+                const double remaining = seconds_until(deadline.get());
+                pollfd poll_fd = { fd, POLLIN, 0 };
+                const int result = (remaining <= 0) ? 0
+                    : ::poll(&poll_fd, 1, (int) (remaining * 1000) + 1);
+                if (result == 0) {
+                    throw TimeOutException();
+                } else if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw RootHelperException(
+                        RootHelperException::CONNECTION_CLOSED);
+                }
+            }
+            const ssize_t count = ::recv(fd, buffer + received,
+                                         length - received, 0);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                NOVA_LOG_ERROR("Error reading from root helper socket: %s",
+                               strerror(errno));
+                throw RootHelperException(
+                    RootHelperException::CONNECTION_CLOSED);
+            }
+            if (count == 0) {
+                if (received == 0) {
+                    return false;
+                }
+                throw RootHelperException(
+                    RootHelperException::MALFORMED_MESSAGE);
+            }
+            received += count;
+        }
+        return true;
+    }
+
+    void append_uint32(string & out, uint32_t value) {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    bool receive_uint32(int fd, uint32_t & value,
+                        const optional<timespec> & deadline = boost::none) {
+        return receive_all(fd, reinterpret_cast<char *>(&value),
+                           sizeof(value), deadline);
+    }
+
+    void receive_string(int fd, string & value, uint32_t max_length,
+                        const optional<timespec> & deadline = boost::none) {
+        uint32_t length;
+        if (!receive_uint32(fd, length, deadline) || length > max_length) {
+            throw RootHelperException(RootHelperException::MALFORMED_MESSAGE);
+        }
+        value.resize(length);
+        if (length > 0 && !receive_all(fd, &value[0], length, deadline)) {
+            throw RootHelperException(RootHelperException::MALFORMED_MESSAGE);
+        }
+    }
+
+    boost::mutex & instance_mutex() {
+        static boost::mutex mutex;
+        return mutex;
+    }
+
+    CommandList with_sudo(const CommandList & cmds) {
+        CommandList sudo_cmds(cmds);
+        sudo_cmds.push_front("/usr/bin/sudo");
+        return sudo_cmds;
+    }
+
+    /* Runs the command through the process wide helper. Returns boost::none
+     * if the caller should fall back to spawning sudo. */
+    optional<bool> run_with_helper(const CommandList & cmds, string & output,
+                                   double time_out) {
+        boost::shared_ptr<RootHelper> helper = RootHelper::get_instance();
+        if (!helper) {
+            return boost::none;
+        }
+        try {
+            return helper->run(cmds, output, time_out);
+        } catch(const RootHelperException & rhe) {
+            if (rhe.code == RootHelperException::COMMAND_NOT_ALLOWED) {
+                NOVA_LOG_INFO("Root helper won't run %s, using sudo.",
+                              cmds.front());
+            } else {
+                NOVA_LOG_ERROR("Root helper failed (%s)! Falling back to "
+                               "sudo from now on.", rhe.what());
+                RootHelper::set_instance(boost::shared_ptr<RootHelper>());
+            }
+            return boost::none;
+        }
+    }
+
+    /* The time left for sudo after the helper turned the command away. */
+    double time_left_for_sudo(const timespec & deadline) {
+        const double time_left = seconds_until(deadline);
+        if (time_left <= 0) {
+            throw TimeOutException();
+        }
+        return time_left;
+    }
+
+}  // end anonymous namespace
+
+
+/**---------------------------------------------------------------------------
+ *- Global Functions
+ *---------------------------------------------------------------------------*/
+
+void sudo(const CommandList & cmds, double time_out) {
+    const timespec deadline = deadline_from_now(time_out);
+    string output;
+    optional<bool> result = run_with_helper(cmds, output, time_out);
+    if (!result) {
+        execute(with_sudo(cmds), time_left_for_sudo(deadline));
+    } else if (!result.get()) {
+        NOVA_LOG_ERROR("%s failed: %s", cmds.front(), output);
+        throw ProcessException(ProcessException::EXIT_CODE_NOT_ZERO);
+    }
+}
+
+void sudo(stringstream & out, const CommandList & cmds, double time_out) {
+    const timespec deadline = deadline_from_now(time_out);
+    string output;
+    optional<bool> result = run_with_helper(cmds, output, time_out);
+    if (!result) {
+        execute(out, with_sudo(cmds), time_left_for_sudo(deadline));
+        return;
+    }
+    out << output;
+    if (!result.get()) {
+        throw ProcessException(ProcessException::EXIT_CODE_NOT_ZERO);
+    }
+}
+
+
+/**---------------------------------------------------------------------------
+ *- RootHelperException
+ *---------------------------------------------------------------------------*/
+
+RootHelperException::RootHelperException(Code code) throw()
+: code(code) {
+}
+
+RootHelperException::~RootHelperException() throw() {
+}
+
+const char * RootHelperException::what() const throw() {
+    switch(code) {
+        case COMMAND_NOT_ALLOWED:
+            return "The root helper does not allow this command.";
+        case CONNECTION_CLOSED:
+            return "The connection to the root helper was lost.";
+        case MALFORMED_MESSAGE:
+            return "Received a malformed root helper message.";
+        case SPAWN_FAILURE:
+            return "Could not start the root helper.";
+        default:
+            return "An error occurred.";
+    }
+}
+
+
+/**---------------------------------------------------------------------------
+ *- RootHelper
+ *---------------------------------------------------------------------------*/
+
+RootHelper::RootHelper(const CommandList & launch_cmds)
+:   fd(-1),
+    mutex(),
+    pid(boost::none)
+{
+    if (launch_cmds.size() < 1) {
+        throw ProcessException(ProcessException::NO_PROGRAM_GIVEN);
+    }
+    int fds[2];
+    if (0 != ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+        NOVA_LOG_ERROR("Couldn't create socketpair: %s", strerror(errno));
+        throw RootHelperException(RootHelperException::SPAWN_FAILURE);
+    }
+    // Neither end should leak into other children; dup2 clears the flag on
+    // the copies the helper gets as stdin and stdout.
+    ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    fd = fds[0];
+
+    vector<char *> args;
+    BOOST_FOREACH(const string & cmd, launch_cmds) {
+        args.push_back(const_cast<char *>(cmd.c_str()));
+    }
+    args.push_back(0);
+
+    posix_spawn_file_actions_t file_actions;
+    posix_spawn_file_actions_init(&file_actions);
+    posix_spawn_file_actions_adddup2(&file_actions, fds[1], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&file_actions, fds[1], STDOUT_FILENO);
+    pid_t child;
+    const int status = posix_spawn(&child, launch_cmds.front().c_str(),
+                                   &file_actions, NULL, &args[0], environ);
+    posix_spawn_file_actions_destroy(&file_actions);
+    ::close(fds[1]);
+    if (status != 0) {
+        NOVA_LOG_ERROR("Couldn't spawn root helper: %s", strerror(status));
+        close();
+        throw RootHelperException(RootHelperException::SPAWN_FAILURE);
+    }
+    pid = child;
+    wait_for_greeting();
+}
+
+RootHelper::RootHelper(int socket_fd)
+:   fd(socket_fd),
+    mutex(),
+    pid(boost::none)
+{
+    wait_for_greeting();
+}
+
+RootHelper::~RootHelper() {
+    close();
+}
+
+void RootHelper::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    if (pid) {
+        // The helper exits as soon as it sees EOF. It's running as root so
+        // it can't be killed; if it's stuck all we can do is stop waiting.
+        const timespec deadline = deadline_from_now(EXIT_TIME_OUT);
+        int status;
+        pid_t result;
+        while (0 == (result = ::waitpid(pid.get(), &status, WNOHANG))
+               && seconds_until(deadline) > 0) {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+        }
+        if (result == 0) {
+            NOVA_LOG_ERROR("Root helper %d didn't exit within %f seconds.",
+                           pid.get(), EXIT_TIME_OUT);
+        } else if (result < 0 && errno != EINTR) {
+            NOVA_LOG_ERROR("Error waiting for root helper %d: %s",
+                           pid.get(), strerror(errno));
+        }
+        pid = boost::none;
+    }
+}
+
+boost::shared_ptr<RootHelper> RootHelper::get_instance() {
+    boost::lock_guard<boost::mutex> lock(instance_mutex());
+    return _get_instance();
+}
+
+boost::shared_ptr<RootHelper> & RootHelper::_get_instance() {
+    static boost::shared_ptr<RootHelper> instance;
+    return instance;
+}
+
+optional<bool> RootHelper::run(const CommandList & cmds, string & output,
+                               double time_out) {
+    // The helper runs one command at a time. Wait briefly for our turn, but
+    // if it's stuck on something slow let the caller spawn sudo instead.
+    const timespec give_up = deadline_from_now(time_out);
+    const double busy_wait = std::min(time_out, BUSY_WAIT_SECONDS);
+    boost::unique_lock<boost::timed_mutex> lock(mutex, boost::defer_lock);
+    if (!lock.timed_lock(boost::posix_time::milliseconds(
+            (long) (busy_wait * 1000)))) {
+        NOVA_LOG_INFO("Root helper busy for %f seconds, using sudo.",
+                      busy_wait);
+        return boost::none;
+    }
+    time_out = seconds_until(give_up);
+    if (fd < 0) {
+        throw RootHelperException(RootHelperException::CONNECTION_CLOSED);
+    }
+
+    string request;
+    append_uint32(request, (uint32_t) (time_out * 1000));
+    append_uint32(request, cmds.size());
+    BOOST_FOREACH(const string & cmd, cmds) {
+        append_uint32(request, cmd.size());
+        request.append(cmd);
+    }
+
+    uint32_t result;
+    try {
+        send_all(fd, request);
+        const timespec deadline = deadline_from_now(time_out
+                                                    + REPLY_GRACE_SECONDS);
+        if (!receive_uint32(fd, result, deadline)) {
+            throw RootHelperException(RootHelperException::CONNECTION_CLOSED);
+        }
+        receive_string(fd, output, MAX_OUTPUT_LENGTH, deadline);
+    } catch(const TimeOutException & toe) {
+        NOVA_LOG_ERROR("Root helper didn't answer in time. Closing it.");
+        close();
+        throw;
+    } catch(const RootHelperException & rhe) {
+        close();
+        throw;
+    }
+
+    switch(result) {
+        case RESULT_SUCCESS:
+            return true;
+        case RESULT_FAILURE:
+            return false;
+        case RESULT_NOT_ALLOWED:
+            throw RootHelperException(RootHelperException::COMMAND_NOT_ALLOWED);
+        case RESULT_TIMED_OUT:
+            throw TimeOutException();
+        default:
+            throw RootHelperException(RootHelperException::MALFORMED_MESSAGE);
+    }
+}
+
+void RootHelper::set_instance(boost::shared_ptr<RootHelper> helper) {
+    boost::lock_guard<boost::mutex> lock(instance_mutex());
+    _get_instance() = helper;
+}
+
+void RootHelper::wait_for_greeting() {
+    uint32_t greeting = 0;
+    try {
+        const timespec deadline = deadline_from_now(GREETING_TIME_OUT);
+        receive_uint32(fd, greeting, deadline);
+    } catch(const std::exception & e) {
+        NOVA_LOG_ERROR("Error waiting for the root helper: %s", e.what());
+    }
+    if (greeting != GREETING) {
+        close();
+        throw RootHelperException(RootHelperException::SPAWN_FAILURE);
+    }
+}
+
+
+/**---------------------------------------------------------------------------
+ *- RootHelperScope
+ *---------------------------------------------------------------------------*/
+
+RootHelperScope::RootHelperScope(optional<const char *> helper_path) {
+    if (!helper_path) {
+        return;
+    }
+    NOVA_LOG_INFO("Starting root helper %s...", helper_path.get());
+    try {
+        CommandList cmds;
+        cmds.push_back("/usr/bin/sudo");
+        cmds.push_back(helper_path.get());
+        RootHelper::set_instance(
+            boost::shared_ptr<RootHelper>(new RootHelper(cmds)));
+    } catch(const std::exception & e) {
+        NOVA_LOG_ERROR("Couldn't start root helper, using sudo instead: %s",
+                       e.what());
+    }
+}
+
+RootHelperScope::~RootHelperScope() {
+    RootHelper::set_instance(boost::shared_ptr<RootHelper>());
+}
+
+
+/**---------------------------------------------------------------------------
+ *- Root Helper Server
+ *---------------------------------------------------------------------------*/
+
+namespace {
+
+    const AllowedProgram * find_allowed_program(const string & program) {
+        BOOST_FOREACH(const AllowedProgram & allowed, ALLOWED_PROGRAMS) {
+            if (program == allowed.name || program == allowed.path) {
+                return &allowed;
+            }
+        }
+        return 0;
+    }
+
+    bool is_init_script(const string & program) {
+        const size_t length = strlen(INIT_SCRIPT_DIRECTORY);
+        return program.compare(0, length, INIT_SCRIPT_DIRECTORY) == 0
+            && program.size() > length
+            && program.find('/', length) == string::npos
+            && program[length] != '.';
+    }
+
+    bool is_option(const string & arg) {
+        return !arg.empty() && arg[0] == '-';
+    }
+
+    bool is_directory(const string & path) {
+        struct stat info;
+        return 0 == ::stat(path.c_str(), &info) && S_ISDIR(info.st_mode);
+    }
+
+    bool fail_with_errno(string & output, const char * name,
+                         const string & path) {
+        output += str(boost::format("%s: %s: %s\n") % name % path
+                      % strerror(errno));
+        return false;
+    }
+
+    bool copy_file(const string & from, const string & to, string & output) {
+        const int in = ::open(from.c_str(), O_RDONLY);
+        if (in < 0) {
+            return fail_with_errno(output, "cp", from);
+        }
+        struct stat info;
+        if (0 != ::fstat(in, &info)) {
+            ::close(in);
+            return fail_with_errno(output, "cp", from);
+        }
+        const int out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                               info.st_mode & 07777);
+        if (out < 0) {
+            ::close(in);
+            return fail_with_errno(output, "cp", to);
+        }
+        bool success = true;
+        char buffer[64 * 1024];
+        ssize_t count;
+        while (success && (count = ::read(in, buffer, sizeof(buffer))) != 0) {
+            if (count < 0) {
+                if (errno != EINTR) {
+                    success = fail_with_errno(output, "cp", from);
+                }
+                continue;
+            }
+            ssize_t written = 0;
+            while (written < count) {
+                const ssize_t result = ::write(out, buffer + written,
+                                               count - written);
+                if (result < 0 && errno != EINTR) {
+                    success = fail_with_errno(output, "cp", to);
+                    break;
+                }
+                written += std::max<ssize_t>(result, 0);
+            }
+        }
+        ::close(in);
+        if (0 != ::close(out) && success) {
+            success = fail_with_errno(output, "cp", to);
+        }
+        return success;
+    }
+
+    /* Handles the simple forms of the file commands the agent uses all the
+     * time with a system call instead of a fork and exec. Returns
+     * boost::none if the arguments are anything fancier, in which case the
+     * real program is spawned. */
+    optional<bool> run_in_process(const string & name,
+                                  const vector<string> & args,
+                                  string & output) {
+        if (name == "cp") {
+            if (args.size() == 2 && !is_option(args[0]) && !is_option(args[1])
+                && !is_directory(args[1])) {
+                return copy_file(args[0], args[1], output);
+            }
+        } else if (name == "mv") {
+            if (args.size() == 2 && !is_option(args[0]) && !is_option(args[1])
+                && !is_directory(args[1])) {
+                if (0 == ::rename(args[0].c_str(), args[1].c_str())) {
+                    return true;
+                }
+                if (errno == EXDEV) {
+                    return boost::none;  // mv knows how to copy across.
+                }
+                return fail_with_errno(output, "mv", args[0]);
+            }
+        } else if (name == "rm") {
+            const bool force = args.size() == 2 && args[0] == "-f";
+            if ((args.size() == 1 || force) && !is_option(args.back())) {
+                const string & path = args.back();
+                struct stat info;
+                if (0 == ::lstat(path.c_str(), &info)
+                    && S_ISDIR(info.st_mode)) {
+                    return boost::none;
+                }
+                if (0 == ::unlink(path.c_str())
+                    || (force && errno == ENOENT)) {
+                    return true;
+                }
+                return fail_with_errno(output, "rm", path);
+            }
+        } else if (name == "ln") {
+            if (args.size() == 3 && args[0] == "-s" && !is_option(args[1])
+                && !is_option(args[2]) && !is_directory(args[2])) {
+                if (0 == ::symlink(args[1].c_str(), args[2].c_str())) {
+                    return true;
+                }
+                return fail_with_errno(output, "ln", args[2]);
+            }
+        } else if (name == "chmod") {
+            if (args.size() == 2 && !args[0].empty() && args[0].size() <= 4
+                && args[0].find_first_not_of("01234567") == string::npos
+                && !is_option(args[1])) {
+                const mode_t mode = strtol(args[0].c_str(), NULL, 8);
+                if (0 == ::chmod(args[1].c_str(), mode)) {
+                    return true;
+                }
+                return fail_with_errno(output, "chmod", args[1]);
+            }
+        } else if (name == "chown") {
+            if (args.size() == 2 && !is_option(args[0]) && !is_option(args[1])
+                && args[0].find_first_of(":.") == string::npos) {
+                passwd entry;
+                passwd * found = 0;
+                char buffer[4096];
+                if (0 != getpwnam_r(args[0].c_str(), &entry, buffer,
+                                    sizeof(buffer), &found) || !found) {
+                    return boost::none;  // Let chown explain.
+                }
+                if (0 == ::chown(args[1].c_str(), found->pw_uid, -1)) {
+                    return true;
+                }
+                return fail_with_errno(output, "chown", args[1]);
+            }
+        }
+        return boost::none;
+    }
+
+    ResultCode spawn_allowed_program(const string & path,
+                                     const vector<string> & args,
+                                     double time_out, string & output) {
+        CommandList cmds(args.begin(), args.end());
+        cmds.push_front(path);
+        try {
+            Process<StdErrAndStdOut> proc(cmds);
+            // Keep no more than fits in a reply; the end is the useful part.
+            LineCollector out(MAX_OUTPUT_LENGTH);
+            try {
+                proc.read_lines_until_exit(out, time_out);
+            } catch(const TimeOutException & toe) {
+                NOVA_LOG_ERROR("%s timed out. Killing it.", path);
+                output = out.str();
+                try {
+                    proc.kill(5, 15);
+                } catch(const std::exception & e) {
+                    NOVA_LOG_ERROR("Couldn't kill %s: %s", path, e.what());
+                }
+                return RESULT_TIMED_OUT;
+            }
+            proc.wait_forever_for_exit();
+            output = out.str();
+            return proc.successful() ? RESULT_SUCCESS : RESULT_FAILURE;
+        } catch(const std::exception & e) {
+            output = e.what();
+            return RESULT_FAILURE;
+        }
+    }
+
+    ResultCode handle_request(const vector<string> & cmds, double time_out,
+                              string & output) {
+        if (cmds.empty()) {
+            return RESULT_MALFORMED;
+        }
+        const string & program = cmds.front();
+        const AllowedProgram * allowed = find_allowed_program(program);
+        if (!allowed && !is_init_script(program)) {
+            NOVA_LOG_ERROR("Refusing to run %s.", program);
+            return RESULT_NOT_ALLOWED;
+        }
+        const vector<string> args(cmds.begin() + 1, cmds.end());
+        if (allowed) {
+            optional<bool> result = run_in_process(allowed->name, args, output);
+            if (result) {
+                return result.get() ? RESULT_SUCCESS : RESULT_FAILURE;
+            }
+        }
+        const string path = allowed ? allowed->path : program;
+        return spawn_allowed_program(path, args, time_out, output);
+    }
+
+}  // end anonymous namespace
+
+void serve_root_helper_requests(int socket_fd) {
+    {
+        string greeting;
+        append_uint32(greeting, GREETING);
+        send_all(socket_fd, greeting);
+    }
+    while (true) {
+        uint32_t time_out_ms;
+        if (!receive_uint32(socket_fd, time_out_ms)) {
+            NOVA_LOG_INFO("Agent closed the connection; root helper exiting.");
+            return;
+        }
+        uint32_t count;
+        if (!receive_uint32(socket_fd, count) || count > MAX_ARG_COUNT) {
+            throw RootHelperException(RootHelperException::MALFORMED_MESSAGE);
+        }
+        vector<string> cmds(count);
+        BOOST_FOREACH(string & cmd, cmds) {
+            receive_string(socket_fd, cmd, MAX_ARG_LENGTH);
+        }
+
+        string output;
+        const ResultCode result = handle_request(cmds, time_out_ms / 1000.0,
+                                                 output);
+        if (output.size() > MAX_OUTPUT_LENGTH) {
+            output.resize(MAX_OUTPUT_LENGTH);
+        }
+        string reply;
+        append_uint32(reply, result);
+        append_uint32(reply, output.size());
+        reply.append(output);
+        send_all(socket_fd, reply);
+    }
+}
+
+} }  // end namespace nova::process
@@ -0,0 +1,129 @@
+#ifndef __NOVA_SUDO_H
+#define __NOVA_SUDO_H
+
+#include <boost/optional.hpp>
+#include "nova/process.h"
+#include <boost/shared_ptr.hpp>
+#include <sstream>
+#include <string>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+
+/**
+ *  Runs commands as root without forking "/usr/bin/sudo" every time.
+ *
+ *  A single root helper is launched through sudo when the agent starts and
+ *  is kept around for the lifetime of the process. The helper reads requests
+ *  from a socketpair, runs simple file operations (cp, mv, rm, ln, chmod and
+ *  chown) directly, and spawns anything else on a fixed whitelist itself.
+ *
+ *  Call sites move over by dropping "/usr/bin/sudo" from their command list:
+ *
+ *      process::execute(list_of("/usr/bin/sudo")("mv")(from)(to));
+ *
+ *  becomes
+ *
+ *      process::sudo(list_of("mv")(from)(to));
+ *
+ *  Requests from several threads queue for the helper. If no helper is
+ *  running, it stays busy with other requests for the whole time out, or
+ *  it refuses the command, "sudo" falls back to spawning "/usr/bin/sudo"
+ *  exactly as before.
+ */
+namespace nova { namespace process {
+
+
+/** Runs the given command as root, waiting until its finished. Throws a
+ *  ProcessException if the exit code isn't zero. */
+void sudo(const CommandList & cmds, double time_out=30);
+
+/** Like the above but captures stdout / stderr into "out". */
+void sudo(std::stringstream & out, const CommandList & cmds,
+          double time_out=30);
+
+
+class RootHelperException : public std::exception {
+
+    public:
+        enum Code {
+            COMMAND_NOT_ALLOWED,
+            CONNECTION_CLOSED,
+            MALFORMED_MESSAGE,
+            SPAWN_FAILURE
+        };
+
+        RootHelperException(Code code) throw();
+
+        virtual ~RootHelperException() throw();
+
+        virtual const char * what() const throw();
+
+        const Code code;
+};
+
+
+/** The agent's end of the connection to the root helper. */
+class RootHelper : boost::noncopyable {
+
+    public:
+        /** Spawns the helper using the given commands (typically
+         *  "/usr/bin/sudo" followed by the path of the helper binary). */
+        RootHelper(const CommandList & launch_cmds);
+
+        /** Talks to a helper which is already listening on the other end of
+         *  "socket_fd". Takes ownership of the descriptor. */
+        explicit RootHelper(int socket_fd);
+
+        /** Closes the socket, which causes the helper to exit. */
+        ~RootHelper();
+
+        /** Sends the command to the helper and waits for it to finish.
+         *  Commands from several threads take turns, but only briefly; the
+         *  wait counts against "time_out". Returns true if the command
+         *  succeeded, false if it didn't, and boost::none without sending
+         *  anything if the helper stayed busy with another command. Any
+         *  output is stored in "output".
+         *  Throws a RootHelperException if the helper refuses the command
+         *  or the connection is lost, and a TimeOutException if the command
+         *  didn't finish within "time_out" seconds. */
+        boost::optional<bool> run(const CommandList & cmds,
+                                  std::string & output, double time_out);
+
+        /** The process wide helper used by "sudo", or null. */
+        static boost::shared_ptr<RootHelper> get_instance();
+
+        /** Makes "helper" the instance returned by get_instance(). */
+        static void set_instance(boost::shared_ptr<RootHelper> helper);
+
+    private:
+        int fd;
+        boost::timed_mutex mutex;
+        boost::optional<pid_t> pid;
+
+        void close();
+
+        void wait_for_greeting();
+
+        static boost::shared_ptr<RootHelper> & _get_instance();
+};
+
+
+/** Starts the process wide helper if a path is given, and stops it when
+ *  destroyed. Failure to start the helper is logged but isn't fatal; calls
+ *  to "sudo" simply keep spawning "/usr/bin/sudo". */
+class RootHelperScope : boost::noncopyable {
+    public:
+        RootHelperScope(boost::optional<const char *> helper_path);
+
+        ~RootHelperScope();
+};
+
+
+/** Serves requests arriving on "socket_fd" until the other side closes it.
+ *  This is the main loop of the helper binary. */
+void serve_root_helper_requests(int socket_fd);
+
+
+} }  // end namespace nova::process
+
+#endif
@@ -3,13 +3,14 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include "nova/Log.h"
-#include <signal.h>
-#include <sys/select.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h> // exit
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
@@ -22,19 +23,6 @@ using boost::optional;
 
 namespace {
 
-    void assert_only_one_timer(int increment) {
-        static int instance_count = 0;
-        instance_count += increment;
-        if (instance_count > 1 || instance_count < 0) {
-            NOVA_LOG_ERROR("Two timers cannot be used at a time. Destroy one "
-                           "before creating another.");
-            NOVA_LOG_ERROR("Count = %d", instance_count);
-            #ifdef _DEBUG
-                std::abort();  // This is what you get, criminal!
-            #endif
-        }
-    }
-
     inline void checkGE0(LogPtr & log, const int return_code,
                          IOException::Code code = IOException::GENERAL) {
         if (return_code < 0) {
@@ -51,6 +39,12 @@ namespace {
         }
     }
 
+    timespec now() {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time;
+    }
+
     timespec timespec_from_seconds(double seconds) {
         const long BILLION = 1000000000L;
         timespec time;
@@ -63,6 +57,43 @@ namespace {
         return time;
     }
 
+    double seconds_between(const timespec & start, const timespec & end) {
+        return (end.tv_sec - start.tv_sec)
+               + (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+    }
+
+    /* Combines a wait's own time out with what's left of a deadline.
+     * Sets "by_deadline" if the deadline is the tighter of the two, and
+     * throws right away if it has already passed. */
+    optional<double> time_limit(optional<double> seconds,
+                                const nova::utils::io::Deadline * deadline,
+                                bool & by_deadline) {
+        by_deadline = false;
+        if (deadline) {
+            optional<double> remaining = deadline->remaining();
+            if (remaining) {
+                if (remaining.get() <= 0) {
+                    throw nova::utils::io::TimeOutException();
+                }
+                if (!seconds || remaining.get() < seconds.get()) {
+                    by_deadline = true;
+                    return remaining;
+                }
+            }
+        }
+        return seconds;
+    }
+
+    int to_poll_time_out(const optional<double> & seconds) {
+        if (!seconds) {
+            return -1;
+        }
+        // Round up so we never wake up a hair early and spin.
+        const double milliseconds = seconds.get() * 1000.0;
+        const int result = (int) milliseconds;
+        return (result < milliseconds) ? result + 1 : result;
+    }
+
     bool internal_is_file(const char * file_path, bool log) {
         struct stat buffer;
         if (stat(file_path, &buffer) == 0) {
@@ -159,6 +190,19 @@ void Pipe::close_out() {
     close(1);
 }
 
+optional<size_t> Pipe::set_capacity(size_t size) {
+    #ifdef F_SETPIPE_SZ
+        const int capacity = ::fcntl(fd[is_open[IN] ? IN : OUT],
+                                     F_SETPIPE_SZ, (int) size);
+        if (capacity >= 0) {
+            return optional<size_t>((size_t) capacity);
+        }
+        NOVA_LOG_INFO("Couldn't resize pipe to %d bytes: %s", size,
+                      strerror(errno));
+    #endif
+    return boost::none;
+}
+
 
 /**---------------------------------------------------------------------------
  *- TimeOutException
@@ -176,85 +220,50 @@ const char * TimeOutException::what() const throw() {
 
 
 /**---------------------------------------------------------------------------
- *- Timer
+ *- Deadline
  *---------------------------------------------------------------------------*/
 
-Timer::Timer(double seconds) {
-    assert_only_one_timer(1);
-    set_interrupt_handler();
-    // Initialize timer.
-    itimerspec value;
-    //TODO(tim.simpson): Valgrind thinks id is not initialized.
-    // However even if you use memset on it this error will not go away.
-    // http://stackoverflow.com/questions/6122594/timer-create-gives-memory-leaks-issue-syscall-param-timer-createevp-points-to
-    // ;_;
-    LogPtr log = Log::get_instance();
-    checkEqual0(log, timer_create(CLOCK_REALTIME, NULL, &id),
-                IOException::TIMER_ENABLE_ERROR);
-    value.it_value = timespec_from_seconds(seconds);
-    value.it_interval = timespec_from_seconds(0.0);  // Not periodic.
-    time_out_occurred() = false;
-    // 0 for relative time.
-    checkEqual0(log, timer_settime(id, 0, &value, NULL),
-                IOException::TIMER_ENABLE_ERROR);
+Deadline::Deadline()
+:   when(boost::none) {
 }
 
-Timer::~Timer() {
-    assert_only_one_timer(-1);
-    LogPtr log = Log::get_instance();
-    if (0 != ::timer_delete(id)) {
-        NOVA_LOG_ERROR("Error deleting timer! OH NO! : %s", strerror(errno));
-    }
-    time_out_occurred() = false;
-    remove_interrupt_handler();
+bool Deadline::expired() const {
+    optional<double> left = remaining();
+    return left && left.get() <= 0;
 }
 
-void Timer::interrupt(int signal_number, siginfo_t * info,
-                             void * context) {
-    NOVA_LOG_ERROR("Interruptin'");
-    time_out_occurred() = true;
-    remove_interrupt_handler();
-    //raise(SIGALRM);
-    //signal(SIGALRM, SIG_IGN);
+optional<double> Deadline::remaining() const {
+    if (!when) {
+        return boost::none;
+    }
+    const double left = seconds_between(now(), when.get());
+    return left > 0 ? left : 0.0;
 }
 
-void Timer::remove_interrupt_handler() {
-    // Unblock all signals. The alarm may happen right now.
-    sigset_t blocked_signals;
-    sigemptyset(&blocked_signals);         /* Block SIGINT */
-    sigaddset(&blocked_signals, SIGALRM);
-    sigprocmask(SIGALRM, &blocked_signals, NULL);
-
-    // Remove signal handler
-    struct sigaction action;
-    action.sa_flags = SA_RESETHAND;
-    action.sa_sigaction = NULL;
-    if ((sigemptyset(&action.sa_mask) == -1) ||
-        (sigaction(SIGALRM, &action, NULL) == -1)) {
-        throw IOException(IOException::SIGNAL_HANDLER_DESTROY_ERROR);
+void Deadline::set(double seconds) {
+    timespec time = now();
+    const timespec offset = timespec_from_seconds(seconds);
+    time.tv_sec += offset.tv_sec;
+    time.tv_nsec += offset.tv_nsec;
+    if (time.tv_nsec >= 1000000000L) {
+        time.tv_sec ++;
+        time.tv_nsec -= 1000000000L;
     }
+    when = time;
 }
 
-void Timer::set_interrupt_handler() {
-    // Block the very signal we're generating so nothing catches it.
-    sigset_t blocked_signals;
-    sigemptyset(&blocked_signals);         /* Block SIGINT */
-    sigaddset(&blocked_signals, SIGALRM);
-    sigprocmask(SIGALRM, &blocked_signals, NULL);
-
-    struct sigaction action;
-    action.sa_handler = SIG_IGN;
-    action.sa_flags = SA_SIGINFO;
-    action.sa_sigaction = interrupt;
-    if ((sigemptyset(&action.sa_mask) == -1) ||
-        (sigaction(SIGALRM, &action, NULL) == -1)) {
-        throw IOException(IOException::SIGNAL_HANDLER_INITIALIZE_ERROR);
+Deadline::Scope::Scope(Deadline & deadline, double seconds)
+:   deadline(deadline),
+    previous(deadline.when)
+{
+    optional<double> left = deadline.remaining();
+    if (!left || seconds < left.get()) {
+        deadline.set(seconds);
     }
 }
 
-bool & Timer::time_out_occurred() {
-    static bool time_out(false);
-    return time_out;
+Deadline::Scope::~Scope() {
+    deadline.when = previous;
 }
 
 
@@ -288,68 +297,98 @@ size_t read_with_throw(int fd, char * const buf, size_t count) {
     return (size_t) bytes_read;
 }
 
-// Throws exceptions if errors are detected.
-// Also unblocks time out signals before proceeding and throws
-// ProcessTimeOutExceptions if they happen.
-int select_with_throw(int nfds, fd_set * readfds, fd_set * writefds,
-                      fd_set * errorfds, optional<double> seconds) {
-    NOVA_LOG_TRACE("select_with_throw, seconds for timeout? %f",
-                   (seconds ? seconds.get() : -99));
-    if (Timer::time_out_occurred()) {
-        NOVA_LOG_ERROR("Not even attempting a select call as an unhandled"
-                       "time out exception is being thrown.");
-        throw TimeOutException();
+int open_pid_fd(pid_t pid) {
+    #ifdef SYS_pidfd_open
+        const int fd = ::syscall(SYS_pidfd_open, pid, 0);
+        if (fd >= 0) {
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        return fd;
+    #else
+        return -1;
+    #endif
+}
+
+optional<size_t> wait_for_readable(const int * fds, size_t count,
+                                   optional<double> seconds,
+                                   const Deadline * deadline) {
+    const size_t MAX_FDS = 8;
+    if (count > MAX_FDS) {
+        NOVA_LOG_ERROR("Can't wait on more than %d file descriptors.", MAX_FDS);
+        throw IOException(IOException::GENERAL);
+    }
+    pollfd poll_fds[MAX_FDS];
+    for (size_t index = 0; index < count; ++ index) {
+        poll_fds[index].fd = fds[index];
+        poll_fds[index].events = POLLIN;
+        poll_fds[index].revents = 0;
     }
-    timespec time_out = timespec_from_seconds(!seconds ? 0.0 : seconds.get());
-    sigset_t empty_set;
-    sigemptyset(&empty_set);
-    // Unblock all signals for the duration of select.
-    int ready = -1;
-    while(ready < 0)
-    {
-        //TODO(tim.simpson): Consider surrounding this call with the
-        //                   assert_only_one_timer calls seen in the Timer
-        //                   class.
-        ready = pselect(nfds, readfds, writefds, errorfds,
-                        (!seconds ? NULL: &time_out), &empty_set);
+    while (true) {
+        bool by_deadline;
+        const optional<double> limit = time_limit(seconds, deadline,
+                                                  by_deadline);
+        const int ready = ::poll(poll_fds, count, to_poll_time_out(limit));
         if (ready < 0) {
             if (errno == EINTR) {
-                if (Timer::time_out_occurred()) {
-                    throw TimeOutException();
-                } else {
-                    NOVA_LOG_ERROR("pselect was interrupted, restarting.");
-                }
-            } else {
-                NOVA_LOG_ERROR("Select returned < 0. errno = %d: %s\n "
-                                "EINTR=%d", errno, strerror(errno), EINTR);
-                throw IOException(IOException::GENERAL);
+                NOVA_LOG_TRACE("poll was interrupted, restarting.");
+                continue;
+            }
+            NOVA_LOG_ERROR("poll returned < 0. errno = %d: %s", errno,
+                           strerror(errno));
+            throw IOException(IOException::GENERAL);
+        }
+        if (ready == 0) {
+            if (by_deadline) {
+                throw TimeOutException();
+            }
+            return boost::none;
+        }
+        for (size_t index = 0; index < count; ++ index) {
+            if (poll_fds[index].revents != 0) {
+                return index;
             }
         }
     }
-    return ready;
 }
 
-int wait_pid_with_throw(pid_t pid, int * status, int options) {
-    if (Timer::time_out_occurred()) {
-        NOVA_LOG_ERROR("Not even attempting a waitpid call as an unhandled"
-                       "time out exception is being thrown.");
-        throw TimeOutException();
-    }
-    int child_pid;
-    while(((child_pid = ::waitpid(pid, status, options)) == -1)
-          && (errno == EINTR)) {
-        if (errno == EINTR) {
-            if (Timer::time_out_occurred()) {
-                throw TimeOutException();
-            } else {
-                NOVA_LOG_ERROR("waitpid was interrupted, retrying.");
+int wait_pid_with_throw(pid_t pid, int pid_fd, int * status,
+                        optional<double> seconds, const Deadline * deadline) {
+    // Without a pidfd there's nothing to sleep on, so poll waitpid starting
+    // at a millisecond and backing off to a tenth of a second.
+    double nap = 0.001;
+    const timespec start = now();
+    while (true) {
+        int child_pid = ::waitpid(pid, status, WNOHANG);
+        if (child_pid < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-        } else {
             NOVA_LOG_ERROR("Error calling waitpid:%s", strerror(errno));
             throw IOException(IOException::WAITPID_ERROR);
         }
+        if (child_pid != 0) {
+            return child_pid;
+        }
+        optional<double> left = seconds;
+        if (seconds) {
+            left = seconds.get() - seconds_between(start, now());
+            if (left.get() <= 0) {
+                return 0;
+            }
+        }
+        if (pid_fd >= 0) {
+            if (!wait_for_readable(&pid_fd, 1, left, deadline)) {
+                return 0;
+            }
+        } else {
+            bool by_deadline;
+            optional<double> limit = time_limit(left, deadline, by_deadline);
+            const double sleep_time = limit ? std::min(nap, limit.get()) : nap;
+            const timespec sleep_spec = timespec_from_seconds(sleep_time);
+            ::nanosleep(&sleep_spec, NULL);
+            nap = std::min(nap * 2, 0.1);
+        }
     }
-    return child_pid;
 }
 
 
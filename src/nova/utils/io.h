@@ -4,6 +4,7 @@
 #include <boost/optional.hpp>
 #include <sys/select.h>
 #include <signal.h>
+#include <sys/types.h>
 #include <time.h>
 #include <boost/utility.hpp>
 #include <vector>
@@ -16,11 +17,11 @@
  *  details of how that works lives here.
  *
  *  For example, many of these functions may fail if an interrupt signal
- *  is given. However, the expectation is unless this code created an interrupt
- *  for an alarm (in which case a TimeOutException is thrown) the function
- *  should just be called again. These functions do that automatically. If
- *  the calls fail due to an error other than an interrupt, these functions
- *  will also log the error and throw an exception.
+ *  is given, in which case they should just be called again. These
+ *  functions do that automatically, throwing a TimeOutException only once
+ *  the Deadline they were given passes. If the calls fail due to an error
+ *  other than an interrupt, these functions will also log the error and
+ *  throw an exception.
  */
 namespace nova { namespace utils { namespace io {
 
@@ -59,6 +60,13 @@ class Pipe : private boost::noncopyable
             return is_open[OUT];
         }
 
+        /** Resizes the kernel buffer behind the pipe (see F_SETPIPE_SZ) so
+         *  the writer blocks less often and each read can return more.
+         *  Returns the new capacity, which the kernel may round up, or
+         *  boost::none if it couldn't be changed, for instance because
+         *  "size" is over /proc/sys/fs/pipe-max-size. */
+        boost::optional<size_t> set_capacity(size_t size);
+
     private:
 
         int fd[2];
@@ -69,30 +77,42 @@ class Pipe : private boost::noncopyable
 
 
 /**
- * Create this to cause the functions here to throw TimeOutExceptions.
- * Only one of these can be used at a time. Unexpected behavior may
- * occur if multiple timers are used at once.
+ * A point in time after which the functions here which accept one throw
+ * TimeOutExceptions. Each Process owns its own, so any number of processes
+ * can be read from and timed out at once from different threads.
+ * Deadlines are measured on the monotonic clock and are folded into the
+ * timeouts of the poll calls below, so nothing here relies on signals.
  */
-class Timer : boost::noncopyable {
+class Deadline {
     public:
-        Timer(double seconds);
+        /** Tightens a Deadline for the life of this object, then restores
+         *  whatever it was before. Scopes nest. */
+        class Scope : boost::noncopyable {
+            public:
+                Scope(Deadline & deadline, double seconds);
 
-        ~Timer();
+                ~Scope();
 
-        static void interrupt(int signal_number, siginfo_t * info,
-                              void * context);
+            private:
+                Deadline & deadline;
+                boost::optional<timespec> previous;
+        };
 
-        static void remove_interrupt_handler();
+        /** Creates a deadline which is never reached. */
+        Deadline();
 
-        static void set_interrupt_handler();
+        /** True if the deadline is set and has already passed. */
+        bool expired() const;
 
-        static bool & time_out_occurred();
+        /** Seconds left until the deadline (zero once it passes), or
+         *  boost::none if it isn't set. */
+        boost::optional<double> remaining() const;
 
-    private:
-        Timer(const Timer &);
-        Timer & operator = (const Timer &);
+        /** Sets the deadline to "seconds" from now. */
+        void set(double seconds);
 
-        timer_t id;
+    private:
+        boost::optional<timespec> when;
 };
 
 bool is_directory(const char * directory_path);
@@ -104,16 +124,27 @@ bool is_file_sans_logging(const char * file_path);
 /** Throws exceptions if errors are detected. */
 size_t read_with_throw(int fd, char * const buf, size_t count);
 
-/** Throws exceptions if errors are detected.
- * Also unblocks time out signals before proceeding and throws
- * ProcessTimeOutExceptions if they happen. */
-int select_with_throw(int nfds, fd_set * readfds, fd_set * writefds,
-                      fd_set * errorfds, boost::optional<double> seconds);
-
-
-/** Calls the waitpid function, but automatically retries in the event
- *  of an interrupt and throws TimeOutException if a time out occurs. */
-int wait_pid_with_throw(pid_t pid, int * status, int options);
+/** Opens a pidfd for the given child so its exit can be waited for with
+ *  poll. Returns -1 if the kernel is too old to support them. */
+int open_pid_fd(pid_t pid);
+
+/** Waits until one of the "count" file descriptors given is readable or has
+ *  hung up and returns its index, or returns boost::none if "seconds" pass
+ *  first (if "seconds" isn't given it waits forever). Throws a
+ *  TimeOutException if "deadline" passes first. Retries on interrupts. */
+boost::optional<size_t> wait_for_readable(const int * fds, size_t count,
+                                          boost::optional<double> seconds,
+                                          const Deadline * deadline=0);
+
+/** Waits for the child to exit and returns its pid, or returns zero if
+ *  "seconds" pass first (if "seconds" isn't given it waits forever).
+ *  If "pid_fd" is a pidfd from open_pid_fd it is polled; otherwise waitpid
+ *  is retried with WNOHANG at a slowly growing interval. Throws a
+ *  TimeOutException if "deadline" passes first and an IOException if
+ *  waitpid fails. */
+int wait_pid_with_throw(pid_t pid, int pid_fd, int * status,
+                        boost::optional<double> seconds,
+                        const Deadline * deadline=0);
 
 class IOException : public std::exception {
 
@@ -1,8 +1,14 @@
 #include "pch.hpp"
 #include "nova/utils/regex.h"
 
+#include <algorithm>
+#include <deque>
 #include <regex.h>
 #include <stdexcept>
+#include <string.h>
+
+using boost::optional;
+using std::string;
 
 namespace nova { namespace utils {
 
@@ -68,6 +74,146 @@ std::string RegexMatches::original_line() const {
 }
 
 
+/**---------------------------------------------------------------------------
+ *- PatternSet
+ *---------------------------------------------------------------------------*/
+
+namespace {
+
+    /* Each pattern is a bit in the automaton's output masks. */
+    const size_t MAX_PATTERNS = 64;
+
+    const int ALPHABET = 256;
+
+}
+
+PatternSet::PatternSet()
+:   compiled(false),
+    found_at(),
+    patterns(),
+    transitions()
+{
+}
+
+PatternSet::~PatternSet() {
+}
+
+size_t PatternSet::add(const string & text, boost::shared_ptr<Regex> regex) {
+    if (patterns.size() >= MAX_PATTERNS) {
+        throw RegexException();
+    }
+    Pattern pattern;
+    pattern.text = text;
+    pattern.regex = regex;
+    patterns.push_back(pattern);
+    compiled = false;
+    return patterns.size() - 1;
+}
+
+size_t PatternSet::add_text(const string & text) {
+    return add(text, boost::shared_ptr<Regex>());
+}
+
+size_t PatternSet::add_regex(const char * pattern,
+                             const string & required_text) {
+    boost::shared_ptr<Regex> regex(new Regex(pattern));
+    return add(required_text, regex);
+}
+
+void PatternSet::compile() {
+    // Build a trie of every pattern's text, then fill in the missing
+    // transitions breadth first from each state's failure state, which
+    // turns it into a DFA that needs one lookup per byte.
+    transitions.assign(ALPHABET, -1);
+    found_at.assign(1, 0);
+    for (size_t index = 0; index < patterns.size(); index ++) {
+        const string & text = patterns[index].text;
+        if (text.empty() && patterns[index].regex) {
+            continue;  // Always tried.
+        }
+        int state = 0;
+        for (size_t i = 0; i < text.size(); i ++) {
+            const unsigned char c = text[i];
+            if (transitions[state * ALPHABET + c] < 0) {
+                transitions[state * ALPHABET + c] = found_at.size();
+                transitions.resize(transitions.size() + ALPHABET, -1);
+                found_at.push_back(0);
+            }
+            state = transitions[state * ALPHABET + c];
+        }
+        found_at[state] |= uint64_t(1) << index;
+    }
+
+    std::vector<int> failure(found_at.size(), 0);
+    std::deque<int> queue;
+    for (int c = 0; c < ALPHABET; c ++) {
+        int & next = transitions[c];
+        if (next < 0) {
+            next = 0;
+        } else {
+            queue.push_back(next);
+        }
+    }
+    while (!queue.empty()) {
+        const int state = queue.front();
+        queue.pop_front();
+        found_at[state] |= found_at[failure[state]];
+        for (int c = 0; c < ALPHABET; c ++) {
+            int & next = transitions[state * ALPHABET + c];
+            const int fallback = transitions[failure[state] * ALPHABET + c];
+            if (next < 0) {
+                next = fallback;
+            } else {
+                failure[next] = fallback;
+                queue.push_back(next);
+            }
+        }
+    }
+    compiled = true;
+}
+
+optional<PatternSet::Match> PatternSet::match(const char * line,
+                                              size_t length, bool partial) {
+    if (!compiled) {
+        compile();
+    }
+    uint64_t found = found_at[0];
+    int state = 0;
+    for (size_t i = 0; i < length; i ++) {
+        state = transitions[state * ALPHABET + (unsigned char) line[i]];
+        found |= found_at[state];
+    }
+
+    for (size_t index = 0; index < patterns.size(); index ++) {
+        const Pattern & pattern = patterns[index];
+        const bool text_found = 0 != (found & (uint64_t(1) << index));
+        Match result;
+        result.index = index;
+        if (pattern.regex) {
+            if (partial || (!pattern.text.empty() && !text_found)) {
+                continue;
+            }
+            result.matches = pattern.regex->match(line);
+            if (!result.matches) {
+                continue;
+            }
+        } else if (text_found) {
+            const char * start = std::search(line, line + length,
+                                              pattern.text.begin(),
+                                              pattern.text.end());
+            regmatch_t * whole = new regmatch_t[1];
+            whole[0].rm_so = start - line;
+            whole[0].rm_eo = whole[0].rm_so + pattern.text.size();
+            result.matches.reset(new RegexMatches(line, whole, 1));
+        } else {
+            continue;
+        }
+        return result;
+    }
+    return boost::none;
+}
+
+
 /**---------------------------------------------------------------------------
  *- RegexException
  *---------------------------------------------------------------------------*/
@@ -1,10 +1,13 @@
 #ifndef _NOVA_UTILS_REGEX_H
 #define _NOVA_UTILS_REGEX_H
 
+#include <boost/optional.hpp>
 #include <boost/smart_ptr.hpp>
 #include <regex.h>
+#include <stdint.h>
 #include <string>
 #include <boost/utility.hpp>
+#include <vector>
 
 
 namespace nova { namespace utils {
@@ -55,6 +58,60 @@ class RegexMatches : boost::noncopyable {
 };
 
 
+/**
+ *  Matches lines against a numbered list of patterns at once.
+ *
+ *  Plain text patterns are compiled together into one automaton
+ *  (Aho-Corasick), so each line is scanned a single time however many
+ *  patterns there are. A regex can name text which every line it matches
+ *  must contain; the regex then only runs on lines where the automaton
+ *  found that text.
+ */
+class PatternSet : boost::noncopyable {
+    public:
+        struct Match {
+            size_t index;
+            RegexMatchesPtr matches;
+        };
+
+        PatternSet();
+
+        ~PatternSet();
+
+        /** Adds a pattern which matches "text" anywhere in a line. Unlike a
+         *  regex nothing in "text" is special. Returns its index. */
+        size_t add_text(const std::string & text);
+
+        /** Adds a regular expression. If "required_text" is given the regex
+         *  is only tried on lines containing it. Returns its index. */
+        size_t add_regex(const char * pattern,
+                         const std::string & required_text="");
+
+        /** Returns the lowest numbered pattern matching "line", which must be
+         *  null terminated at "length". If "partial" is true the line may
+         *  not have ended yet, so only text patterns are tried; a regex
+         *  could capture something different once the rest arrives. For
+         *  text patterns only the whole match (index 0) is available. */
+        boost::optional<Match> match(const char * line, size_t length,
+                                     bool partial=false);
+
+    private:
+        struct Pattern {
+            std::string text;
+            boost::shared_ptr<Regex> regex;
+        };
+
+        bool compiled;
+        std::vector<uint64_t> found_at;
+        std::vector<Pattern> patterns;
+        std::vector<int> transitions;
+
+        size_t add(const std::string & text, boost::shared_ptr<Regex> regex);
+
+        void compile();
+};
+
+
 class RegexException : public std::exception {
 
     public:
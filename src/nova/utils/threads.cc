@@ -1,6 +1,10 @@
 #include "pch.hpp"
 #include "threads.h"
+#include <boost/foreach.hpp>
 #include "../Log.h"
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
 namespace nova { namespace utils {
 
@@ -102,35 +106,66 @@ const char * ThreadException::what() const throw() {
  *- ThreadBasedJobRunner
  *---------------------------------------------------------------------------*/
 
-ThreadBasedJobRunner::ThreadBasedJobRunner()
+namespace {
+
+    using boost::posix_time::microsec_clock;
+    using boost::posix_time::ptime;
+
+    ptime now() {
+        return microsec_clock::universal_time();
+    }
+
+}
+
+ThreadBasedJobRunner::ThreadBasedJobRunner(size_t max_queued_jobs,
+                                           size_t worker_count)
 :   condition(),
-    job(0),
+    max_queued_jobs(max_queued_jobs),
     mutex(),
-    shutdown_completed(false),
-    shutdown_requested(false)
+    next_id(1),
+    queue(),
+    running(),
+    shutdown_requested(false),
+    worker_count(worker_count),
+    workers_finished(0)
 {
 }
 
 ThreadBasedJobRunner::~ThreadBasedJobRunner() {
-    if (0 != job) {
+    if (!running.empty()) {
         NOVA_LOG_ERROR("Destroying the job runner, but the last job was never "
                        "finished!");
-        delete job;
-        job = 0;
+    }
+    BOOST_FOREACH(Queue::value_type & item, queue) {
+        delete item.second.job;
     }
 }
 
-void ThreadBasedJobRunner::execute_job() {
-    if (0 == job) {
-        NOVA_LOG_ERROR("Error- can't execute null job!");
-        return;
+bool ThreadBasedJobRunner::cancel(JobId id) {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    for (Queue::iterator itr = queue.begin(); itr != queue.end(); ++ itr) {
+        if (itr->second.id == id) {
+            NOVA_LOG_INFO("Cancelling job %d before it started.", id);
+            delete itr->second.job;
+            queue.erase(itr);
+            return true;
+        }
     }
-    NOVA_LOG_INFO("Running job!");
+    std::map<JobId, Entry>::iterator found = running.find(id);
+    if (found != running.end()) {
+        NOVA_LOG_INFO("Asking running job %d to stop.", id);
+        return found->second.job->cancel();
+    }
+    return false;
+}
+
+void ThreadBasedJobRunner::execute_job(Entry & entry) {
+    NOVA_LOG_INFO("Running job %d (%s)!", entry.id, entry.job->describe());
 #ifndef _DEBUG
     try {
 #endif
-        (*job)();
-        NOVA_LOG_INFO("Job finished successfully.");
+        (*entry.job)();
+        NOVA_LOG_INFO("Job %d finished successfully.", entry.id);
 #ifndef _DEBUG
     } catch (const std::exception & e) {
         NOVA_LOG_ERROR("Error running job!: %s", e.what());
@@ -138,31 +173,38 @@ void ThreadBasedJobRunner::execute_job() {
         NOVA_LOG_ERROR("Error executing job! Exception type unknown.");
     }
 #endif
-    {
-        boost::lock_guard<boost::mutex> lock(mutex);
-        delete job;  // Kill job variable.
-        job = 0;
-    }
 }
 
 void ThreadBasedJobRunner::operator()() {
     NOVA_LOG_INFO("Starting Job Runner thread...");
-    while(!is_shutdown_requested()) {
-        NOVA_LOG_INFO("Waiting for job...");
+    while(true) {
+        Entry entry;
         {
-            while (_is_idle() && !is_shutdown_requested()) {
-                boost::posix_time::seconds time(1);
-                boost::this_thread::sleep(time);
+            boost::unique_lock<boost::mutex> lock(mutex);
+            NOVA_LOG_INFO("Waiting for job...");
+            while (queue.empty() && !shutdown_requested) {
+                condition.wait(lock);
             }
+            if (shutdown_requested) {
+                break;
+            }
+            entry = queue.begin()->second;
+            queue.erase(queue.begin());
+            entry.started_at = now();
+            running[entry.id] = entry;
         }
-        if (!is_shutdown_requested()) {
-            execute_job();
+        execute_job(entry);
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            running.erase(entry.id);
+            delete entry.job;
         }
     }
-    {
-        boost::lock_guard<boost::mutex> lock(mutex);
-        shutdown_completed = true;
-    }
+    // Notify while holding the lock, since once it's released shutdown()
+    // may return and the runner be destroyed.
+    boost::lock_guard<boost::mutex> lock(mutex);
+    ++ workers_finished;
+    condition.notify_all();
 }
 
 bool ThreadBasedJobRunner::is_idle() {
@@ -171,46 +213,267 @@ bool ThreadBasedJobRunner::is_idle() {
 }
 
 bool ThreadBasedJobRunner::_is_idle() {
-    return 0 == job;
+    return queue.empty() && running.empty();
 }
 
-bool ThreadBasedJobRunner::is_shutdown_completed() {
+std::list<JobInfo> ThreadBasedJobRunner::list_jobs() {
     boost::lock_guard<boost::mutex> lock(mutex);
-    return shutdown_completed;
+    const ptime current = now();
+    std::list<JobInfo> jobs;
+    for (std::map<JobId, Entry>::const_iterator itr = running.begin();
+         itr != running.end(); ++ itr) {
+        const Entry & entry = itr->second;
+        JobInfo info;
+        info.id = entry.id;
+        info.description = entry.job->describe();
+        info.priority = entry.priority;
+        info.queued_at = entry.queued_at;
+        info.started_at = entry.started_at;
+        info.elapsed_seconds = (current - entry.started_at)
+            .total_microseconds() / 1000000.0;
+        jobs.push_back(info);
+    }
+    for (Queue::const_iterator itr = queue.begin(); itr != queue.end();
+         ++ itr) {
+        const Entry & entry = itr->second;
+        JobInfo info;
+        info.id = entry.id;
+        info.description = entry.job->describe();
+        info.priority = entry.priority;
+        info.queued_at = entry.queued_at;
+        info.elapsed_seconds = 0.0;
+        jobs.push_back(info);
+    }
+    return jobs;
 }
 
-bool ThreadBasedJobRunner::is_shutdown_requested() {
-    boost::lock_guard<boost::mutex> lock(mutex);
-    return shutdown_requested;
+bool ThreadBasedJobRunner::run(const Job & job) {
+    return !!run(job, 0);
 }
 
-bool ThreadBasedJobRunner::run(const Job & job) {
+boost::optional<JobId> ThreadBasedJobRunner::run(const Job & job,
+                                                 int priority) {
+    Entry entry;
     {
         boost::lock_guard<boost::mutex> lock(mutex);
-        if (!_is_idle()) {
-            NOVA_LOG_INFO("Can't run job because thread isn't idle.");
-            return false;
+        // Jobs which a free worker will start right away don't count
+        // against the limit.
+        const size_t free_workers = worker_count > running.size()
+            ? worker_count - running.size() : 0;
+        if (queue.size() >= max_queued_jobs + free_workers) {
+            NOVA_LOG_INFO("Can't run job because the queue is full.");
+            return boost::none;
         }
-        this->job = job.clone();
+        entry.id = next_id ++;
+        entry.job = job.clone();
+        entry.priority = priority;
+        entry.queued_at = now();
+        queue[std::make_pair(-priority, entry.id)] = entry;
     }
     condition.notify_one();
-    return true;
+    return entry.id;
 }
 
 void ThreadBasedJobRunner::shutdown() {
-    {
-        boost::lock_guard<boost::mutex> lock(mutex);
-        shutdown_requested = true;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    shutdown_requested = true;
+    condition.notify_all();
+    while (workers_finished < worker_count) {
+        condition.wait(lock);
+    }
+    if (!queue.empty()) {
+        NOVA_LOG_INFO("Dropping %d jobs which never started.", queue.size());
+    }
+}
+
+
+/**---------------------------------------------------------------------------
+ *- PeriodicScheduler
+ *---------------------------------------------------------------------------*/
+
+PeriodicScheduler::PeriodicScheduler(size_t stack_size, double tick_seconds,
+                                     size_t wheel_size)
+:   condition(),
+    current_slot(0),
+    entries(),
+    mutex(),
+    seed((unsigned int) time(0) ^ (unsigned int) getpid()),
+    shutdown_requested(false),
+    slots(wheel_size),
+    stack_size(stack_size),
+    threads_finished(0),
+    tick_seconds(tick_seconds)
+{
+}
+
+PeriodicScheduler::~PeriodicScheduler() {
+}
+
+void PeriodicScheduler::add(const std::string & name, PeriodicTaskPtr task,
+                            double interval, double jitter) {
+    boost::shared_ptr<Entry> entry(new Entry());
+    entry->task = task;
+    entry->jitter = jitter;
+    entry->pending = false;
+    entry->runner.reset(new TaskThread(*this, *entry));
+    entry->running = false;
+    entry->rounds = 0;
+    entry->stats.name = name;
+    entry->stats.interval = interval;
+    entry->stats.runs = 0;
+    entry->stats.skipped = 0;
+    entry->stats.last_duration = 0.0;
+    entry->stats.max_duration = 0.0;
+    entry->stats.total_duration = 0.0;
+    boost::lock_guard<boost::mutex> lock(mutex);
+    entries.push_back(entry);
+    schedule(*entry);
+}
+
+void PeriodicScheduler::fire(Entry & entry) {
+    if (entry.running || entry.pending) {
+        ++ entry.stats.skipped;
+        NOVA_LOG_ERROR("Periodic task %s is still running, so skipping it. "
+                       "(skipped %d times so far)", entry.stats.name,
+                       entry.stats.skipped);
+        return;
     }
-    while(!is_shutdown_completed()) {
-        boost::posix_time::seconds time(1);
-        boost::this_thread::sleep(time);
+    entry.pending = true;
+    condition.notify_all();
+}
+
+std::vector<PeriodicTaskStats> PeriodicScheduler::get_stats() {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    std::vector<PeriodicTaskStats> stats;
+    BOOST_FOREACH(const boost::shared_ptr<Entry> & entry, entries) {
+        stats.push_back(entry->stats);
     }
+    return stats;
+}
 
+void PeriodicScheduler::operator()() {
+    NOVA_LOG_INFO("Starting periodic task threads...");
     {
         boost::lock_guard<boost::mutex> lock(mutex);
-        shutdown_completed = true;
+        BOOST_FOREACH(boost::shared_ptr<Entry> & entry, entries) {
+            entry->thread.reset(new Thread(stack_size, *entry->runner));
+        }
     }
+    const boost::posix_time::time_duration tick =
+        boost::posix_time::microseconds((long) (tick_seconds * 1000000));
+    boost::system_time next_tick = boost::get_system_time();
+    while(true) {
+        next_tick += tick;
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!shutdown_requested
+               && condition.timed_wait(lock, next_tick)) {
+            // Woken for some other reason; keep waiting out the tick.
+        }
+        if (shutdown_requested) {
+            break;
+        }
+        current_slot = (current_slot + 1) % slots.size();
+        std::list<Entry *> due;
+        due.swap(slots[current_slot]);
+        BOOST_FOREACH(Entry * entry, due) {
+            if (entry->rounds > 0) {
+                -- entry->rounds;
+                slots[current_slot].push_back(entry);
+            } else {
+                fire(*entry);
+                schedule(*entry);
+            }
+        }
+    }
+    thread_finished();
+}
+
+void PeriodicScheduler::run_task(Entry & entry) {
+    while(true) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!entry.pending && !shutdown_requested) {
+                condition.wait(lock);
+            }
+            if (shutdown_requested) {
+                break;
+            }
+            entry.pending = false;
+            entry.running = true;
+        }
+        NOVA_LOG_TRACE("Running periodic task %s...", entry.stats.name);
+        const boost::posix_time::ptime start =
+            boost::posix_time::microsec_clock::universal_time();
+        try {
+            (*entry.task)();
+        } catch(const std::exception & e) {
+            NOVA_LOG_ERROR("Error in periodic task %s! : %s",
+                           entry.stats.name, e.what());
+        } catch(...) {
+            NOVA_LOG_ERROR("Error in periodic task %s! Exception type "
+                           "unknown.", entry.stats.name);
+        }
+        const double duration =
+            (boost::posix_time::microsec_clock::universal_time() - start)
+            .total_microseconds() / 1000000.0;
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            entry.running = false;
+            ++ entry.stats.runs;
+            entry.stats.last_duration = duration;
+            entry.stats.total_duration += duration;
+            if (duration > entry.stats.max_duration) {
+                entry.stats.max_duration = duration;
+            }
+        }
+        if (duration > entry.stats.interval) {
+            NOVA_LOG_ERROR("Periodic task %s took %f seconds, longer than its "
+                           "interval of %f.", entry.stats.name, duration,
+                           entry.stats.interval);
+        }
+    }
+    thread_finished();
+}
+
+void PeriodicScheduler::schedule(Entry & entry) {
+    double delay = entry.stats.interval;
+    if (entry.jitter > 0) {
+        delay += entry.jitter * (2.0 * rand_r(&seed) / RAND_MAX - 1.0);
+    }
+    size_t ticks = (size_t) (delay / tick_seconds + 0.5);
+    if (ticks < 1) {
+        ticks = 1;
+    }
+    entry.rounds = (ticks - 1) / slots.size();
+    slots[(current_slot + ticks) % slots.size()].push_back(&entry);
+}
+
+void PeriodicScheduler::shutdown() {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    shutdown_requested = true;
+    condition.notify_all();
+    // The timer thread plus one for each task.
+    while (threads_finished < entries.size() + 1) {
+        condition.wait(lock);
+    }
+}
+
+void PeriodicScheduler::thread_finished() {
+    // As with the job runner, notify while holding the lock.
+    boost::lock_guard<boost::mutex> lock(mutex);
+    ++ threads_finished;
+    condition.notify_all();
+}
+
+PeriodicScheduler::TaskThread::TaskThread(PeriodicScheduler & scheduler,
+                                          Entry & entry)
+:   scheduler(scheduler),
+    entry(entry)
+{
+}
+
+void PeriodicScheduler::TaskThread::operator()() {
+    scheduler.run_task(entry);
 }
 
 
@@ -2,10 +2,16 @@
 #define _NOVA_UTILS_THREADS_H
 
 #include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <functional>
+#include <list>
+#include <map>
+#include <boost/optional.hpp>
 #include <pthread.h>
 #include <boost/shared_ptr.hpp>
+#include <string>
 #include <boost/utility.hpp>
+#include <vector>
 
 
 namespace nova { namespace utils {
@@ -67,6 +73,18 @@ public:
     virtual void operator()() = 0;
 
     virtual Job * clone() const = 0;
+
+    /* Asks a running job to stop early. This is called from a different
+     * thread than the one running the job. Returns true if the job will
+     * stop; by default jobs can't be cancelled once they've started. */
+    virtual bool cancel() {
+        return false;
+    }
+
+    /* A short description used when listing jobs. */
+    virtual std::string describe() const {
+        return "job";
+    }
 };
 
 
@@ -81,46 +99,224 @@ public:
 };
 
 
-/* A class which operates a job runner on another thread. */
+typedef unsigned long JobId;
+
+/* A snapshot of a job which is waiting or running. */
+struct JobInfo {
+    JobId id;
+    std::string description;
+    int priority;
+    boost::posix_time::ptime queued_at;
+    /* Set once the job starts running. */
+    boost::optional<boost::posix_time::ptime> started_at;
+    /* Seconds spent running so far, or zero if the job hasn't started. */
+    double elapsed_seconds;
+
+    bool is_running() const {
+        return !!started_at;
+    }
+};
+
+
+/* A class which runs jobs on other threads. Jobs wait in a queue ordered by
+ * priority (higher goes first, then first come first served) until one of
+ * the worker threads is free. A worker is a Thread started with this
+ * object as its Runner; as many must be started as "worker_count". */
 class ThreadBasedJobRunner
 :   public JobRunner,
     public Thread::Runner,
     private boost::noncopyable
 {
 public:
-    ThreadBasedJobRunner();
+    /* "max_queued_jobs" is how many jobs may wait for a worker beyond those
+     * which can start right away. With the defaults only one job is taken at
+     * a time and others are refused until it finishes. */
+    ThreadBasedJobRunner(size_t max_queued_jobs=0, size_t worker_count=1);
 
     virtual ~ThreadBasedJobRunner();
 
+    /* Removes a waiting job, or asks a running one to stop (see
+     * Job::cancel). Returns true if the job won't run or will stop. */
+    bool cancel(JobId id);
+
+    /* True if no jobs are waiting or running. */
     virtual bool is_idle();
 
+    /* Lists the running jobs followed by those waiting, in the order they
+     * will run. */
+    std::list<JobInfo> list_jobs();
+
+    /* The main routine of each worker thread. */
     virtual void operator()();
 
+    /* Queues a copy of the job with normal priority. Returns false if the
+     * queue is full. */
     virtual bool run(const Job & job);
 
-    /* Shuts down the runner, causing its thread to exit.
+    /* Queues a copy of the job, returning its id, or boost::none if the
+     * queue is full. */
+    boost::optional<JobId> run(const Job & job, int priority);
+
+    /* Shuts down the runner, causing its threads to exit after any jobs
+     * they're running finish. Jobs which haven't started are dropped.
      * This is not a big deal in production but is necessary for unit tests. */
     void shutdown();
+
+    size_t get_worker_count() const {
+        return worker_count;
+    }
+
 private:
+    struct Entry {
+        JobId id;
+        Job * job;
+        int priority;
+        boost::posix_time::ptime queued_at;
+        boost::posix_time::ptime started_at;
+    };
+
+    /* Ordered by negated priority and then id. */
+    typedef std::map<std::pair<int, JobId>, Entry> Queue;
+
     boost::condition_variable condition;
 
-    void execute_job();
+    void execute_job(Entry & entry);
 
     bool _is_idle();
 
-    Job * job;
+    const size_t max_queued_jobs;
 
     boost::mutex mutex;
 
-    // True if the main routine has finished.
-    bool is_shutdown_completed();
+    JobId next_id;
+
+    Queue queue;
+
+    std::map<JobId, Entry> running;
+
+    bool shutdown_requested;
+
+    const size_t worker_count;
+
+    size_t workers_finished;
+};
+
+
+
+/* Something a PeriodicScheduler runs over and over. */
+class PeriodicTask {
+public:
+    virtual ~PeriodicTask()
+    {
+    }
+
+    virtual void operator()() = 0;
+};
+
+typedef boost::shared_ptr<PeriodicTask> PeriodicTaskPtr;
+
+
+/* How a PeriodicScheduler's task has behaved so far. Durations are in
+ * seconds. */
+struct PeriodicTaskStats {
+    std::string name;
+    double interval;
+    unsigned long runs;
+    /* Times the task came due while it was still running and so was
+     * skipped. */
+    unsigned long skipped;
+    double last_duration;
+    double max_duration;
+    double total_duration;
+};
+
+
+/* Runs tasks, each at its own interval, from a hashed timer wheel.
+ *
+ * The thread running the scheduler only keeps time; each task gets a
+ * thread of its own, so a slow task never holds up the others. If a task is
+ * still running when it comes due again that run is skipped rather than
+ * queued up behind it. Timing is accurate to "tick_seconds". */
+class PeriodicScheduler
+:   public Thread::Runner,
+    private boost::noncopyable
+{
+public:
+    PeriodicScheduler(size_t stack_size, double tick_seconds=0.5,
+                      size_t wheel_size=256);
+
+    virtual ~PeriodicScheduler();
+
+    /* Runs "task" every "interval" seconds, the first time "interval"
+     * seconds after the scheduler starts. Each run is moved by a random
+     * amount of up to "jitter" seconds either way so tasks sharing an
+     * interval don't all wake at once. Tasks must be added before the
+     * scheduler's thread starts. */
+    void add(const std::string & name, PeriodicTaskPtr task,
+             double interval, double jitter=0.0);
+
+    std::vector<PeriodicTaskStats> get_stats();
+
+    /* Starts each task's thread, then turns the wheel until shut down. */
+    virtual void operator()();
+
+    /* Stops the scheduler and waits for its threads to exit, which means
+     * waiting for any task which is running to finish. */
+    void shutdown();
+
+private:
+    struct Entry;
+
+    class TaskThread : public Thread::Runner {
+    public:
+        TaskThread(PeriodicScheduler & scheduler, Entry & entry);
+
+        virtual void operator()();
 
-    // True if the main routine is currently running.
-    bool is_shutdown_requested();
+    private:
+        PeriodicScheduler & scheduler;
+        Entry & entry;
+    };
+
+    struct Entry {
+        PeriodicTaskPtr task;
+        double jitter;
+        bool pending;
+        boost::shared_ptr<TaskThread> runner;
+        bool running;
+        /* Full turns of the wheel left before the task is due. */
+        size_t rounds;
+        PeriodicTaskStats stats;
+        boost::shared_ptr<Thread> thread;
+    };
+
+    boost::condition_variable condition;
+
+    size_t current_slot;
+
+    std::vector<boost::shared_ptr<Entry> > entries;
+
+    boost::mutex mutex;
 
-    bool shutdown_completed;
+    unsigned int seed;
 
     bool shutdown_requested;
+
+    std::vector<std::list<Entry *> > slots;
+
+    const size_t stack_size;
+
+    size_t threads_finished;
+
+    const double tick_seconds;
+
+    void fire(Entry & entry);
+
+    void run_task(Entry & entry);
+
+    void schedule(Entry & entry);
+
+    void thread_finished();
 };
 
 
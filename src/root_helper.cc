@@ -0,0 +1,27 @@
+#include "pch.hpp"
+#include <fcntl.h>
+#include "nova/Log.h"
+#include "nova/sudo.h"
+#include <unistd.h>
+
+/* The long lived process the agent launches through sudo once at start up.
+ * The agent's end of a socketpair arrives as both stdin and stdout; stdout
+ * is pointed back at stderr so log messages can't corrupt the protocol. */
+int main(int argc, char* argv[]) {
+    const int socket_fd = dup(STDIN_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    const int dev_null = open("/dev/null", O_RDONLY);
+    if (dev_null >= 0) {
+        dup2(dev_null, STDIN_FILENO);
+        close(dev_null);
+    }
+
+    nova::LogApiScope log(nova::LogOptions::simple());
+    try {
+        nova::process::serve_root_helper_requests(socket_fd);
+    } catch(const std::exception & e) {
+        NOVA_LOG_ERROR("Root helper failed: %s", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -3,16 +3,22 @@
 
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
 #include <fstream>
 #include <iostream>
+#include "nova/json.h"
 #include "nova/Log.h"
 #include "nova/utils/regex.h"
 #include <string>
 #include <boost/thread.hpp>
 #include <vector>
+#include <zlib.h>
 
 // Confirm the macros works everywhere by not using nova::Log.
 using boost::format;
+using nova::JsonObject;
+using nova::JsonObjectPtr;
+using nova::LogAsyncOptions;
 using nova::LogException;
 using nova::LogFileOptions;
 using nova::LogOptions;
@@ -49,6 +55,29 @@ BOOST_AUTO_TEST_CASE(should_throw_if_uninitialized)
 }
 
 
+namespace {
+    int evaluations = 0;
+
+    int count_evaluation() {
+        return ++ evaluations;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(disabled_levels_skip_formatting_arguments)
+{
+    LogOptions options(boost::none, false, false);
+    options.show_debug = false;
+    nova::Log::initialize(options);
+    NOVA_LOG_TRACE("%d", count_evaluation());
+    NOVA_LOG_DEBUG("%d", count_evaluation());
+    BOOST_CHECK_EQUAL(evaluations, 0);
+    NOVA_LOG_INFO("%d", count_evaluation());
+    NOVA_LOG_ERROR("%d", count_evaluation());
+    BOOST_CHECK_EQUAL(evaluations, 2);
+    nova::Log::shutdown();
+}
+
+
 static int test_count = 0;
 
 struct LogTestsFixture {
@@ -56,7 +85,9 @@ struct LogTestsFixture {
     string log_file;
 
     LogTestsFixture(boost::optional<double> max_time_in_seconds=boost::none,
-                    bool test_append=false)
+                    bool test_append=false,
+                    optional<LogAsyncOptions> async=boost::none,
+                    bool json_lines=false)
     : log_file()
     {
         if (test_append) {
@@ -70,7 +101,9 @@ struct LogTestsFixture {
         }
         LogFileOptions file_options(log_file, boost::optional<size_t>(10000),
                     max_time_in_seconds, 3);
-        LogOptions options(optional<LogFileOptions>(file_options), false, false);
+        LogOptions options(optional<LogFileOptions>(file_options), false, false,
+                           async);
+        options.json_lines = json_lines;
         nova::Log::initialize(options);
         ++ test_count;
     }
@@ -216,6 +249,185 @@ BOOST_AUTO_TEST_CASE(writing_some_lines_and_rotating) {
 
 }
 
+BOOST_AUTO_TEST_CASE(writing_some_lines_asynchronously) {
+    LogTestsFixture log_fixture(boost::none, false,
+        LogAsyncOptions(2, LogAsyncOptions::BLOCK));
+    NOVA_LOG_DEBUG("Hello from the tests. How're you doing?");
+    NOVA_LOG_ERROR("Hi");
+    {
+        // Errors don't return until they, and everything before them, are
+        // in the file.
+        vector<string> lines;
+        log_fixture.read_file(lines);
+        BOOST_REQUIRE_EQUAL(lines.size(), 3u);
+    }
+    NOVA_LOG_INFO("Bye");
+    nova::Log::get_instance()->flush();
+
+    vector<string> lines;
+    log_fixture.read_file(lines);
+    check_expected_data_written(lines, "writing_some_lines_asynchronously");
+}
+
+BOOST_AUTO_TEST_CASE(writing_json_lines) {
+    LogTestsFixture log_fixture(boost::none, false, boost::none, true);
+    NOVA_LOG_INFO("Say \"%s\"\n", "hi");
+    NOVA_LOG_ERROR("Bye");
+
+    vector<string> lines;
+    log_fixture.read_file(lines);
+    BOOST_REQUIRE_EQUAL(lines.size(), 3u);
+    JsonObject first(lines[0].c_str());
+    BOOST_CHECK_EQUAL(first.get_string("level"), "INFO");
+    BOOST_CHECK_EQUAL(first.get_string("message"), "Say \"hi\"\n");
+    BOOST_CHECK_EQUAL(first.get_string("file"), "tests/log_tests.cc");
+    BOOST_CHECK(first.get_int("line") > 0);
+    Regex time_regex("^[0-9]{4}-[0-9]{2}-[0-9]{2} [0-9]{2}:[0-9]{2}:[0-9]{2}$");
+    BOOST_CHECK(!!time_regex.match(first.get_string("time")));
+    BOOST_CHECK(!first.has_item("fields"));
+    JsonObject second(lines[1].c_str());
+    BOOST_CHECK_EQUAL(second.get_string("level"), "ERROR");
+    BOOST_CHECK_EQUAL(second.get_string("thread"), first.get_string("thread"));
+}
+
+BOOST_AUTO_TEST_CASE(json_lines_include_fields_in_scope) {
+    LogTestsFixture log_fixture(boost::none, false, boost::none, true);
+    {
+        nova::LogFieldScope method("method", "prepare");
+        {
+            nova::LogFieldScope user("user", "\"quoted\"");
+            NOVA_LOG_INFO("inner");
+        }
+        NOVA_LOG_INFO("outer");
+    }
+    NOVA_LOG_INFO("none");
+    nova::Log::get_instance()->flush();
+
+    vector<string> lines;
+    log_fixture.read_file(lines);
+    BOOST_REQUIRE_EQUAL(lines.size(), 4u);
+    JsonObjectPtr inner = JsonObject(lines[0].c_str()).get_object("fields");
+    BOOST_CHECK_EQUAL(inner->get_string("method"), "prepare");
+    BOOST_CHECK_EQUAL(inner->get_string("user"), "\"quoted\"");
+    JsonObjectPtr outer = JsonObject(lines[1].c_str()).get_object("fields");
+    BOOST_CHECK_EQUAL(outer->get_string("method"), "prepare");
+    BOOST_CHECK(!outer->has_item("user"));
+    BOOST_CHECK(!JsonObject(lines[2].c_str()).has_item("fields"));
+}
+
+BOOST_AUTO_TEST_CASE(asynchronous_log_accounts_for_dropped_lines) {
+    LogTestsFixture log_fixture(boost::none, false,
+        LogAsyncOptions(1, LogAsyncOptions::DROP));
+    const int line_count = 1000;
+    for (int i = 0; i < line_count; ++ i) {
+        NOVA_LOG_DEBUG("line %d", i);
+    }
+    nova::Log::get_instance()->flush();
+
+    vector<string> lines;
+    log_fixture.read_file(lines);
+    Regex dropped_regex("ERROR ([0-9]+) log lines were dropped");
+    int accounted_for = 0;
+    BOOST_FOREACH(const string & line, lines) {
+        RegexMatchesPtr matches = dropped_regex.match(line.c_str());
+        if (matches) {
+            accounted_for += boost::lexical_cast<int>(matches->get(1));
+        } else if (line.find("DEBUG line ") != string::npos) {
+            ++ accounted_for;
+        }
+    }
+    BOOST_CHECK_EQUAL(accounted_for, line_count);
+}
+
+struct AsyncLineWriter {
+    int id;
+    int line_count;
+
+    AsyncLineWriter(int id, int line_count) : id(id), line_count(line_count) {
+    }
+
+    void operator()() {
+        for (int i = 0; i < line_count; ++ i) {
+            NOVA_LOG_INFO("writer=%d line=%d", id, i);
+        }
+    }
+};
+
+BOOST_AUTO_TEST_CASE(asynchronous_log_keeps_every_line_from_many_threads) {
+    LogTestsFixture log_fixture(boost::none, false,
+        LogAsyncOptions(4, LogAsyncOptions::BLOCK));
+    const int writer_count = 4;
+    const int line_count = 500;
+    boost::thread_group threads;
+    for (int id = 0; id < writer_count; ++ id) {
+        threads.create_thread(AsyncLineWriter(id, line_count));
+    }
+    threads.join_all();
+    nova::Log::get_instance()->flush();
+
+    vector<string> lines;
+    log_fixture.read_file(lines);
+    Regex line_regex("writer=([0-9]+) line=([0-9]+)");
+    vector<int> next_line(writer_count, 0);
+    BOOST_FOREACH(const string & line, lines) {
+        RegexMatchesPtr matches = line_regex.match(line.c_str());
+        if (matches) {
+            const int id = boost::lexical_cast<int>(matches->get(1));
+            // Each thread's lines arrive once and in the order logged.
+            BOOST_CHECK_EQUAL(boost::lexical_cast<int>(matches->get(2)),
+                              next_line[id]);
+            ++ next_line[id];
+        }
+    }
+    for (int id = 0; id < writer_count; ++ id) {
+        BOOST_CHECK_EQUAL(next_line[id], line_count);
+    }
+}
+
+namespace {
+    string read_gzip_file(const string & path) {
+        string contents;
+        gzFile file = gzopen(path.c_str(), "rb");
+        BOOST_REQUIRE_MESSAGE(file != NULL, "Could not open " + path);
+        char buffer[256];
+        int count;
+        while ((count = gzread(file, buffer, sizeof(buffer))) > 0) {
+            contents.append(buffer, count);
+        }
+        gzclose(file);
+        return contents;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rotated_files_are_compressed) {
+    const string log_file("bin/log_tests_compressed");
+    remove(log_file.c_str());
+    remove((log_file + ".1.gz").c_str());
+    remove((log_file + ".2.gz").c_str());
+    LogFileOptions file_options(log_file, optional<size_t>(100), boost::none,
+                                3, true);
+    nova::Log::initialize(LogOptions(optional<LogFileOptions>(file_options),
+                                     false, false));
+    NOVA_LOG_INFO("first");
+    BOOST_CHECK(!nova::Log::get_instance()->should_rotate_logs());
+    NOVA_LOG_INFO("first again");
+    // The size is tracked as lines are written, not read from the disk.
+    BOOST_CHECK(nova::Log::get_instance()->should_rotate_logs());
+    nova::Log::rotate_logs_if_needed();
+    NOVA_LOG_INFO("second");
+    nova::Log::rotate_files();
+    nova::Log::wait_for_log_compression();
+
+    BOOST_CHECK(!std::ifstream((log_file + ".1").c_str()).is_open());
+    BOOST_CHECK(!std::ifstream((log_file + ".2").c_str()).is_open());
+    const string newer = read_gzip_file(log_file + ".1.gz");
+    BOOST_CHECK(newer.find("INFO  second") != string::npos);
+    const string older = read_gzip_file(log_file + ".2.gz");
+    BOOST_CHECK(older.find("INFO  first for") != string::npos);
+    BOOST_CHECK(older.find("INFO  first again") != string::npos);
+    nova::Log::shutdown();
+}
+
 struct Worker {
     int id;
     char stage;
@@ -7,6 +7,7 @@
 #include "nova/datastores/DatastoreStatus.h"
 #include "nova/rpc/sender.h"
 #include "nova/guest/utils.h"
+#include <boost/thread.hpp>
 
 using namespace nova::flags;
 using nova::guest::utils::IsoDateTime;
@@ -40,16 +41,20 @@ BOOST_GLOBAL_FIXTURE(GlobalFixture);
  *  figure out the status of a locally running app. */
 class TestDatastoreStatus : public DatastoreStatus {
     public:
-        TestDatastoreStatus(bool is_installed)
-        : DatastoreStatus(ResilientSenderPtr(), is_installed),
+        TestDatastoreStatus(bool is_installed, double heartbeat_interval=0)
+        : DatastoreStatus(ResilientSenderPtr(), is_installed,
+                          heartbeat_interval),
           last_sent_status(),
-          next_determined_status(DatastoreStatus::RUNNING) {
+          next_determined_status(DatastoreStatus::RUNNING),
+          send_count(0) {
         }
 
         optional<Status> last_sent_status;
 
         Status next_determined_status;
 
+        int send_count;
+
     protected:
         virtual Status determine_actual_status() const {
             return next_determined_status;
@@ -57,6 +62,7 @@ class TestDatastoreStatus : public DatastoreStatus {
 
         virtual void set_status(Status status) {
             last_sent_status = status;
+            send_count += 1;
         }
 };
 
@@ -85,6 +91,70 @@ BOOST_AUTO_TEST_CASE(typical_happy_instance_path) {
     BOOST_REQUIRE_EQUAL(updater.last_sent_status, DatastoreStatus::RUNNING);
 }
 
+BOOST_AUTO_TEST_CASE(unchanged_statuses_wait_for_the_heartbeat_interval) {
+    TestDatastoreStatus updater(true, 0.5);
+    updater.update();
+    updater.update();
+    updater.update();
+    BOOST_CHECK_EQUAL(updater.send_count, 1);
+
+    // Changes go out right away.
+    updater.next_determined_status = DatastoreStatus::SHUTDOWN;
+    updater.update();
+    BOOST_CHECK_EQUAL(updater.send_count, 2);
+    BOOST_CHECK_EQUAL(updater.last_sent_status.get(),
+                      DatastoreStatus::SHUTDOWN);
+    updater.update();
+    BOOST_CHECK_EQUAL(updater.send_count, 2);
+
+    // So do explicit transitions, even if nothing changed.
+    updater.end_install_or_restart();
+    BOOST_CHECK_EQUAL(updater.send_count, 3);
+
+    // Once the interval passes the same status is sent again.
+    boost::this_thread::sleep(boost::posix_time::milliseconds(600));
+    updater.update();
+    BOOST_CHECK_EQUAL(updater.send_count, 4);
+}
+
+BOOST_AUTO_TEST_CASE(waiting_for_a_status_change) {
+    // Pretends the app comes up on the third check. Each wait also reports
+    // the status the way the periodic task would, which would deadlock if
+    // the wait held on to the status lock.
+    struct Updater : public TestDatastoreStatus {
+        int waits;
+
+        Updater()
+        :   TestDatastoreStatus(true),
+            waits(0) {
+            next_determined_status = DatastoreStatus::SHUTDOWN;
+        }
+
+        virtual bool wait_for_status_change(double seconds) const {
+            Updater * mutable_this = const_cast<Updater *>(this);
+            mutable_this->waits += 1;
+            mutable_this->update();
+            if (waits == 2) {
+                mutable_this->next_determined_status = DatastoreStatus::RUNNING;
+            }
+            return true;
+        }
+    } updater;
+
+    BOOST_REQUIRE(updater.wait_for_real_state_to_change_to(
+        DatastoreStatus::RUNNING, 60, false));
+    BOOST_CHECK_EQUAL(updater.waits, 2);
+    BOOST_CHECK_EQUAL(updater.last_sent_status.get(),
+                      DatastoreStatus::SHUTDOWN);
+
+    // When the status already matches there's no waiting at all.
+    BOOST_REQUIRE(updater.wait_for_real_state_to_change_to(
+        DatastoreStatus::RUNNING, 60, true));
+    BOOST_CHECK_EQUAL(updater.waits, 2);
+    BOOST_CHECK_EQUAL(updater.last_sent_status.get(),
+                      DatastoreStatus::RUNNING);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 
@@ -0,0 +1,213 @@
+#define BOOST_TEST_MODULE DpkgStatus_tests
+#include <boost/test/unit_test.hpp>
+
+#include "nova/guest/apt.h"
+#include <fstream>
+#include "nova/Log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace nova;
+using nova::guest::apt::DpkgStatus;
+using boost::optional;
+using std::string;
+
+struct GlobalFixture {
+
+    LogApiScope log;
+
+    GlobalFixture()
+    : log(LogOptions::simple()) {
+    }
+
+};
+
+BOOST_GLOBAL_FIXTURE(GlobalFixture);
+
+/* Writes status files into a temporary directory the way dpkg does, by
+ * writing "status-new" and renaming it over "status". */
+struct StatusFileFixture {
+
+    string directory;
+
+    StatusFileFixture() {
+        char name[] = "/tmp/DpkgStatus_tests_XXXXXX";
+        BOOST_REQUIRE(mkdtemp(name) != 0);
+        directory = name;
+    }
+
+    ~StatusFileFixture() {
+        for (size_t i = 0; i < update_names.size(); ++ i) {
+            unlink(update_path(update_names[i]).c_str());
+        }
+        rmdir(update_path("").c_str());
+        unlink(path().c_str());
+        rmdir(directory.c_str());
+    }
+
+    string path() const {
+        return directory + "/status";
+    }
+
+    string update_path(const string & name) const {
+        return directory + "/updates/" + name;
+    }
+
+    /* Journals an entry the way dpkg does, by writing "tmp.i" and renaming
+     * it to the entry's sequence number. */
+    void write_update(const char * name, const char * contents) {
+        mkdir(update_path("").c_str(), 0755);
+        const string tmp_path = update_path("tmp.i");
+        {
+            std::ofstream file(tmp_path.c_str());
+            file << contents;
+        }
+        BOOST_REQUIRE_EQUAL(0, rename(tmp_path.c_str(),
+                                      update_path(name).c_str()));
+        update_names.push_back(name);
+    }
+
+    std::vector<string> update_names;
+
+    void write(const char * contents) const {
+        const string new_path = directory + "/status-new";
+        {
+            std::ofstream file(new_path.c_str());
+            file << contents;
+        }
+        BOOST_REQUIRE_EQUAL(0, rename(new_path.c_str(), path().c_str()));
+    }
+};
+
+const char * const STATUS =
+    "Package: mysql-server-5.1\n"
+    "Status: install ok installed\n"
+    "Priority: optional\n"
+    "Version: 5.1.63-0ubuntu0.11.04.1\n"
+    "Description: MySQL database server binaries\n"
+    " Package: this-is-not-a-package\n"
+    " Version: 0.0\n"
+    "\n"
+    "Package: mysql-client-5.1\n"
+    "Status: deinstall ok config-files\n"
+    "Version: 5.1.61\n"
+    "\n"
+    "Package: nova-guest\n"
+    "Status: purge ok not-installed\n"
+    "Version: 1.0\n"
+    "\n"
+    "Package: libc6\n"
+    "Status: install ok installed\n"
+    "Version: 2.13-20ubuntu5\n"
+    "Architecture: amd64\n"
+    "\n"
+    "Package: libc6\n"
+    "Status: install ok installed\n"
+    "Version: 2.13-20ubuntu4\n"
+    "Architecture: i386\n";
+
+BOOST_FIXTURE_TEST_CASE(versions_come_from_the_status_file, StatusFileFixture)
+{
+    write(STATUS);
+    DpkgStatus status(path().c_str());
+    optional<string> version;
+
+    BOOST_REQUIRE(status.version("mysql-server-5.1", version));
+    BOOST_CHECK_EQUAL("5.1.63-0ubuntu0.11.04.1", version.get_value_or("none"));
+
+    // Packages removed but not purged still have a version, just like
+    // "dpkg-query -W" reports.
+    BOOST_REQUIRE(status.version("mysql-client-5.1", version));
+    BOOST_CHECK_EQUAL("5.1.61", version.get_value_or("none"));
+
+    BOOST_REQUIRE(status.version("nova-guest", version));
+    BOOST_CHECK(!version);
+
+    BOOST_REQUIRE(status.version("this-is-not-a-package", version));
+    BOOST_CHECK(!version);
+
+    BOOST_REQUIRE(status.version("libc6", version));
+    BOOST_CHECK_EQUAL("2.13-20ubuntu5", version.get_value_or("none"));
+}
+
+BOOST_FIXTURE_TEST_CASE(rewrites_are_picked_up, StatusFileFixture)
+{
+    write(STATUS);
+    DpkgStatus status(path().c_str());
+    optional<string> version;
+    BOOST_REQUIRE(status.version("mysql-server-5.5", version));
+    BOOST_CHECK(!version);
+
+    write("Package: mysql-server-5.5\n"
+          "Status: install ok installed\n"
+          "Version: 5.5.28\n");
+    BOOST_REQUIRE(status.version("mysql-server-5.5", version));
+    BOOST_CHECK_EQUAL("5.5.28", version.get_value_or("none"));
+    BOOST_REQUIRE(status.version("mysql-server-5.1", version));
+    BOOST_CHECK(!version);
+}
+
+BOOST_FIXTURE_TEST_CASE(missing_status_files_are_not_an_answer,
+                        StatusFileFixture)
+{
+    DpkgStatus status(path().c_str());
+    optional<string> version;
+    BOOST_CHECK(!status.version("mysql-server-5.1", version));
+
+    write(STATUS);
+    BOOST_REQUIRE(status.version("mysql-server-5.1", version));
+    BOOST_CHECK_EQUAL("5.1.63-0ubuntu0.11.04.1", version.get_value_or("none"));
+}
+
+BOOST_FIXTURE_TEST_CASE(journaled_updates_are_applied_in_order,
+                        StatusFileFixture)
+{
+    write(STATUS);
+    write_update("1", "Package: mysql-server-5.1\n"
+                      "Status: install ok unpacked\n"
+                      "Version: 5.1.64\n");
+    write_update("2", "Package: mysql-server-5.1\n"
+                      "Status: install ok installed\n"
+                      "Version: 5.1.65\n");
+    write_update("10", "Package: nova-guest\n"
+                       "Status: install ok installed\n"
+                       "Version: 1.1\n");
+    // Left behind by a dpkg which died mid-write; dpkg ignores it too.
+    {
+        std::ofstream file(update_path("tmp.i").c_str());
+        file << "Package: libc6\nStatus: install ok installed\nVersion: 9\n";
+    }
+    update_names.push_back("tmp.i");
+
+    DpkgStatus status(path().c_str());
+    optional<string> version;
+    BOOST_REQUIRE(status.version("mysql-server-5.1", version));
+    BOOST_CHECK_EQUAL("5.1.65", version.get_value_or("none"));
+    BOOST_REQUIRE(status.version("nova-guest", version));
+    BOOST_CHECK_EQUAL("1.1", version.get_value_or("none"));
+    BOOST_REQUIRE(status.version("libc6", version));
+    BOOST_CHECK_EQUAL("2.13-20ubuntu5", version.get_value_or("none"));
+}
+
+BOOST_FIXTURE_TEST_CASE(new_updates_are_picked_up, StatusFileFixture)
+{
+    write(STATUS);
+    write_update("0", "Package: libc6\n"
+                      "Status: install ok installed\n"
+                      "Version: 2.13-20ubuntu6\n");
+    DpkgStatus status(path().c_str());
+    optional<string> version;
+    BOOST_REQUIRE(status.version("mysql-server-5.5", version));
+    BOOST_CHECK(!version);
+
+    write_update("1", "Package: mysql-server-5.5\n"
+                      "Status: install ok installed\n"
+                      "Version: 5.5.28\n");
+    BOOST_REQUIRE(status.version("mysql-server-5.5", version));
+    BOOST_CHECK_EQUAL("5.5.28", version.get_value_or("none"));
+    BOOST_REQUIRE(status.version("libc6", version));
+    BOOST_CHECK_EQUAL("2.13-20ubuntu6", version.get_value_or("none"));
+}
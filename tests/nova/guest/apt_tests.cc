@@ -4,12 +4,14 @@
 
 
 #include "nova/guest/apt.h"
+#include <boost/assign/list_of.hpp>
 #include "nova/Log.h"
 #include "nova/LogFlags.h"
 #include "nova/utils/regex.h"
 #include <fstream>
 #include <unistd.h>
 
+using namespace boost::assign;
 using std::ifstream;
 using boost::optional;
 using namespace nova;
@@ -19,6 +21,7 @@ using namespace nova::guest::apt;
 using nova::utils::Regex;
 using nova::utils::RegexMatchesPtr;
 using std::string;
+using std::vector;
 
 
 const double TIME_OUT = 60;
@@ -109,6 +112,14 @@ BOOST_AUTO_TEST_CASE(install_should_throw_exceptions_with_invalid_packages) {
                         PACKAGE_NOT_FOUND);
 }
 
+BOOST_AUTO_TEST_CASE(batch_install_should_throw_if_any_package_is_invalid) {
+    LogApiScope log(log_options_from_flags(get_flags()));
+    apt::AptGuest guest(USE_SUDO, "sneaky-pete", 1 * 60);
+    const vector<string> packages = list_of("dpkg")(INVALID_PACKAGE_NAME);
+    // A prefetch of a bad package is only logged, and install waits for it.
+    guest.prefetch(packages, 60);
+    CHECK_APT_EXCEPTION(guest.install(packages, 60), PACKAGE_NOT_FOUND);
+}
 
 BOOST_AUTO_TEST_CASE(remove_should_throw_exceptions_with_invalid_packages) {
     LogApiScope log(log_options_from_flags(get_flags()));
@@ -0,0 +1,164 @@
+#define BOOST_TEST_MODULE apt_update_tests
+#include <boost/test/unit_test.hpp>
+
+#include "nova/guest/apt.h"
+#include <fstream>
+#include "nova/Log.h"
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+#include <vector>
+
+using namespace nova;
+using nova::guest::apt::newest_modification_time;
+using nova::guest::apt::package_lists_age;
+using nova::guest::apt::package_lists_need_refresh;
+using boost::optional;
+using std::string;
+using std::vector;
+
+struct GlobalFixture {
+
+    LogApiScope log;
+
+    GlobalFixture()
+    : log(LogOptions::simple()) {
+    }
+
+};
+
+BOOST_GLOBAL_FIXTURE(GlobalFixture);
+
+/* Lays out apt's lists and sources in a temporary directory, with times
+ * set explicitly so the tests don't depend on the clock. */
+struct AptFilesFixture {
+
+    string directory;
+    vector<string> files;
+
+    AptFilesFixture() {
+        char name[] = "/tmp/apt_update_tests_XXXXXX";
+        BOOST_REQUIRE(mkdtemp(name) != 0);
+        directory = name;
+        BOOST_REQUIRE_EQUAL(0, mkdir(lists().c_str(), 0755));
+        BOOST_REQUIRE_EQUAL(0, mkdir(sources_directory().c_str(), 0755));
+    }
+
+    ~AptFilesFixture() {
+        for (size_t i = 0; i < files.size(); ++ i) {
+            unlink(files[i].c_str());
+        }
+        rmdir(lists().c_str());
+        rmdir(sources_directory().c_str());
+        rmdir(directory.c_str());
+    }
+
+    string lists() const {
+        return directory + "/lists";
+    }
+
+    string sources_list() const {
+        return directory + "/sources.list";
+    }
+
+    string sources_directory() const {
+        return directory + "/sources.list.d";
+    }
+
+    optional<double> age(time_t last_refresh, time_t now) const {
+        return package_lists_age(lists().c_str(), sources_list().c_str(),
+                                 sources_directory().c_str(), last_refresh,
+                                 now);
+    }
+
+    void write(const string & path, time_t modified) {
+        {
+            std::ofstream file(path.c_str());
+            file << "deb http://archive.ubuntu.com/ubuntu precise main\n";
+        }
+        files.push_back(path);
+        touch(path, modified);
+    }
+
+    static void touch(const string & path, time_t modified) {
+        utimbuf times;
+        times.actime = modified;
+        times.modtime = modified;
+        BOOST_REQUIRE_EQUAL(0, utime(path.c_str(), &times));
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(newest_modification_time_looks_at_files,
+                        AptFilesFixture)
+{
+    BOOST_CHECK_EQUAL(0, newest_modification_time(
+        (directory + "/missing").c_str()));
+
+    touch(lists(), 1000);
+    BOOST_CHECK_EQUAL(1000, newest_modification_time(lists().c_str()));
+
+    write(lists() + "/Packages", 3000);
+    write(lists() + "/Release", 2000);
+    touch(lists(), 1000);
+    BOOST_CHECK_EQUAL(3000, newest_modification_time(lists().c_str()));
+
+    // The directory's own time counts, as apt renames lists into it.
+    touch(lists(), 4000);
+    BOOST_CHECK_EQUAL(4000, newest_modification_time(lists().c_str()));
+}
+
+BOOST_FIXTURE_TEST_CASE(lists_age_from_their_newest_time, AptFilesFixture)
+{
+    write(sources_list(), 500);
+    touch(sources_directory(), 500);
+    write(lists() + "/Packages", 1000);
+    touch(lists(), 1000);
+    BOOST_CHECK_EQUAL(60, age(0, 1060).get_value_or(-1));
+
+    // An update this process ran counts even if apt didn't touch anything.
+    BOOST_CHECK_EQUAL(10, age(1050, 1060).get_value_or(-1));
+}
+
+BOOST_FIXTURE_TEST_CASE(changed_sources_make_lists_stale, AptFilesFixture)
+{
+    write(sources_list(), 500);
+    touch(sources_directory(), 500);
+    write(lists() + "/Packages", 1000);
+    touch(lists(), 1000);
+    BOOST_REQUIRE(!!age(0, 1060));
+
+    touch(sources_list(), 1030);
+    BOOST_CHECK(!age(0, 1060));
+    touch(sources_list(), 500);
+
+    write(sources_directory() + "/mysql.list", 1030);
+    touch(sources_directory(), 500);
+    BOOST_CHECK(!age(0, 1060));
+
+    // Once the lists are refreshed again they're fresh.
+    BOOST_CHECK_EQUAL(20, age(1040, 1060).get_value_or(-1));
+}
+
+BOOST_FIXTURE_TEST_CASE(lists_never_refreshed_have_no_age, AptFilesFixture)
+{
+    touch(sources_directory(), 500);
+    rmdir(lists().c_str());
+    BOOST_CHECK(!age(0, 1060));
+    BOOST_CHECK_EQUAL(60, age(1000, 1060).get_value_or(-1));
+}
+
+BOOST_AUTO_TEST_CASE(deciding_whether_to_refresh)
+{
+    const double TTL = 300;
+    // Fresh lists are used.
+    BOOST_CHECK(!package_lists_need_refresh(optional<double>(10), TTL, false));
+    // Unless the caller insists, or the TTL is turned off.
+    BOOST_CHECK(package_lists_need_refresh(optional<double>(10), TTL, true));
+    BOOST_CHECK(package_lists_need_refresh(optional<double>(10), 0, false));
+    // Old, stale or future lists are refreshed.
+    BOOST_CHECK(package_lists_need_refresh(optional<double>(300), TTL, false));
+    BOOST_CHECK(package_lists_need_refresh(boost::none, TTL, false));
+    BOOST_CHECK(package_lists_need_refresh(optional<double>(-5), TTL, false));
+}
@@ -82,3 +82,67 @@ BOOST_AUTO_TEST_CASE(test_create_global_stmt)
     BOOST_CHECK_EQUAL_COLLECTIONS(expected_output, expected_output+7,
                                   output, output+7);
 }
+
+struct QuoteEscaper {
+    const std::string escape_string(const char * const original) {
+        string escaped;
+        for (const char * c = original; *c != 0; ++ c) {
+            if (*c == '\'') {
+                escaped += '\\';
+            }
+            escaped += *c;
+        }
+        return escaped;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(list_users_stmt_pages_by_primary_key)
+{
+    QuoteEscaper escaper;
+    BOOST_CHECK_EQUAL(
+        list_users_stmt(escaper, 10, boost::none, false),
+        "SELECT User, Host FROM mysql.user WHERE Host != 'localhost'"
+        " ORDER BY Host ASC, User ASC LIMIT 11");
+    // The host is whatever follows the last "@".
+    BOOST_CHECK_EQUAL(
+        list_users_stmt(escaper, 2, string("o'hara@work@%"), false),
+        "SELECT User, Host FROM mysql.user WHERE Host != 'localhost'"
+        " AND Host >= '%' AND (Host > '%' OR User > 'o\\'hara@work')"
+        " ORDER BY Host ASC, User ASC LIMIT 3");
+    BOOST_CHECK_EQUAL(
+        list_users_stmt(escaper, 2, string("bob@10.0.0.1"), true),
+        "SELECT User, Host FROM mysql.user WHERE Host != 'localhost'"
+        " AND Host >= '10.0.0.1' AND (Host > '10.0.0.1' OR User >= 'bob')"
+        " ORDER BY Host ASC, User ASC LIMIT 3");
+}
+
+BOOST_AUTO_TEST_CASE(list_user_databases_stmt_only_reads_given_users)
+{
+    QuoteEscaper escaper;
+    MySqlUserList users;
+    const char * names[][2] = { { "bob", "%" }, { "o'hara", "10.0.0.1" } };
+    for (int i = 0; i < 2; i ++) {
+        MySqlUserPtr user(new MySqlUser());
+        user->set_name(names[i][0]);
+        user->set_host(names[i][1]);
+        users.push_back(user);
+    }
+    BOOST_CHECK_EQUAL(
+        list_user_databases_stmt(escaper, users),
+        "SELECT User, Host, Db FROM mysql.db WHERE"
+        " (Host = '%' AND User = 'bob')"
+        " OR (Host = '10.0.0.1' AND User = 'o\\'hara')"
+        " ORDER BY Db ASC");
+}
+
+BOOST_AUTO_TEST_CASE(list_databases_stmt_pages_by_name)
+{
+    QuoteEscaper escaper;
+    BOOST_CHECK_EQUAL(
+        list_databases_stmt(escaper, 5, string("db1"), false),
+        "SELECT schema_name, default_character_set_name,"
+        " default_collation_name FROM information_schema.schemata"
+        " WHERE schema_name NOT IN"
+        " ('mysql', 'information_schema', 'lost+found')"
+        " AND schema_name > 'db1' ORDER BY schema_name ASC LIMIT 6");
+}
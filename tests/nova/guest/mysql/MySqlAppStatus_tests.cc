@@ -5,7 +5,9 @@
 #define private public
 #define protected public
 
+#include <boost/assign/list_of.hpp>
 #include "nova/flags.h"
+#include <fstream>
 #include <boost/optional.hpp>
 #include "nova/Log.h"
 #include "nova/db/mysql.h"
@@ -26,6 +28,7 @@ using nova::guest::mysql::MySqlAppStatus;
 using boost::optional;
 using nova::process::ProcessException;
 using std::string;
+using boost::assign::list_of;
 
 namespace nova { namespace guest { namespace mysql {
 
@@ -62,6 +65,26 @@ class TestMySqlStatus : public MySqlAppStatus {
 
         virtual void on_execute() = 0;
 
+        // The in process probes are routed through "execute" so each test
+        // can decide which of them succeed by throwing or not.
+        virtual bool is_mysqld_running() const {
+            return probe("/bin/ps");
+        }
+
+        virtual bool ping_mysql() const {
+            return probe("/usr/bin/mysqladmin");
+        }
+
+        bool probe(const char * program) const {
+            std::stringstream out;
+            try {
+                execute(out, list_of(program));
+                return true;
+            } catch(const ProcessException & pe) {
+                return false;
+            }
+        }
+
         int call_number;
 
         optional<Status> last_sent_status;
@@ -235,6 +258,97 @@ BOOST_AUTO_TEST_CASE(After_mysql_is_marked_as_installed_but_mysql_not_there) {
                       DatastoreStatus::SHUTDOWN);
 }
 
+BOOST_AUTO_TEST_CASE(pid_file_is_looked_up_again_only_when_my_cnf_changes) {
+    struct Updater : public TestMySqlStatus {
+        Updater()
+        :   TestMySqlStatus(true)
+        {
+        }
+
+        virtual void execute(std::stringstream & out,
+                             const std::list<std::string> & cmds) const {
+            Updater * mutable_this = const_cast<Updater *>(this);
+            mutable_this->call_number += 1;
+            out << "--pid-file=/var/run/mysqld/mysqld" << call_number
+                << ".pid ";
+        }
+
+        virtual void on_execute() {
+        }
+    } updater;
+
+    char name[] = "/tmp/MySqlAppStatus_tests_XXXXXX";
+    const int fd = mkstemp(name);
+    BOOST_REQUIRE(fd >= 0);
+    close(fd);
+    updater.my_cnf_path = name;
+
+    BOOST_CHECK_EQUAL(updater.find_mysql_pid_file().get(),
+                      "/var/run/mysqld/mysqld1.pid");
+    BOOST_CHECK_EQUAL(updater.find_mysql_pid_file().get(),
+                      "/var/run/mysqld/mysqld1.pid");
+    BOOST_CHECK_EQUAL(updater.call_number, 1);
+
+    {
+        std::ofstream file(name);
+        file << "[mysqld]\npid-file=/var/run/mysqld/mysqld2.pid\n";
+    }
+    BOOST_CHECK_EQUAL(updater.find_mysql_pid_file().get(),
+                      "/var/run/mysqld/mysqld2.pid");
+    BOOST_CHECK_EQUAL(updater.call_number, 2);
+
+    // Without a my.cnf to go by nothing is remembered.
+    unlink(name);
+    updater.find_mysql_pid_file();
+    updater.find_mysql_pid_file();
+    BOOST_CHECK_EQUAL(updater.call_number, 4);
+}
+
+BOOST_AUTO_TEST_CASE(waits_wake_up_when_files_appear_next_to_the_pid_file) {
+    struct Updater : public TestMySqlStatus {
+        string directory;
+
+        Updater(const string & directory)
+        :   TestMySqlStatus(true),
+            directory(directory)
+        {
+        }
+
+        virtual void execute(std::stringstream & out,
+                             const std::list<std::string> & cmds) const {
+            out << "--pid-file=" << directory << "/mysqld.pid ";
+        }
+
+        virtual void on_execute() {
+        }
+    };
+
+    // The pid file pattern doesn't allow underscores.
+    char name[] = "/tmp/MySqlAppStatusTestsXXXXXX";
+    BOOST_REQUIRE(mkdtemp(name) != 0);
+    const Updater updater(name);
+
+    // Nothing happens, so this times out.
+    BOOST_CHECK(!updater.wait_for_status_change(0.2));
+
+    const string socket = string(name) + "/mysqld.sock";
+    struct Creator {
+        string path;
+
+        void operator()() {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+            std::ofstream file(path.c_str());
+        }
+    } creator;
+    creator.path = socket;
+    boost::thread thread(creator);
+    BOOST_CHECK(updater.wait_for_status_change(30));
+    thread.join();
+
+    unlink(socket.c_str());
+    rmdir(name);
+}
+
 
 } } } // end namespace
 
@@ -101,6 +101,40 @@ BOOST_AUTO_TEST_CASE(config_reader)
     BOOST_REQUIRE_EQUAL("right_password", result.get().password);
 }
 
+BOOST_AUTO_TEST_CASE(connection_pool_reuses_returned_connections)
+{
+    MySqlApiScope mysql_api_scope;
+    MySqlConnectionPoolPtr pool = MySqlConnectionPool::create("localhost", 1);
+    MySqlConnection * kept;
+    {
+        MySqlConnectionPtr first = pool->borrow();
+        MySqlConnectionPtr second = pool->borrow();
+        BOOST_CHECK(first != second);
+        BOOST_CHECK_EQUAL(0, pool->idle_count());
+        kept = second.get();  // Returned first, as it's destroyed first.
+    }
+    // Only one idle connection is kept, so the other one was closed.
+    BOOST_CHECK_EQUAL(1, pool->idle_count());
+    MySqlConnectionPtr again = pool->borrow();
+    BOOST_CHECK(kept == again.get());
+    BOOST_CHECK_EQUAL(0, pool->idle_count());
+}
+
+BOOST_AUTO_TEST_CASE(connection_pool_closes_idle_connections)
+{
+    MySqlApiScope mysql_api_scope;
+    MySqlConnectionPoolPtr pool = MySqlConnectionPool::create("localhost", 4,
+                                                              0);
+    pool->borrow();
+    BOOST_CHECK_EQUAL(1, pool->idle_count());
+    // Anything idle for zero seconds has expired by the next call.
+    pool->borrow();
+    BOOST_CHECK_EQUAL(1, pool->idle_count());
+    MySqlConnectionPtr a = pool->borrow();
+    MySqlConnectionPtr b = pool->borrow();
+    BOOST_CHECK_EQUAL(0, pool->idle_count());
+}
+
 BOOST_AUTO_TEST_CASE(integration_tests)
 {
     MySqlApiScope mysql_api_scope;
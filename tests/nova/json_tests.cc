@@ -6,6 +6,7 @@
 #include "nova/json.h"
 #include <boost/assign/list_of.hpp>
 #include <boost/foreach.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/format.hpp>
 #include <json/json.h>
 #include <map>
@@ -18,6 +19,7 @@ using nova::JsonData;
 using nova::JsonDataPtr;
 using nova::JsonException;
 using nova::json_obj;
+using nova::json_string;
 using nova::JsonObject;
 using nova::JsonObjectBuilder;
 using nova::JsonObjectPtr;
@@ -250,6 +252,17 @@ BOOST_AUTO_TEST_CASE(creating_malformed_object)
                          CTOR_ARGUMENT_NOT_OBJECT);
 }
 
+BOOST_AUTO_TEST_CASE(creating_object_from_text_with_length)
+{
+    // Only the first length bytes are parsed; the rest is garbage.
+    const string text("{ \"string\":\"abcde\", \"int\":42 }GARBAGE");
+    JsonObject object(text.data(), text.size() - 7);
+    test_object(object);
+
+    CHECK_JSON_EXCEPTION({ JsonObject object(text.data(), 10); },
+                         CTOR_ARGUMENT_IS_NOT_JSON_STRING);
+}
+
 BOOST_AUTO_TEST_CASE(getting_arrays_from_inside_an_object)
 {
     JsonObject object(json_tokener_parse(
@@ -449,6 +462,27 @@ BOOST_AUTO_TEST_CASE(iteration_over_an_object_and_visit_data)
 }
 
 
+BOOST_AUTO_TEST_CASE(children_outlive_their_parent)
+{
+    JsonArrayPtr users;
+    JsonObjectPtr first;
+    {
+        JsonObject object("{ 'users' : [ { 'name' : 'a' }, "
+                          "              { 'name' : 'b', 'dbs' : [ 1 ] } ] }");
+        users = object.get_array("users");
+        first = users->get_object(0);
+        for (int i = 0; i < 1000; ++ i) {
+            users->get_object(1)->get_array("dbs");
+        }
+    }
+    BOOST_CHECK_EQUAL(users->get_length(), 2);
+    BOOST_CHECK_EQUAL(first->get_string("name"), "a");
+    JsonObjectPtr second = users->get_object(1);
+    users.reset();
+    BOOST_CHECK_EQUAL(second->get_array("dbs")->get_int(0), 1);
+}
+
+
 BOOST_AUTO_TEST_CASE(json_builder)
 {
     JsonObjectBuilder obj;
@@ -544,3 +578,187 @@ BOOST_AUTO_TEST_CASE(build_json_array)
                                  "null "
                               "]");
 }
+
+
+BOOST_AUTO_TEST_CASE(json_builder_escapes_and_formats_numbers)
+{
+    JsonObjectBuilder obj = json_obj(
+        "ctl", "a\x01" "b\tc\\d\n",
+        "neg", -2147483647 - 1,
+        "max", 4294967295u,
+        "small", 0.000125,
+        "flag", true,
+        "utf8", "caf\xc3\xa9 / \"x\"");
+    const auto result = str(format("%s") % obj);
+    BOOST_CHECK_EQUAL(result, "{ \"ctl\" : \"a\\u0001b\\tc\\\\d\\n\", "
+                              "\"neg\" : -2147483648, "
+                              "\"max\" : 4294967295, "
+                              "\"small\" : 0.000125, "
+                              "\"flag\" : 1, "
+                              "\"utf8\" : \"caf\xc3\xa9 / \\\"x\\\"\" }");
+    JsonObject parsed(obj);
+    BOOST_CHECK_EQUAL(parsed.get_string("ctl"), "a\x01" "b\tc\\d\n");
+    BOOST_CHECK_EQUAL(parsed.get_int("neg"), -2147483647 - 1);
+    BOOST_CHECK_EQUAL(json_string("\x1f"), "\"\\u001f\"");
+}
+
+
+/**---------------------------------------------------------------------------
+ *- json_find_top_level_string Tests
+ *---------------------------------------------------------------------------*/
+
+BOOST_AUTO_TEST_CASE(find_top_level_string_unescapes_value)
+{
+    const string text("{ \"skip\" : { \"key\" : \"nested\", \"a\": [1, \"]\"] },"
+                      " \"n\": -4.5e3, \"t\": true,"
+                      " \"key\" : \"tab\\there \\\"q\\\" \\/ \\u00e9\\ud83d\\ude00\" }");
+    string value("left over");
+    BOOST_CHECK_EQUAL(nova::json_find_top_level_string(
+        text.data(), text.size(), "key", value), true);
+    BOOST_CHECK_EQUAL(value, "tab\there \"q\" / \xc3\xa9\xf0\x9f\x98\x80");
+}
+
+BOOST_AUTO_TEST_CASE(find_top_level_string_when_missing_or_not_a_string)
+{
+    string value;
+    const string text("{ \"inner\" : { \"key\" : \"no\" }, \"num\" : 5 }");
+    BOOST_CHECK_EQUAL(nova::json_find_top_level_string(
+        text.data(), text.size(), "key", value), false);
+    BOOST_CHECK_EQUAL(nova::json_find_top_level_string(
+        text.data(), text.size(), "num", value), false);
+    BOOST_CHECK_EQUAL(nova::json_find_top_level_string("{}", 2, "key", value),
+                      false);
+}
+
+BOOST_AUTO_TEST_CASE(find_top_level_string_takes_last_duplicate)
+{
+    string value;
+    const string text("{ \"key\" : \"first\", \"a\" : 1, \"key\" : \"last\" }");
+    BOOST_CHECK_EQUAL(nova::json_find_top_level_string(
+        text.data(), text.size(), "key", value), true);
+    BOOST_CHECK_EQUAL(value, "last");
+    BOOST_CHECK_EQUAL(value, JsonObject(text.c_str()).get_string("key"));
+
+    const string replaced("{ \"key\" : \"first\", \"key\" : 5 }");
+    BOOST_CHECK_EQUAL(nova::json_find_top_level_string(
+        replaced.data(), replaced.size(), "key", value), false);
+}
+
+BOOST_AUTO_TEST_CASE(find_top_level_string_with_malformed_text)
+{
+    string value;
+    CHECK_JSON_EXCEPTION({ nova::json_find_top_level_string(
+                               "[1, 2]", 6, "key", value); },
+                         CTOR_ARGUMENT_NOT_OBJECT);
+    CHECK_JSON_EXCEPTION({ nova::json_find_top_level_string(
+                               "{ \"key\" : \"abc", 14, "key", value); },
+                         CTOR_ARGUMENT_IS_NOT_JSON_STRING);
+    CHECK_JSON_EXCEPTION({ nova::json_find_top_level_string(
+                               "{ \"a\" 1 }", 9, "key", value); },
+                         CTOR_ARGUMENT_IS_NOT_JSON_STRING);
+}
+
+namespace {
+
+    // Builds an oslo.messaging envelope shaped like what Trove sends for
+    // "prepare", with enough users and config to be representative.
+    string trove_prepare_envelope(const int user_count) {
+        JsonArrayBuilder users;
+        JsonArrayBuilder databases;
+        for (int i = 0; i < user_count; ++ i) {
+            const string name = str(format("user_%d") % i);
+            databases.add(json_obj("_name", str(format("db_%d") % i),
+                                   "_character_set", "utf8",
+                                   "_collate", "utf8_general_ci"));
+            users.add(json_obj("_name", name,
+                               "_password", "pa$$\"word\\",
+                               "_host", "%",
+                               "_databases", json_array(
+                                   json_obj("_name", "db_0"))));
+        }
+        string config("[mysqld]\n");
+        for (int i = 0; i < 60; ++ i) {
+            config += str(format("option_%d = \"value %d\"\n") % i % i);
+        }
+        JsonObjectBuilder inner = json_obj(
+            "method", "prepare",
+            "_msg_id", "0f5d1c2e43b44b8b9c0a3c6e4d2b1a90",
+            "_unique_id", "a8d3f2c1b0e94f6d8c7b6a5f4e3d2c1b",
+            "_context_tenant", "8b4c3a2d1e0f4a5b9c8d7e6f5a4b3c2d",
+            "_context_auth_token", "MIIQ9wYJKoZIhvcNAQcCoIIQ6DCCEOQCAQEx",
+            "_context_user", "d3c2b1a0f9e84d7c",
+            "_context_is_admin", false,
+            "args", json_obj(
+                "packages", json_array("mysql-server-5.6"),
+                "memory_mb", 4096,
+                "config_contents", config,
+                "overrides", boost::none,
+                "device_path", "/dev/vdb",
+                "mount_point", "/var/lib/mysql",
+                "backup_info", boost::none,
+                "users", users,
+                "databases", databases));
+        return boost::lexical_cast<string>(json_obj(
+            "oslo.version", "2.0",
+            "oslo.message", boost::lexical_cast<string>(inner)));
+    }
+
+    double elapsed_ms(const posix_time::ptime & start) {
+        return (posix_time::microsec_clock::universal_time() - start)
+            .total_microseconds() / 1000.0;
+    }
+
+}
+
+BOOST_AUTO_TEST_CASE(find_top_level_string_extracts_oslo_message)
+{
+    const string envelope = trove_prepare_envelope(3);
+    JsonObject outer(envelope.c_str());
+    string oslo_message;
+    BOOST_REQUIRE_EQUAL(nova::json_find_top_level_string(
+        envelope.data(), envelope.size(), "oslo.message", oslo_message), true);
+    BOOST_CHECK_EQUAL(oslo_message, outer.get_string("oslo.message"));
+
+    JsonObject msg(oslo_message.data(), oslo_message.size());
+    BOOST_CHECK_EQUAL(msg.get_string("method"), "prepare");
+    BOOST_CHECK_EQUAL(msg.get_object("args")->get_array("users")
+                      ->get_object(2)->get_string("_password"),
+                      "pa$$\"word\\");
+}
+
+BOOST_AUTO_TEST_CASE(benchmark_oslo_envelope_parsing)
+{
+    // Compares parsing the envelope into a tree and then parsing its
+    // "oslo.message" string again against scanning for that string and
+    // parsing once. Timings are informational; only results are checked.
+    const int iterations = 200;
+    const string envelope = trove_prepare_envelope(200);
+
+    size_t two_pass_args = 0;
+    posix_time::ptime start = posix_time::microsec_clock::universal_time();
+    for (int i = 0; i < iterations; ++ i) {
+        JsonObject raw(envelope.c_str());
+        JsonObject msg(raw.get_string("oslo.message"));
+        two_pass_args += msg.get_object("args")->get_array("users")
+                            ->get_length();
+    }
+    const double two_pass_ms = elapsed_ms(start);
+
+    size_t single_pass_args = 0;
+    string oslo_message;
+    start = posix_time::microsec_clock::universal_time();
+    for (int i = 0; i < iterations; ++ i) {
+        nova::json_find_top_level_string(envelope.data(), envelope.size(),
+                                         "oslo.message", oslo_message);
+        JsonObject msg(oslo_message.data(), oslo_message.size());
+        single_pass_args += msg.get_object("args")->get_array("users")
+                               ->get_length();
+    }
+    const double single_pass_ms = elapsed_ms(start);
+
+    BOOST_CHECK_EQUAL(two_pass_args, single_pass_args);
+    BOOST_TEST_MESSAGE(str(format("oslo envelope, %d bytes x %d: two pass "
+                                  "%.2f ms, single pass %.2f ms")
+                           % envelope.size() % iterations
+                           % two_pass_ms % single_pass_ms));
+}
@@ -75,6 +75,12 @@ int main(int argc, const char* argv[]) {
             cout << "1";
             cerr << "2";
         }
+    } else if (args.size() >=2 && args[1] == "recite") {
+        // Numbered lines followed by a prompt with no newline.
+        for (int index = 0; index < 10000; index ++) {
+            cout << index << "\n";
+        }
+        cout << "Polly want a cracker? " << flush;
     } else {
         error("zzz");
         exit(57);
@@ -2,14 +2,29 @@
 #include <boost/test/unit_test.hpp>
 
 #include <boost/assign/list_of.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <fcntl.h>
+#include <fstream>
+#include <boost/format.hpp>
 #include "nova/Log.h"
 #include "nova/process.h"
 #include <stdlib.h>
+#include <string.h>
+#include <boost/thread.hpp>
+#include <unistd.h>
+#include <vector>
 
 using namespace nova;
 using namespace nova::process;
+using boost::format;
+using nova::utils::io::Deadline;
+using nova::utils::io::Pipe;
+namespace posix_time = boost::posix_time;
+using nova::utils::io::read_with_throw;
+using nova::utils::io::TimeOutException;
 using std::string;
 using std::stringstream;
+using std::vector;
 using namespace boost::assign;
 
 #define CHECK_POINT BOOST_REQUIRE_EQUAL(2,2);
@@ -124,6 +139,16 @@ BOOST_AUTO_TEST_CASE(execute_test) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(finding_processes_by_name) {
+    // Whatever this test binary is called, it's certainly running.
+    std::ifstream comm("/proc/self/comm");
+    string name;
+    std::getline(comm, name);
+    BOOST_REQUIRE(!name.empty());
+    BOOST_CHECK(!!find_process_by_name(name.c_str()));
+    BOOST_CHECK(!find_process_by_name("no_such_thing"));
+}
+
 BOOST_AUTO_TEST_CASE(environment_variables_should_transfer_part_1_it_fails) {
     CHECK_POINT;
     const double TIME_OUT = 4.0;
@@ -222,3 +247,244 @@ BOOST_AUTO_TEST_CASE(test_giga_flood) {
     BOOST_REQUIRE_EQUAL(actual_stdout_count, 1024 * 1024);
     BOOST_REQUIRE_EQUAL(actual_stderr_count, 1024 * 1024);
 }
+
+/**---------------------------------------------------------------------------
+ *- Line Reading Tests
+ *---------------------------------------------------------------------------*/
+
+struct LineChecker : public LineHandler {
+    int next;
+    int stop_at;
+    string last_line;
+    bool last_line_ended;
+    string last_partial_line;
+    size_t longest;
+    size_t total;
+
+    LineChecker()
+    : next(0), stop_at(-1), last_line_ended(false), longest(0), total(0) {
+    }
+
+    virtual bool on_line(const char * line, size_t length, bool ended) {
+        BOOST_REQUIRE_EQUAL(strlen(line), length);
+        if (next < 10000) {
+            BOOST_REQUIRE_EQUAL(str(format("%d") % next), line);
+        }
+        last_line = line;
+        last_line_ended = ended;
+        longest = std::max(longest, length);
+        total += length;
+        return next++ != stop_at;
+    }
+
+    virtual bool on_partial_line(const char * line, size_t length) {
+        last_partial_line = string(line, length);
+        return true;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(reading_lines) {
+    CommandList cmds = list_of(parrot_path())("recite");
+    Process<StdErrAndStdOut> process(cmds);
+    LineChecker checker;
+    checker.stop_at = 5;
+    // Stopping early leaves the remaining lines for the next call.
+    BOOST_REQUIRE(process.read_lines_until_exit(checker, 60));
+    BOOST_REQUIRE_EQUAL(6, checker.next);
+    BOOST_CHECK(checker.last_line_ended);
+    BOOST_REQUIRE(!process.read_lines_until_exit(checker, 60));
+    BOOST_REQUIRE_EQUAL(10001, checker.next);
+    BOOST_CHECK_EQUAL("Polly want a cracker? ", checker.last_partial_line);
+    BOOST_CHECK_EQUAL("Polly want a cracker? ", checker.last_line);
+    BOOST_CHECK(!checker.last_line_ended);
+    BOOST_CHECK(process.is_finished());
+}
+
+BOOST_AUTO_TEST_CASE(reading_lines_longer_than_the_buffer) {
+    CommandList cmds = list_of(parrot_path())("giga-flood");
+    Process<StdErrAndStdOut> process(cmds);
+    LineChecker checker;
+    checker.next = 10000;  // Don't check the contents.
+    BOOST_REQUIRE(!process.read_lines_until_exit(checker, 60));
+    BOOST_CHECK_EQUAL(1024 * 1024 * 2, checker.total);
+    BOOST_CHECK(checker.longest <= 4096);
+}
+
+BOOST_AUTO_TEST_CASE(collecting_lines_longer_than_the_buffer) {
+    // Pieces of a long line are joined back together, not split by newlines.
+    CommandList cmds = list_of(parrot_path())("giga-flood");
+    Process<StdErrAndStdOut> process(cmds);
+    LineCollector collector;
+    process.read_lines_until_exit(collector, 60);
+    const string output = collector.str();
+    BOOST_CHECK_EQUAL(1024 * 1024 * 2, output.size());
+    BOOST_CHECK_EQUAL(string::npos, output.find('\n'));
+}
+
+BOOST_AUTO_TEST_CASE(collecting_lines_with_a_limit) {
+    CommandList cmds = list_of(parrot_path())("recite");
+    Process<StdErrAndStdOut> process(cmds);
+    LineCollector collector(32);
+    process.read_lines_until_exit(collector, 60);
+    BOOST_CHECK(collector.truncated());
+    BOOST_CHECK_EQUAL("9998\n9999\nPolly want a cracker? ", collector.str());
+}
+
+/**---------------------------------------------------------------------------
+ *- Pipe Tests
+ *---------------------------------------------------------------------------*/
+
+const size_t BENCHMARK_FILE_SIZE = 16 * 1024 * 1024;
+
+/* A temporary file full of "size" bytes, removed when destroyed. */
+struct TempFile {
+    string path;
+
+    TempFile(size_t size) {
+        char name[] = "/tmp/io_tests_XXXXXX";
+        const int fd = mkstemp(name);
+        BOOST_REQUIRE(fd >= 0);
+        path = name;
+        vector<char> block(1024 * 1024, 'x');
+        for (size_t written = 0; written < size; written += block.size()) {
+            BOOST_REQUIRE_EQUAL(block.size(),
+                                ::write(fd, &block[0], block.size()));
+        }
+        ::close(fd);
+    }
+
+    ~TempFile() {
+        ::unlink(path.c_str());
+    }
+};
+
+double elapsed_ms(const posix_time::ptime & start) {
+    return (posix_time::microsec_clock::universal_time() - start)
+        .total_microseconds() / 1000.0;
+}
+
+/* Sends a file through a pipe to /dev/null the way process output is
+ * usually handled, reading each chunk into a buffer and writing it back
+ * out. Returns the number of bytes moved. */
+size_t copy_through_pipe(const char * path, Pipe & pipe,
+                         size_t chunk_size) {
+    const int file = ::open(path, O_RDONLY);
+    const int null = ::open("/dev/null", O_WRONLY);
+    vector<char> buffer(chunk_size);
+    size_t total = 0;
+    size_t count;
+    while (0 != (count = read_with_throw(file, &buffer[0], chunk_size))) {
+        BOOST_REQUIRE_EQUAL(count, ::write(pipe.out(), &buffer[0], count));
+        size_t drained = 0;
+        while (drained < count) {
+            const size_t got = read_with_throw(pipe.in(), &buffer[0],
+                                               count - drained);
+            BOOST_REQUIRE_EQUAL(got, ::write(null, &buffer[0], got));
+            drained += got;
+        }
+        total += count;
+    }
+    ::close(file);
+    ::close(null);
+    return total;
+}
+
+
+BOOST_AUTO_TEST_CASE(pipes_can_be_resized)
+{
+    Pipe pipe;
+    boost::optional<size_t> capacity = pipe.set_capacity(256 * 1024);
+    BOOST_REQUIRE(!!capacity);
+    BOOST_CHECK(capacity.get() >= 256 * 1024);
+}
+
+BOOST_AUTO_TEST_CASE(benchmark_pipe_transfers)
+{
+    // Moves a file through a pipe with the default buffer and with a buffer
+    // the size of the backup's zlib buffer. Timings are informational; only
+    // the byte counts are checked.
+    TempFile file(BENCHMARK_FILE_SIZE);
+    const size_t big = 1024 * 1024;
+
+    Pipe default_pipe;
+    posix_time::ptime start = posix_time::microsec_clock::universal_time();
+    BOOST_CHECK_EQUAL(BENCHMARK_FILE_SIZE, copy_through_pipe(file.path.c_str(),
+                                                   default_pipe, 64 * 1024));
+    const double default_ms = elapsed_ms(start);
+
+    Pipe big_pipe;
+    BOOST_REQUIRE(!!big_pipe.set_capacity(big));
+    start = posix_time::microsec_clock::universal_time();
+    BOOST_CHECK_EQUAL(BENCHMARK_FILE_SIZE, copy_through_pipe(file.path.c_str(),
+                                                   big_pipe, big));
+    const double big_ms = elapsed_ms(start);
+
+    BOOST_TEST_MESSAGE(str(format("%d MB through a pipe: 64K copies %.2f ms, "
+                                  "1M copies %.2f ms")
+                           % (BENCHMARK_FILE_SIZE / (1024 * 1024)) % default_ms
+                           % big_ms));
+}
+
+/**---------------------------------------------------------------------------
+ *- Deadline Tests
+ *---------------------------------------------------------------------------*/
+
+struct TimeOutBabbler {
+    bool timed_out;
+
+    TimeOutBabbler() : timed_out(false) {
+    }
+
+    void operator()() {
+        CommandList cmds = list_of(parrot_path())("babble");
+        Process<StdErrAndStdOut> process(cmds);
+        try {
+            process.wait_for_exit(1);
+        } catch(const TimeOutException & toe) {
+            timed_out = true;
+        }
+    }
+};
+
+BOOST_AUTO_TEST_CASE(processes_time_out_concurrently) {
+    // Each process has its own deadline, so several threads can wait with
+    // time outs at once.
+    TimeOutBabbler first, second, third;
+    boost::thread thread1(boost::ref(first));
+    boost::thread thread2(boost::ref(second));
+    boost::thread thread3(boost::ref(third));
+    thread1.join();
+    thread2.join();
+    thread3.join();
+    BOOST_CHECK(first.timed_out);
+    BOOST_CHECK(second.timed_out);
+    BOOST_CHECK(third.timed_out);
+}
+
+BOOST_AUTO_TEST_CASE(deadline_scopes_nest) {
+    CommandList cmds = list_of(parrot_path())("wake");
+    Process<StdErrAndStdOut, StdIn> process(cmds);
+    Deadline & deadline = process.get_deadline();
+    BOOST_REQUIRE(!deadline.remaining());
+    {
+        Deadline::Scope outer(deadline, 60);
+        {
+            Deadline::Scope inner(deadline, 0.5);
+            BOOST_CHECK(deadline.remaining().get() <= 0.5);
+            stringstream out;
+            try {
+                process.read_until_pause(out, 30);
+                BOOST_FAIL("Should have thrown.");
+            } catch(const TimeOutException & toe) {
+            }
+            BOOST_CHECK(deadline.expired());
+        }
+        // A looser scope doesn't extend a tighter one, but the outer one
+        // comes back once the inner one is gone.
+        BOOST_CHECK(deadline.remaining().get() > 30);
+    }
+    BOOST_REQUIRE(!deadline.remaining());
+    process.write("die\n");
+    process.wait_for_exit(5);
+    BOOST_CHECK(process.successful());
+}
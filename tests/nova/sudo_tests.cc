@@ -0,0 +1,220 @@
+#define BOOST_TEST_MODULE sudo_tests
+#include <boost/test/unit_test.hpp>
+
+#include <boost/assign/list_of.hpp>
+#include <fstream>
+#include "nova/Log.h"
+#include "nova/sudo.h"
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <boost/thread.hpp>
+#include <unistd.h>
+
+using namespace nova;
+using namespace nova::process;
+using std::string;
+using std::stringstream;
+using namespace boost::assign;
+
+struct GlobalFixture {
+
+    LogApiScope log;
+
+    GlobalFixture()
+    : log(LogOptions::simple()) {
+    }
+
+};
+
+BOOST_GLOBAL_FIXTURE(GlobalFixture);
+
+/* Runs the helper's request loop in a thread on one end of a socketpair,
+ * so the tests don't need sudo. */
+struct HelperFixture {
+
+    int fds[2];
+    boost::shared_ptr<RootHelper> helper;
+    boost::thread server;
+    string directory;
+
+    HelperFixture() {
+        BOOST_REQUIRE_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        server = boost::thread(serve_root_helper_requests, fds[1]);
+        helper.reset(new RootHelper(fds[0]));
+        char name[] = "/tmp/sudo_tests_XXXXXX";
+        BOOST_REQUIRE(mkdtemp(name) != 0);
+        directory = name;
+    }
+
+    ~HelperFixture() {
+        helper.reset();  // Closing our end makes the server return.
+        server.join();
+        close(fds[1]);
+        execute(list_of("/bin/rm")("-rf")(directory.c_str()));
+    }
+
+    string path(const char * name) const {
+        return directory + "/" + name;
+    }
+};
+
+string read_file(const string & path) {
+    std::ifstream file(path.c_str());
+    stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+BOOST_FIXTURE_TEST_CASE(file_commands_run_in_the_helper, HelperFixture)
+{
+    const double TIME_OUT = 4.0;
+    const string original = path("original");
+    const string copy = path("copy");
+    const string moved = path("moved");
+    const string link = path("link");
+    string output;
+    {
+        std::ofstream file(original.c_str());
+        file << "[mysqld]\n";
+    }
+
+    BOOST_REQUIRE(helper->run(list_of("cp")(original.c_str())(copy.c_str()),
+                              output, TIME_OUT).get());
+    BOOST_CHECK_EQUAL("[mysqld]\n", read_file(copy));
+
+    BOOST_REQUIRE(helper->run(list_of("chmod")("0640")(copy.c_str()),
+                              output, TIME_OUT).get());
+    struct stat info;
+    BOOST_REQUIRE_EQUAL(0, stat(copy.c_str(), &info));
+    BOOST_CHECK_EQUAL(0640, info.st_mode & 07777);
+
+    BOOST_REQUIRE(helper->run(list_of("mv")(copy.c_str())(moved.c_str()),
+                              output, TIME_OUT).get());
+    BOOST_CHECK(access(copy.c_str(), F_OK) != 0);
+    BOOST_CHECK_EQUAL("[mysqld]\n", read_file(moved));
+
+    BOOST_REQUIRE(helper->run(list_of("ln")("-s")(moved.c_str())(link.c_str()),
+                              output, TIME_OUT).get());
+    BOOST_CHECK_EQUAL("[mysqld]\n", read_file(link));
+
+    BOOST_REQUIRE(helper->run(list_of("rm")("-f")(link.c_str()),
+                              output, TIME_OUT).get());
+    BOOST_CHECK(access(link.c_str(), F_OK) != 0);
+    // rm -f is happy when there's nothing to remove, plain rm is not.
+    BOOST_REQUIRE(helper->run(list_of("rm")("-f")(link.c_str()),
+                              output, TIME_OUT).get());
+    BOOST_REQUIRE(!helper->run(list_of("rm")(link.c_str()),
+                               output, TIME_OUT).get());
+    BOOST_CHECK(output.find("rm: ") == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(other_allowed_programs_are_spawned, HelperFixture)
+{
+    {
+        std::ofstream file(path("ib_logfile0").c_str());
+    }
+    string output;
+    BOOST_REQUIRE(helper->run(list_of("/bin/ls")(directory.c_str()),
+                              output, 4.0).get());
+    BOOST_CHECK_EQUAL("ib_logfile0\n", output);
+}
+
+BOOST_FIXTURE_TEST_CASE(unknown_programs_are_refused, HelperFixture)
+{
+    string output;
+    try {
+        helper->run(list_of("/bin/sh")("-c")("true"), output, 4.0);
+        BOOST_FAIL("Should have thrown.");
+    } catch(const RootHelperException & rhe) {
+        BOOST_REQUIRE_EQUAL(RootHelperException::COMMAND_NOT_ALLOWED,
+                            rhe.code);
+    }
+    // A refused command leaves the connection usable.
+    BOOST_REQUIRE(helper->run(list_of("ls")(directory.c_str()),
+                              output, 4.0).get());
+}
+
+BOOST_FIXTURE_TEST_CASE(init_scripts_must_live_in_init_d, HelperFixture)
+{
+    string output;
+    try {
+        helper->run(list_of("/etc/init.d/../../bin/sh"), output, 4.0);
+        BOOST_FAIL("Should have thrown.");
+    } catch(const RootHelperException & rhe) {
+        BOOST_REQUIRE_EQUAL(RootHelperException::COMMAND_NOT_ALLOWED,
+                            rhe.code);
+    }
+}
+
+struct ListDirectory {
+    RootHelper * helper;
+    string directory;
+    boost::optional<bool> result;
+
+    void operator()() {
+        string output;
+        result = helper->run(list_of("ls")(directory.c_str()), output, 10.0);
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(threads_take_turns_using_the_helper, HelperFixture)
+{
+    const int thread_count = 8;
+    ListDirectory callers[thread_count];
+    boost::thread_group threads;
+    for (int i = 0; i < thread_count; ++ i) {
+        callers[i].helper = helper.get();
+        callers[i].directory = directory;
+        threads.create_thread(boost::ref(callers[i]));
+    }
+    threads.join_all();
+    // None of them gave up on the helper because another had it.
+    for (int i = 0; i < thread_count; ++ i) {
+        BOOST_REQUIRE(!!callers[i].result);
+        BOOST_CHECK(callers[i].result.get());
+    }
+}
+
+struct WaitForSilentHelper {
+    RootHelper * helper;
+    bool connection_closed;
+
+    void operator()() {
+        string output;
+        connection_closed = false;
+        try {
+            helper->run(list_of("ls"), output, 10.0);
+        } catch(const RootHelperException & rhe) {
+            connection_closed
+                = rhe.code == RootHelperException::CONNECTION_CLOSED;
+        }
+    }
+};
+
+BOOST_AUTO_TEST_CASE(busy_helper_turns_other_callers_away_quickly)
+{
+    // Greets the agent but never answers, so the first command hogs it.
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    const uint32_t greeting = 0x53505248;
+    BOOST_REQUIRE_EQUAL(sizeof(greeting),
+                        write(fds[1], &greeting, sizeof(greeting)));
+    RootHelper helper(fds[0]);
+    WaitForSilentHelper hog;
+    hog.helper = &helper;
+    boost::thread hog_thread(boost::ref(hog));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+
+    const boost::posix_time::ptime start =
+        boost::posix_time::microsec_clock::universal_time();
+    string output;
+    BOOST_CHECK(!helper.run(list_of("ls"), output, 10.0));
+    const boost::posix_time::time_duration waited =
+        boost::posix_time::microsec_clock::universal_time() - start;
+    BOOST_CHECK(waited < boost::posix_time::seconds(2));
+
+    close(fds[1]);
+    hog_thread.join();
+    BOOST_CHECK(hog.connection_closed);
+}
@@ -4,6 +4,7 @@
 
 #include <iostream>
 #include "nova/utils/regex.h"
+#include <string.h>
 
 using std::endl;
 using namespace nova;
@@ -192,3 +193,75 @@ BOOST_AUTO_TEST_CASE(match_package_with_period_wheezy)
     BOOST_REQUIRE_EQUAL(matches.get() != 0, true);
     BOOST_REQUIRE_EQUAL(matches->get(1), "mysql-server-5.5");
 }
+
+
+/**---------------------------------------------------------------------------
+ *- PatternSet Tests
+ *---------------------------------------------------------------------------*/
+
+BOOST_AUTO_TEST_CASE(pattern_set_finds_text)
+{
+    PatternSet patterns;
+    BOOST_REQUIRE_EQUAL(0, patterns.add_text("password"));
+    BOOST_REQUIRE_EQUAL(1, patterns.add_text("Setting up libstdc++6"));
+    BOOST_REQUIRE_EQUAL(2, patterns.add_text("up"));
+
+    const char * line = "Setting up libstdc++6 (4.7.2-5) ...";
+    boost::optional<PatternSet::Match> match
+        = patterns.match(line, strlen(line));
+    BOOST_REQUIRE(!!match);
+    // The "+"s aren't special and the lowest numbered pattern wins.
+    BOOST_CHECK_EQUAL(1, match->index);
+    BOOST_CHECK_EQUAL("Setting up libstdc++6", match->matches->get(0));
+
+    line = "Unpacking up";
+    match = patterns.match(line, strlen(line));
+    BOOST_REQUIRE(!!match);
+    BOOST_CHECK_EQUAL(2, match->index);
+    BOOST_CHECK_EQUAL("up", match->matches->get(0));
+
+    line = "[sudo] passwor";
+    BOOST_CHECK(!patterns.match(line, strlen(line)));
+}
+
+BOOST_AUTO_TEST_CASE(pattern_set_finds_overlapping_text)
+{
+    PatternSet patterns;
+    patterns.add_text("abcd");
+    patterns.add_text("bc");
+    patterns.add_text("abce");
+    const char * line = "xxabcexx";
+    boost::optional<PatternSet::Match> match
+        = patterns.match(line, strlen(line));
+    BOOST_REQUIRE(!!match);
+    BOOST_CHECK_EQUAL(1, match->index);
+
+    line = "xxabcabcdxx";
+    match = patterns.match(line, strlen(line));
+    BOOST_REQUIRE(!!match);
+    BOOST_CHECK_EQUAL(0, match->index);
+}
+
+BOOST_AUTO_TEST_CASE(pattern_set_runs_regexes)
+{
+    PatternSet patterns;
+    patterns.add_regex("no packages found matching (\\S+)",
+                       "no packages found matching ");
+    patterns.add_regex("(\\S+)\\s+(\\S*).*");
+
+    const char * line = "dpkg-query: no packages found matching cowsay";
+    boost::optional<PatternSet::Match> match
+        = patterns.match(line, strlen(line));
+    BOOST_REQUIRE(!!match);
+    BOOST_CHECK_EQUAL(0, match->index);
+    BOOST_CHECK_EQUAL("cowsay", match->matches->get(1));
+
+    line = "cowsay\t3.03";
+    match = patterns.match(line, strlen(line));
+    BOOST_REQUIRE(!!match);
+    BOOST_CHECK_EQUAL(1, match->index);
+    BOOST_CHECK_EQUAL("3.03", match->matches->get(2));
+
+    // The version might not be finished yet.
+    BOOST_CHECK(!patterns.match(line, strlen(line), true));
+}
@@ -4,6 +4,7 @@
 #include "nova/Log.h"
 #include <boost/thread.hpp>
 #include "nova/utils/threads.h"
+#include <vector>
 
 using nova::LogApiScope;
 using nova::LogOptions;
@@ -99,3 +100,152 @@ BOOST_AUTO_TEST_CASE(job_runner_tests)
     quit = true;
     runner.shutdown(); // Avoid errors due to thread still running dead object.
 }
+
+namespace {
+    boost::mutex order_mutex;
+    std::vector<int> order;
+
+    /* Waits until "release" is set, then records its number. */
+    struct OrderJob : public Job {
+        int number;
+        volatile bool * release;
+
+        OrderJob(int number, volatile bool * release)
+        :   number(number),
+            release(release)
+        {}
+
+        virtual void operator()() {
+            while(!*release) {
+                boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+            }
+            boost::lock_guard<boost::mutex> lock(order_mutex);
+            order.push_back(number);
+        }
+
+        virtual Job * clone() const {
+            return new OrderJob(*this);
+        }
+
+        virtual std::string describe() const {
+            return "order job";
+        }
+    };
+
+    void wait_until_idle(ThreadBasedJobRunner & runner) {
+        for (int i = 0; i < 1000 && !runner.is_idle(); ++ i) {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(queued_jobs_run_by_priority)
+{
+    LogApiScope log(LogOptions::simple());
+
+    ThreadBasedJobRunner runner(3);
+    Thread thread(1024 * 1024, runner);
+    order.clear();
+
+    volatile bool release = false;
+    boost::optional<JobId> first = runner.run(OrderJob(1, &release), 0);
+    BOOST_REQUIRE(!!first);
+    // Give the worker a moment to take the first job.
+    for (int i = 0; i < 200 && !runner.list_jobs().front().is_running();
+         ++ i) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    }
+    BOOST_REQUIRE(runner.run(OrderJob(2, &release), 0));
+    BOOST_REQUIRE(runner.run(OrderJob(3, &release), 5));
+    boost::optional<JobId> cancelled = runner.run(OrderJob(4, &release), 0);
+    BOOST_REQUIRE(!!cancelled);
+    // The queue holds three jobs.
+    BOOST_REQUIRE(!runner.run(OrderJob(5, &release), 0));
+
+    std::list<JobInfo> jobs = runner.list_jobs();
+    BOOST_REQUIRE_EQUAL(4, jobs.size());
+    BOOST_CHECK_EQUAL(first.get(), jobs.front().id);
+    BOOST_CHECK(jobs.front().is_running());
+    BOOST_CHECK_EQUAL("order job", jobs.front().description);
+    BOOST_CHECK(!jobs.back().is_running());
+    BOOST_CHECK_EQUAL(cancelled.get(), jobs.back().id);
+
+    BOOST_CHECK(runner.cancel(cancelled.get()));
+    BOOST_CHECK(!runner.cancel(cancelled.get()));
+    // OrderJob doesn't know how to stop early.
+    BOOST_CHECK(!runner.cancel(first.get()));
+
+    release = true;
+    wait_until_idle(runner);
+    BOOST_REQUIRE(runner.is_idle());
+    BOOST_REQUIRE_EQUAL(3, order.size());
+    BOOST_CHECK_EQUAL(1, order[0]);
+    BOOST_CHECK_EQUAL(3, order[1]);
+    BOOST_CHECK_EQUAL(2, order[2]);
+    runner.shutdown();
+}
+
+BOOST_AUTO_TEST_CASE(jobs_start_without_waiting_for_a_poll)
+{
+    LogApiScope log(LogOptions::simple());
+
+    ThreadBasedJobRunner runner(0, 2);
+    Thread thread1(1024 * 1024, runner);
+    Thread thread2(1024 * 1024, runner);
+    order.clear();
+
+    volatile bool release = true;
+    boost::posix_time::ptime start
+        = boost::posix_time::microsec_clock::universal_time();
+    for (int i = 0; i < 10; ++ i) {
+        while (!runner.run(OrderJob(i, &release))) {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+        }
+    }
+    wait_until_idle(runner);
+    const boost::posix_time::time_duration took
+        = boost::posix_time::microsec_clock::universal_time() - start;
+    BOOST_REQUIRE_EQUAL(10, order.size());
+    BOOST_CHECK(took.total_milliseconds() < 1000);
+    runner.shutdown();
+}
+
+namespace {
+    struct SleepyTask : public PeriodicTask {
+        boost::posix_time::milliseconds nap;
+
+        SleepyTask(long milliseconds) : nap(milliseconds) {
+        }
+
+        virtual void operator()() {
+            boost::this_thread::sleep(nap);
+        }
+    };
+}
+
+BOOST_AUTO_TEST_CASE(periodic_tasks_keep_their_own_cadence)
+{
+    LogApiScope log(LogOptions::simple());
+
+    PeriodicScheduler scheduler(1024 * 1024, 0.01, 16);
+    scheduler.add("quick", PeriodicTaskPtr(new SleepyTask(0)), 0.05);
+    scheduler.add("slow", PeriodicTaskPtr(new SleepyTask(300)), 0.05, 0.01);
+    scheduler.add("rare", PeriodicTaskPtr(new SleepyTask(0)), 60.0);
+    Thread thread(1024 * 1024, scheduler);
+
+    boost::this_thread::sleep(boost::posix_time::seconds(1));
+    scheduler.shutdown();
+
+    std::vector<PeriodicTaskStats> stats = scheduler.get_stats();
+    BOOST_REQUIRE_EQUAL(3, stats.size());
+    BOOST_CHECK_EQUAL("quick", stats[0].name);
+    // The slow task doesn't hold up the quick one...
+    BOOST_CHECK(stats[0].runs >= 10);
+    BOOST_CHECK_EQUAL(0, stats[0].skipped);
+    // ...and doesn't pile up behind itself.
+    BOOST_CHECK(stats[1].runs >= 2 && stats[1].runs <= 4);
+    BOOST_CHECK(stats[1].skipped > 0);
+    BOOST_CHECK(stats[1].max_duration >= 0.3);
+    // Sixty seconds takes several turns of a 16 slot wheel.
+    BOOST_CHECK_EQUAL(0, stats[2].runs);
+}